@@ -0,0 +1,9 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+export { Assembler } from './src/assembler.ts';
+export type { IAssemblerLine, IAssemblerResult } from './src/assembler.ts';
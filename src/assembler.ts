@@ -0,0 +1,115 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { IMakeLine, makeFromFile } from './make.ts';
+import { IPrelex } from './prelex.ts';
+import { pathResolve } from './deps.ts';
+import * as sink from './sink.ts';
+
+export type IAssemblerLine = IMakeLine;
+
+export type IAssemblerResult =
+  | {
+    rom: Uint8Array;
+    base: number;
+    arm: boolean;
+    symbols: { [label: string]: number };
+    lines: IAssemblerLine[];
+    logs: string[];
+  }
+  | { errors: string[]; logs: string[] };
+
+// an assembler session over an in-memory filesystem, using posix paths
+//
+// the session keeps the lexed include tree between builds, so rebuilding after editing a few files
+// only re-lexes those files
+export class Assembler {
+  private files = new Map<string, string | Uint8Array>();
+  private prelex: IPrelex = new Map();
+  private defines: { key: string; value: number }[] = [];
+  // builds share the lexed tree, so they run one at a time
+  private building: Promise<unknown> = Promise.resolve();
+
+  private static normalize(filename: string) {
+    return pathResolve(true, '/', filename);
+  }
+
+  public writeFile(filename: string, data: string | Uint8Array) {
+    this.files.set(Assembler.normalize(filename), data);
+  }
+
+  public deleteFile(filename: string) {
+    this.files.delete(Assembler.normalize(filename));
+  }
+
+  public hasFile(filename: string): boolean {
+    return this.files.has(Assembler.normalize(filename));
+  }
+
+  public define(key: string, value: number) {
+    this.defines = this.defines.filter((d) => d.key !== key);
+    this.defines.push({ key, value });
+  }
+
+  public undefine(key: string) {
+    this.defines = this.defines.filter((d) => d.key !== key);
+  }
+
+  public assemble(filename: string): Promise<IAssemblerResult> {
+    const res = this.building.then(() => this.build(filename));
+    this.building = res.catch(() => {});
+    return res;
+  }
+
+  private async build(filename: string): Promise<IAssemblerResult> {
+    const logs: string[] = [];
+    const res = await makeFromFile(
+      Assembler.normalize(filename),
+      this.defines,
+      true,
+      (file) => file.startsWith('/'),
+      (file) => {
+        if (this.files.has(file)) {
+          return Promise.resolve(sink.fstype.FILE);
+        }
+        for (const f of this.files.keys()) {
+          if (f.startsWith(`${file}/`)) {
+            return Promise.resolve(sink.fstype.DIR);
+          }
+        }
+        return Promise.resolve(sink.fstype.NONE);
+      },
+      (file) => {
+        const data = this.files.get(file);
+        if (data === undefined) {
+          return Promise.reject(new Error(`Not found: ${file}`));
+        }
+        return Promise.resolve(typeof data === 'string' ? data : new TextDecoder().decode(data));
+      },
+      (file) => {
+        const data = this.files.get(file);
+        if (data === undefined) {
+          return Promise.reject(new Error(`Not found: ${file}`));
+        }
+        return Promise.resolve(typeof data === 'string' ? new TextEncoder().encode(data) : data);
+      },
+      (str) => logs.push(str),
+      this.prelex,
+    );
+    if ('errors' in res) {
+      return { errors: res.errors, logs };
+    }
+    return {
+      rom: new Uint8Array(res.result),
+      base: res.base,
+      arm: res.arm,
+      symbols: res.symbols,
+      lines: res.lines,
+      logs,
+    };
+  }
+}
@@ -0,0 +1,250 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+export interface IAudio {
+  rate: number;
+  channels: Float32Array[];
+  loop: false | { start: number; end: number };
+}
+
+function str4(data: Uint8Array, i: number): string {
+  return String.fromCharCode(data[i], data[i + 1], data[i + 2], data[i + 3]);
+}
+
+export function decodeWav(data: Uint8Array): IAudio {
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  if (data.length < 12 || str4(data, 0) !== 'RIFF' || str4(data, 8) !== 'WAVE') {
+    throw 'Unknown audio format, expecting WAV file';
+  }
+  let fmt: false | { format: number; channels: number; rate: number; bits: number } = false;
+  let samples: false | Uint8Array = false;
+  let loop: false | { start: number; end: number } = false;
+  for (let i = 12; i + 8 <= data.length;) {
+    const id = str4(data, i);
+    const size = view.getUint32(i + 4, true);
+    const body = i + 8;
+    if (body + size > data.length) {
+      throw `Invalid WAV file, chunk "${id}" is truncated`;
+    }
+    if (id === 'fmt ') {
+      let format = view.getUint16(body, true);
+      if (format === 0xfffe && size >= 26) {
+        // WAVE_FORMAT_EXTENSIBLE stores the real format in the sub-format GUID
+        format = view.getUint16(body + 24, true);
+      }
+      fmt = {
+        format,
+        channels: view.getUint16(body + 2, true),
+        rate: view.getUint32(body + 4, true),
+        bits: view.getUint16(body + 14, true),
+      };
+    } else if (id === 'data') {
+      samples = data.subarray(body, body + size);
+    } else if (id === 'smpl' && size >= 60 && view.getUint32(body + 28, true) > 0) {
+      // first sample loop; end is inclusive in the file
+      loop = {
+        start: view.getUint32(body + 44, true),
+        end: view.getUint32(body + 48, true) + 1,
+      };
+    }
+    i = body + size + (size & 1);
+  }
+  if (fmt === false || samples === false) {
+    throw 'Invalid WAV file, missing fmt or data chunk';
+  }
+  if (fmt.channels < 1 || fmt.rate <= 0) {
+    throw 'Invalid WAV file, bad channel count or sample rate';
+  }
+
+  let read: (i: number) => number;
+  if (fmt.format === 1 && fmt.bits === 8) {
+    read = (i) => (samples as Uint8Array)[i] / 128 - 1;
+  } else if (fmt.format === 1 && fmt.bits === 16) {
+    const sv = new DataView(samples.buffer, samples.byteOffset, samples.byteLength);
+    read = (i) => sv.getInt16(i, true) / 32768;
+  } else if (fmt.format === 1 && fmt.bits === 24) {
+    const s = samples;
+    read = (i) => (((s[i] << 8) | (s[i + 1] << 16) | (s[i + 2] << 24)) >> 8) / 8388608;
+  } else if (fmt.format === 1 && fmt.bits === 32) {
+    const sv = new DataView(samples.buffer, samples.byteOffset, samples.byteLength);
+    read = (i) => sv.getInt32(i, true) / 2147483648;
+  } else if (fmt.format === 3 && fmt.bits === 32) {
+    const sv = new DataView(samples.buffer, samples.byteOffset, samples.byteLength);
+    read = (i) => sv.getFloat32(i, true);
+  } else {
+    throw `Unsupported WAV format ${fmt.format} with ${fmt.bits}-bit samples`;
+  }
+
+  const bytesPerSample = fmt.bits >> 3;
+  const frameSize = bytesPerSample * fmt.channels;
+  const frames = Math.floor(samples.length / frameSize);
+  const channels: Float32Array[] = [];
+  for (let c = 0; c < fmt.channels; c++) {
+    const ch = new Float32Array(frames);
+    for (let f = 0, k = c * bytesPerSample; f < frames; f++, k += frameSize) {
+      ch[f] = read(k);
+    }
+    channels.push(ch);
+  }
+  if (loop && (loop.start >= loop.end || loop.end > frames)) {
+    loop = false;
+  }
+  return { rate: fmt.rate, channels, loop };
+}
+
+export function mixMono(audio: IAudio): IAudio {
+  if (audio.channels.length === 1) {
+    return audio;
+  }
+  const len = audio.channels[0].length;
+  const out = new Float32Array(len);
+  const scale = 1 / audio.channels.length;
+  for (const ch of audio.channels) {
+    for (let i = 0; i < len; i++) {
+      out[i] += ch[i] * scale;
+    }
+  }
+  return { ...audio, channels: [out] };
+}
+
+// polyphase windowed-sinc resampler
+const PHASES = 256;
+const HALF_TAPS = 16;
+
+function buildFilter(cutoff: number): Float32Array[] {
+  const table: Float32Array[] = [];
+  for (let p = 0; p <= PHASES; p++) {
+    const frac = p / PHASES;
+    const taps = new Float32Array(HALF_TAPS * 2);
+    let sum = 0;
+    for (let k = 0; k < HALF_TAPS * 2; k++) {
+      // distance from the output position to input sample n + k - HALF_TAPS + 1
+      const x = k - HALF_TAPS + 1 - frac;
+      const sx = Math.PI * cutoff * x;
+      const sinc = Math.abs(sx) < 1e-9 ? 1 : Math.sin(sx) / sx;
+      // Blackman window over the full span of the kernel
+      const w = (x / HALF_TAPS + 1) / 2;
+      const win = w <= 0 || w >= 1
+        ? 0
+        : 0.42 - 0.5 * Math.cos(2 * Math.PI * w) + 0.08 * Math.cos(4 * Math.PI * w);
+      taps[k] = sinc * win;
+      sum += taps[k];
+    }
+    // normalize so DC passes through at unity gain
+    for (let k = 0; k < taps.length; k++) {
+      taps[k] /= sum;
+    }
+    table.push(taps);
+  }
+  return table;
+}
+
+export function resample(audio: IAudio, rate: number): IAudio {
+  if (rate === audio.rate) {
+    return audio;
+  }
+  const ratio = rate / audio.rate;
+  // when downsampling, lower the cutoff to the new Nyquist frequency to avoid aliasing
+  const filter = buildFilter(Math.min(1, ratio) * 0.95);
+  const len = Math.floor(audio.channels[0].length * ratio);
+  const channels = audio.channels.map((input) => {
+    const out = new Float32Array(len);
+    const last = input.length - 1;
+    for (let i = 0; i < len; i++) {
+      const t = i / ratio;
+      const n = Math.floor(t);
+      const taps = filter[Math.round((t - n) * PHASES)];
+      let acc = 0;
+      const first = n - HALF_TAPS + 1;
+      if (first >= 0 && first + HALF_TAPS * 2 <= input.length) {
+        for (let k = 0; k < HALF_TAPS * 2; k++) {
+          acc += input[first + k] * taps[k];
+        }
+      } else {
+        // near the edges, clamp to the first and last sample
+        for (let k = 0; k < HALF_TAPS * 2; k++) {
+          acc += input[Math.min(last, Math.max(0, first + k))] * taps[k];
+        }
+      }
+      out[i] = acc;
+    }
+    return out;
+  });
+  // the length rounds down, so a loop running to the last sample could round up past the end, and
+  // a short loop near the end could shrink to nothing, so keep at least one sample in it
+  const end = Math.min(len, Math.round(audio.loop === false ? 0 : audio.loop.end * ratio));
+  if (audio.loop !== false && end < 1) {
+    throw 'Resampled audio is too short to loop';
+  }
+  const loop = audio.loop === false ? false : {
+    start: Math.min(end - 1, Math.round(audio.loop.start * ratio)),
+    end,
+  };
+  return { rate, channels, loop };
+}
+
+// pad the start with silence so the loop starts on a multiple of `align` samples, and repeat the
+// loop body until its length is also a multiple of `align`, so the whole sample can be streamed to
+// the FIFO in fixed-size blocks; without a loop, just pad the end with silence
+export function alignLoop(audio: IAudio, align: number): IAudio {
+  const len = audio.channels[0].length;
+  const gcd = (a: number, b: number): number => b === 0 ? a : gcd(b, a % b);
+  let pre = 0;
+  let loopLen = 0;
+  let copies = 0;
+  let total;
+  if (audio.loop === false) {
+    total = Math.ceil(len / align) * align;
+  } else {
+    pre = (align - (audio.loop.start % align)) % align;
+    loopLen = audio.loop.end - audio.loop.start;
+    if (loopLen <= 0) {
+      throw `Invalid loop points: ${audio.loop.start}, ${audio.loop.end}`;
+    }
+    copies = align / gcd(loopLen, align);
+    total = pre + audio.loop.start + loopLen * copies;
+  }
+  const channels = audio.channels.map((input) => {
+    const out = new Float32Array(total);
+    if (audio.loop === false) {
+      out.set(input);
+    } else {
+      out.set(input.subarray(0, audio.loop.end), pre);
+      const body = input.subarray(audio.loop.start, audio.loop.end);
+      for (let c = 1; c < copies; c++) {
+        out.set(body, pre + audio.loop.end + (c - 1) * loopLen);
+      }
+    }
+    return out;
+  });
+  const loop = audio.loop === false ? false : {
+    start: pre + audio.loop.start,
+    end: total,
+  };
+  return { rate: audio.rate, channels, loop };
+}
+
+export function toS8(samples: Float32Array, dither: boolean): Int8Array {
+  const out = new Int8Array(samples.length);
+  // fixed seed so builds are reproducible
+  let seed = 0x12345678;
+  const rand = () => {
+    seed ^= seed << 13;
+    seed ^= seed >>> 17;
+    seed ^= seed << 5;
+    return (seed >>> 0) / 4294967296;
+  };
+  for (let i = 0; i < samples.length; i++) {
+    let v = samples[i] * 128;
+    if (dither) {
+      // triangular PDF dither, spanning +/- 1 LSB
+      v += rand() - rand();
+    }
+    out[i] = Math.max(-128, Math.min(127, Math.round(v)));
+  }
+  return out;
+}
@@ -0,0 +1,263 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { CPU } from './run.ts';
+import { hex16 } from './util.ts';
+
+// high-level emulation of BIOS calls for `gvasm run`: each call does its work directly, and counts
+// the cycles the BIOS code would take, so it can be compared against hand-written routines
+//
+// BIOS code fetches take 1 cycle, so costs are the data accesses plus the instructions of each
+// loop, and a fixed cost to enter, dispatch, and return
+
+const CALL_CYCLES = 60;
+
+class Access {
+  private cpu: CPU;
+  // the address of the last access in each direction, so runs of accesses are sequential
+  private lastRead = -1;
+  private lastWrite = -1;
+
+  constructor(cpu: CPU) {
+    this.cpu = cpu;
+  }
+
+  public read(addr: number, size: 1 | 2 | 4) {
+    this.cpu.idle(this.cpu.accessCycles(addr, size, addr === this.lastRead));
+    this.lastRead = addr + size;
+    return size === 1
+      ? this.cpu.read8(addr)
+      : size === 2
+      ? this.cpu.read16(addr)
+      : this.cpu.read32(addr) | 0;
+  }
+
+  public write(addr: number, size: 1 | 2 | 4, value: number) {
+    this.cpu.idle(this.cpu.accessCycles(addr, size, addr === this.lastWrite));
+    this.lastWrite = addr + size;
+    if (size === 1) {
+      this.cpu.write8(addr, value);
+    } else if (size === 2) {
+      this.cpu.write16(addr, value);
+    } else {
+      this.cpu.write32(addr, value);
+    }
+  }
+
+  // instructions between accesses; the BIOS alternates reads and writes, so every access is
+  // non-sequential unless it's part of an ldm/stm
+  public instructions(count: number) {
+    this.cpu.idle(count);
+    this.lastRead = -1;
+    this.lastWrite = -1;
+  }
+}
+
+// r0 = source, r1 = destination, r2 = count (bits 0-20), fill (bit 24), 32-bit (bit 26)
+function cpuSet(cpu: CPU, bus: Access) {
+  const src = cpu.reg(0);
+  const dst = cpu.reg(1);
+  const count = cpu.reg(2) & 0x1fffff;
+  const fill = !!(cpu.reg(2) & (1 << 24));
+  const size = cpu.reg(2) & (1 << 26) ? 4 : 2;
+  const value = fill ? bus.read(src, size) : 0;
+  for (let i = 0; i < count; i++) {
+    // ldr, str, subs, bgt
+    bus.write(dst + i * size, size, fill ? value : bus.read(src + i * size, size));
+    bus.instructions(fill ? 5 : 7);
+  }
+}
+
+// like CpuSet, but always 32-bit, and copies 8 words at a time with ldm/stm, so the count is
+// rounded up to a multiple of 8
+function cpuFastSet(cpu: CPU, bus: Access) {
+  const src = cpu.reg(0);
+  const dst = cpu.reg(1);
+  const count = ((cpu.reg(2) & 0x1fffff) + 7) & ~7;
+  const fill = !!(cpu.reg(2) & (1 << 24));
+  const value = fill ? bus.read(src, 4) : 0;
+  const block = [0, 0, 0, 0, 0, 0, 0, 0];
+  for (let i = 0; i < count; i += 8) {
+    for (let j = 0; j < 8; j++) {
+      block[j] = fill ? value : bus.read(src + (i + j) * 4, 4);
+    }
+    for (let j = 0; j < 8; j++) {
+      bus.write(dst + (i + j) * 4, 4, block[j]);
+    }
+    // ldmia, stmia, subs, bgt
+    bus.instructions(fill ? 5 : 7);
+  }
+}
+
+// writes a halfword at a time for VRAM, like the BIOS, which holds the even byte until the odd one
+// is ready, so it isn't in memory yet
+class ByteWriter {
+  private bus: Access;
+  private vram: boolean;
+  public addr: number;
+  private pending = 0;
+
+  constructor(bus: Access, addr: number, vram: boolean) {
+    this.bus = bus;
+    this.addr = addr;
+    this.vram = vram;
+  }
+
+  public write(value: number) {
+    if (!this.vram) {
+      this.bus.write(this.addr, 1, value);
+    } else if (this.addr & 1) {
+      this.bus.write(this.addr - 1, 2, this.pending | (value << 8));
+    } else {
+      this.pending = value;
+    }
+    if (this.vram) {
+      // test the address, then shift and combine the bytes
+      this.bus.instructions(3);
+    }
+    this.addr++;
+  }
+}
+
+// r0 = source, r1 = destination; header is 0x10 | size << 8, then groups of a flag byte followed by
+// 8 literals or matches, see lz77.ts
+function lz77UnComp(cpu: CPU, bus: Access, vram: boolean) {
+  let src = cpu.reg(0);
+  const out = new ByteWriter(bus, cpu.reg(1), vram);
+  const end = out.addr + (bus.read(src, 4) >>> 8);
+  src += 4;
+  bus.instructions(4);
+  while (out.addr < end) {
+    // ldrb, mov, b
+    const flags = bus.read(src++, 1);
+    bus.instructions(6);
+    for (let bit = 0x80; bit && out.addr < end; bit >>= 1) {
+      if (flags & bit) {
+        // ldrb, ldrb, and, orr, add, mov, add, bne
+        const b0 = bus.read(src++, 1);
+        const b1 = bus.read(src++, 1);
+        bus.instructions(13);
+        const length = (b0 >> 4) + 3;
+        const from = out.addr - (((b0 & 0xf) << 8) | b1) - 1;
+        for (let i = 0; i < length && out.addr < end; i++) {
+          // ldrb, strb, subs, subs, bgt
+          out.write(bus.read(from + i, 1));
+          bus.instructions(8);
+        }
+      } else {
+        // tst, bne, ldrb, strb, subs, subs, bne
+        out.write(bus.read(src++, 1));
+        bus.instructions(10);
+      }
+    }
+  }
+}
+
+// r0 = source, r1 = destination; header is 0x30 | size << 8, then blocks starting with a flag byte:
+// bit 7 set is a run of (flag & 0x7f) + 3 copies of the next byte, otherwise (flag & 0x7f) + 1
+// literal bytes follow
+function rlUnComp(cpu: CPU, bus: Access, vram: boolean) {
+  let src = cpu.reg(0);
+  const out = new ByteWriter(bus, cpu.reg(1), vram);
+  const end = out.addr + (bus.read(src, 4) >>> 8);
+  src += 4;
+  bus.instructions(4);
+  while (out.addr < end) {
+    // ldrb, tst, and, bne
+    const flag = bus.read(src++, 1);
+    bus.instructions(6);
+    if (flag & 0x80) {
+      const value = bus.read(src++, 1);
+      for (let i = (flag & 0x7f) + 3; i > 0 && out.addr < end; i--) {
+        // strb, subs, subs, bgt
+        out.write(value);
+        bus.instructions(6);
+      }
+    } else {
+      for (let i = (flag & 0x7f) + 1; i > 0 && out.addr < end; i--) {
+        // ldrb, strb, subs, subs, bgt
+        out.write(bus.read(src++, 1));
+        bus.instructions(8);
+      }
+    }
+  }
+}
+
+// bits in the quotient of a / b, for the shift-subtract loops below
+function quotientBits(a: number, b: number) {
+  let bits = 1;
+  while (bits < 32 && b * 2 ** bits <= a) {
+    bits++;
+  }
+  return bits;
+}
+
+// numerator / denominator; returns r0 = quotient, r1 = remainder, r3 = |quotient|, rounded towards
+// zero like C
+function div(cpu: CPU, numerator: number, denominator: number) {
+  if (denominator === 0) {
+    throw 'BIOS Div by zero';
+  }
+  const a = Math.abs(numerator);
+  const b = Math.abs(denominator);
+  const quotient = Math.floor(a / b);
+  const remainder = a % b;
+  // signs: ands, rsbmi, eors, rsbcs, then shift the denominator up to the numerator (cmp, movls,
+  // bls) and back down a bit at a time (cmp, subcs, adc, mov, cmp, bne)
+  const bits = quotientBits(a, b);
+  cpu.idle(8 + bits * 5 + bits * 8);
+  cpu.mov(0, (numerator < 0) !== (denominator < 0) ? -quotient : quotient);
+  cpu.mov(1, numerator < 0 ? -remainder : remainder);
+  cpu.mov(3, quotient);
+}
+
+// r0 = value; returns r0 = the integer square root, with a bit found each loop (add, cmp, subcs,
+// orrcs, movs, bne)
+function sqrt(cpu: CPU) {
+  const value = cpu.reg(0) >>> 0;
+  let root = Math.floor(Math.sqrt(value));
+  // floating point can round up near perfect squares
+  while (root * root > value) {
+    root--;
+  }
+  cpu.idle(8 + 16 * 8);
+  cpu.mov(0, root);
+}
+
+export function bios(cpu: CPU, comment: number) {
+  const bus = new Access(cpu);
+  cpu.idle(CALL_CYCLES);
+  switch (comment) {
+    case 0x06:
+      div(cpu, cpu.reg(0), cpu.reg(1));
+      break;
+    case 0x07:
+      div(cpu, cpu.reg(1), cpu.reg(0));
+      break;
+    case 0x08:
+      sqrt(cpu);
+      break;
+    case 0x0b:
+      cpuSet(cpu, bus);
+      break;
+    case 0x0c:
+      cpuFastSet(cpu, bus);
+      break;
+    case 0x11:
+    case 0x12:
+      lz77UnComp(cpu, bus, comment === 0x12);
+      break;
+    case 0x14:
+    case 0x15:
+      rlUnComp(cpu, bus, comment === 0x15);
+      break;
+    default:
+      throw `Not implemented: BIOS call ${hex16(comment)}`;
+  }
+  // the BIOS returns with `movs pc, lr`, which refills the pipeline at the instruction after swi
+  cpu.refill(cpu.pc() - (cpu.isARM() ? 4 : 2));
+}
@@ -0,0 +1,152 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+// bits are packed into bytes either starting at bit 0 (LSB-first, what GBA code usually wants
+// since it can `and` and `lsr` its way through a word), or starting at bit 7 (MSB-first, the
+// traditional order for compressed streams)
+
+export class BitWriter {
+  private data = new Uint8Array(256);
+  private bitPos = 0;
+  public readonly msb: boolean;
+
+  constructor(msb: boolean) {
+    this.msb = msb;
+  }
+
+  public bitLength() {
+    return this.bitPos;
+  }
+
+  public byteLength() {
+    return (this.bitPos + 7) >> 3;
+  }
+
+  private grow(bits: number) {
+    const need = (this.bitPos + bits + 7) >> 3;
+    if (need <= this.data.length) {
+      return;
+    }
+    let size = this.data.length * 2;
+    while (size < need) {
+      size *= 2;
+    }
+    const data = new Uint8Array(size);
+    data.set(this.data);
+    this.data = data;
+  }
+
+  public write(value: number, count: number) {
+    if (count < 0 || count > 32) {
+      throw `Invalid bit count: ${count}`;
+    }
+    this.grow(count);
+    value = value >>> 0;
+    if (this.msb) {
+      while (count > 0) {
+        const off = this.bitPos & 7;
+        const n = Math.min(8 - off, count);
+        const bits = (value >>> (count - n)) & ((1 << n) - 1);
+        this.data[this.bitPos >> 3] |= bits << (8 - off - n);
+        count -= n;
+        this.bitPos += n;
+      }
+    } else {
+      while (count > 0) {
+        const off = this.bitPos & 7;
+        const n = Math.min(8 - off, count);
+        this.data[this.bitPos >> 3] |= (value & ((1 << n) - 1)) << off;
+        value >>>= n;
+        count -= n;
+        this.bitPos += n;
+      }
+    }
+  }
+
+  // pad with zero bits until the stream is a multiple of `bytes` bytes long
+  public align(bytes: number) {
+    const bits = bytes * 8;
+    const pad = (bits - (this.bitPos % bits)) % bits;
+    this.grow(pad);
+    this.bitPos += pad;
+  }
+
+  public bytes(): Uint8Array {
+    return this.data.slice(0, this.byteLength());
+  }
+}
+
+export class BitReader {
+  private data: Uint8Array;
+  private bitPos = 0;
+  public readonly msb: boolean;
+
+  constructor(data: Uint8Array, msb: boolean) {
+    this.data = data;
+    this.msb = msb;
+  }
+
+  public position() {
+    return this.bitPos;
+  }
+
+  public left() {
+    return this.data.length * 8 - this.bitPos;
+  }
+
+  public read(count: number): number {
+    if (count < 0 || count > 32) {
+      throw `Invalid bit count: ${count}`;
+    }
+    if (count > this.left()) {
+      throw 'Read past end of bitstream';
+    }
+    let result = 0;
+    if (this.msb) {
+      while (count > 0) {
+        const off = this.bitPos & 7;
+        const n = Math.min(8 - off, count);
+        const bits = (this.data[this.bitPos >> 3] >> (8 - off - n)) & ((1 << n) - 1);
+        result = result * (1 << n) + bits;
+        count -= n;
+        this.bitPos += n;
+      }
+    } else {
+      let scale = 1;
+      while (count > 0) {
+        const off = this.bitPos & 7;
+        const n = Math.min(8 - off, count);
+        const bits = (this.data[this.bitPos >> 3] >> off) & ((1 << n) - 1);
+        result += bits * scale;
+        scale *= 1 << n;
+        count -= n;
+        this.bitPos += n;
+      }
+    }
+    return result;
+  }
+
+  public readSigned(count: number): number {
+    const v = this.read(count);
+    if (count > 0 && v >= 2 ** (count - 1)) {
+      return v - 2 ** count;
+    }
+    return v;
+  }
+
+  public skip(count: number) {
+    if (count < 0 || count > this.left()) {
+      throw 'Skip past end of bitstream';
+    }
+    this.bitPos += count;
+  }
+
+  public align(bytes: number) {
+    const bits = bytes * 8;
+    this.skip(Math.min(this.left(), (bits - (this.bitPos % bits)) % bits));
+  }
+}
@@ -24,6 +24,8 @@ interface IPool {
   bytes: 1 | 2 | 4;
   align: 1 | 2 | 4;
   sym: string;
+  reach: number; // furthest the pool can be placed after the instruction
+  veneer?: 'arm' | 'thumb';
 }
 
 interface IPendingExpr {
@@ -44,6 +46,17 @@ export interface IBase {
   relativeTo: number;
 }
 
+// decisions carried from one layout pass to the next
+export interface ILayout {
+  veneers: Set<number>; // branch sites that must go through a veneer
+  relaxed: Set<number>; // relaxable branch sites that must use their long form
+}
+
+export interface ILayoutMisses {
+  veneers: number[];
+  relaxed: number[];
+}
+
 export class Bytes {
   private base: IBase = {
     value: 0x08000000,
@@ -53,10 +66,33 @@ export class Bytes {
   private pendingExprs: IPendingExpr[] = [];
   private globalLabels: { [name: string]: number } = {};
   private localLabels: { [name: string]: number }[] = [{}];
+  // whether each global label was defined in ARM or Thumb code, so veneers can switch modes
+  private labelModes: { [name: string]: 'arm' | 'thumb' } = {};
+  private layout: ILayout;
+  private branchSites = 0;
+  private branchMisses = new Set<number>();
+  private veneerCount = 0;
+  private relaxSites = 0;
+  private relaxLong = 0;
+  private relaxMisses = new Set<number>();
+  // labels waiting for the next byte, so a pool written before that byte goes before them too
+  // byte ranges of pools written automatically, which don't belong to the source line being parsed
+  private autoPools: { start: number; end: number }[] = [];
+  private deferredLabels: {
+    label: string;
+    mode?: 'arm' | 'thumb';
+    onDefine?: (addr: number) => void;
+  }[] = [];
 
   public firstBase = 0x08000000;
+  public autoPool = false;
+
+  constructor(layout: ILayout = { veneers: new Set(), relaxed: new Set() }) {
+    this.layout = layout;
+  }
 
   public get(): readonly number[] {
+    this.flushLabels();
     for (const pex of this.pendingExprs) {
       for (const expr of Object.values(pex.exprs)) {
         if (expr instanceof Expression) {
@@ -64,7 +100,9 @@ export class Bytes {
         }
       }
       if (pex.pool) {
-        throw `${pex.hint}, missing .pool statement to hold constant`;
+        throw `${pex.hint}, missing .pool statement to hold ${
+          pex.pool.veneer ? 'veneer' : 'constant'
+        }`;
       }
     }
     return this.array;
@@ -83,6 +121,7 @@ export class Bytes {
   }
 
   public setBase(base: IBase) {
+    this.flushLabels();
     if (this.array.length <= 0) {
       this.firstBase = base.value;
     }
@@ -94,6 +133,7 @@ export class Bytes {
   }
 
   private push(...v: number[]) {
+    this.flushLabels();
     if (this.array.length + v.length > MAX_LENGTH) {
       throw `Program too large, exceeds maximum length of 0x${MAX_LENGTH.toString(16)} bytes`;
     }
@@ -114,9 +154,13 @@ export class Bytes {
     this.push(v, v >> 8, v >> 16, v >> 24);
   }
 
-  public writeArray(v: number[] | Uint8Array) {
+  public writeArray(v: readonly number[] | Uint8Array) {
+    this.flushLabels();
+    if (this.array.length + v.length > MAX_LENGTH) {
+      throw `Program too large, exceeds maximum length of 0x${MAX_LENGTH.toString(16)} bytes`;
+    }
     for (let i = 0; i < v.length; i++) {
-      this.push(v[i] & 0xff);
+      this.array.push(v[i] & 0xff);
     }
   }
 
@@ -243,6 +287,83 @@ export class Bytes {
     });
   }
 
+  // a branch that can't reach its target is sent through a veneer in the next pool instead; since
+  // the target might not be known until after that pool, a layout pass only records the misses,
+  // and the next pass reserves veneers for them
+  public exprBranch(
+    hint: string,
+    exprs: { [name: string]: Expression | number },
+    sym: string,
+    mode: 'arm' | 'thumb',
+    reach: number,
+    build: BuildWithoutPoolFunc,
+  ) {
+    const site = this.branchSites++;
+    const veneer = this.layout.veneers.has(site);
+    const pcOffset = mode === 'arm' ? 8 : 4;
+    this.expr32(
+      hint,
+      exprs,
+      veneer ? { bytes: 4, align: 4, sym, reach, veneer: mode } : false,
+      (values, address) => {
+        if (veneer) {
+          return false;
+        }
+        const offset = values[sym] - address - pcOffset;
+        if (offset < -reach || offset >= reach) {
+          this.branchMisses.add(site);
+          return 0;
+        }
+        return build(values, address);
+      },
+      (values, address, poolAddress) => {
+        const offset = poolAddress - address - pcOffset;
+        if (offset < -reach || offset >= reach) {
+          throw 'Next .pool too far away';
+        }
+        return build({ ...values, [sym]: poolAddress }, address) as number;
+      },
+    );
+  }
+
+  // a relaxable branch starts out in its 16-bit short form, and sites that can't reach are given
+  // their 32-bit long form in the next pass; forms only ever grow, so the layout settles
+  public exprRelax(
+    hint: string,
+    exprs: { [name: string]: Expression | number },
+    sym: string,
+    reach: number,
+    buildShort: BuildWithoutPoolFunc,
+    buildLong: BuildWithoutPoolFunc,
+  ) {
+    const site = this.relaxSites++;
+    if (this.layout.relaxed.has(site)) {
+      this.relaxLong++;
+      this.expr32(hint, exprs, false, buildLong);
+      return;
+    }
+    this.expr16(hint, exprs, false, (values, address) => {
+      const offset = values[sym] - address - 4;
+      if (offset < -reach || offset >= reach) {
+        this.relaxMisses.add(site);
+        return 0;
+      }
+      return buildShort(values, address);
+    });
+  }
+
+  public getLayoutMisses(): ILayoutMisses {
+    return { veneers: [...this.branchMisses], relaxed: [...this.relaxMisses] };
+  }
+
+  public getRelaxStats() {
+    return { sites: this.relaxSites, long: this.relaxLong };
+  }
+
+  public getVeneerCount() {
+    return this.veneerCount;
+  }
+
   public addLabelsToExpression(expr: Expression) {
     for (const [label, v] of Object.entries(this.globalLabels)) {
       expr.addLabel(label, v);
@@ -297,15 +418,40 @@ export class Bytes {
     return true;
   }
 
-  public addLabel(label: string) {
+  public addLabel(label: string, mode?: 'arm' | 'thumb', onDefine?: (addr: number) => void) {
     const isLocal = label.startsWith('@@');
     const scope = isLocal ? this.localLabels[0] : this.globalLabels;
-    if (label.startsWith('@') && label in scope) {
+    if (
+      label.startsWith('@') &&
+      (label in scope || this.deferredLabels.some((d) => d.label === label))
+    ) {
       throw `Cannot redefine label: ${label}`;
     }
+    if (this.autoPool && this.hasPendingPool()) {
+      this.deferredLabels.push({ label, mode, onDefine });
+    } else {
+      this.defineLabel(label, mode, onDefine);
+    }
+  }
+
+  public flushLabels() {
+    const labels = this.deferredLabels;
+    this.deferredLabels = [];
+    for (const { label, mode, onDefine } of labels) {
+      this.defineLabel(label, mode, onDefine);
+    }
+  }
+
+  private defineLabel(label: string, mode?: 'arm' | 'thumb', onDefine?: (addr: number) => void) {
+    const isLocal = label.startsWith('@@');
+    const scope = isLocal ? this.localLabels[0] : this.globalLabels;
+    if (mode && !isLocal && label.startsWith('@')) {
+      this.labelModes[label] = mode;
+    }
 
     // add label knowledge
     const v = this.nextAddress();
+    onDefine?.(v);
     if (!label.startsWith('+')) { // don't store forward reference labels
       scope[label] = v;
     }
@@ -334,11 +480,18 @@ export class Bytes {
     }
   }
 
+  // global labels only, since local labels are discarded at the end of their scope
+  public getLabels(): { [name: string]: number } {
+    this.flushLabels();
+    return { ...this.globalLabels };
+  }
+
   public scopeBegin() {
     this.localLabels.unshift({});
   }
 
   public scopeEnd() {
+    this.flushLabels();
     if (this.localLabels.length > 1) {
       this.localLabels.shift();
     } else {
@@ -374,9 +527,82 @@ export class Bytes {
     this.push(crc & 0xff);
   }
 
+  private hasPendingPool() {
+    return this.pendingExprs.some((pex) => pex.pool && pex.poolAddress === false);
+  }
+
+  // with automatic pools, nothing falls through an unconditional branch, so it's a free place to
+  // write the pool
+  public autoPoolAfterTransfer(arm: boolean) {
+    if (this.autoPool && this.hasPendingPool()) {
+      const start = this.array.length;
+      this.writePool();
+      this.align(arm ? 4 : 2);
+      this.autoPools.push({ start, end: this.array.length });
+    }
+  }
+
+  // with automatic pools, make sure every pending entry can still reach a pool written after the
+  // next `length` bytes of instructions or data; otherwise, write the pool now with a branch around
+  // it, before any labels waiting for those bytes
+  public autoPoolBefore(arm: boolean, length: number) {
+    if (!this.autoPool) {
+      return;
+    }
+    let deadline = Infinity;
+    let size = 0;
+    for (const pex of this.pendingExprs) {
+      if (pex.pool && pex.poolAddress === false) {
+        deadline = Math.min(deadline, pex.address + pex.pool.reach);
+        size += pex.pool.veneer ? 19 : pex.pool.bytes + pex.pool.align - 1;
+      }
+    }
+    // leave room for the branch around, and alignment
+    if (deadline === Infinity || this.nextAddress() + length + 8 + size <= deadline) {
+      return;
+    }
+    this.writePoolAround(arm);
+  }
+
+  // with automatic pools, the end of a .begin block writes what's pending, since the code after it
+  // might have a different base, or manual pools
+  public autoPoolEnd(arm: boolean) {
+    if (this.autoPool && this.hasPendingPool()) {
+      this.writePoolAround(arm);
+    }
+  }
+
+  private writePoolAround(arm: boolean) {
+    const labels = this.deferredLabels;
+    this.deferredLabels = [];
+    const start = this.array.length;
+    const address = this.nextAddress();
+    const rewrite = arm ? this.rewrite32() : this.rewrite16();
+    this.writePool();
+    this.align(arm ? 4 : 2);
+    const offset = this.nextAddress() - address - (arm ? 8 : 4);
+    if (arm) {
+      rewrite(0xea000000 | ((offset >> 2) & 0xffffff)); // b next
+    } else if (offset < 2048) {
+      rewrite(0xe000 | ((offset >> 1) & 0x7ff)); // b next
+    } else {
+      throw 'Pool too large to branch around';
+    }
+    this.autoPools.push({ start, end: this.array.length });
+    this.deferredLabels = labels;
+    this.flushLabels();
+  }
+
+  // returns the automatic pools written since the last call
+  public takeAutoPools() {
+    const pools = this.autoPools;
+    this.autoPools = [];
+    return pools;
+  }
+
   public writePool(): boolean {
     let result = false;
-    const written: { v: number; addr: number }[] = [];
+    const written: { key: string; addr: number }[] = [];
     for (let i = 0; i < this.pendingExprs.length; i++) {
       const pex = this.pendingExprs[i];
       if (pex.pool && pex.poolAddress === false) {
@@ -392,12 +618,48 @@ export class Bytes {
         }
         result = true;
 
+        // constants can only be shared once known, but veneers can share a target expression
+        let key: string | false = false;
+        if (pex.pool.veneer) {
+          const ek = typeof writev === 'number' ? `${writev}` : (pv as Expression).key();
+          key = ek === false ? false : `${pex.pool.veneer}:${ek}`;
+        } else if (typeof writev === 'number') {
+          key = `${writev}`;
+        }
+
         // see if we already wrote it to the pool
-        const w = written.find((w) => w.v === writev);
+        const w = key === false ? undefined : written.find((w) => w.key === key);
         let poolAddress;
         if (w) {
           // we already wrote this constant, so use it again
           poolAddress = w.addr;
+        } else if (pex.pool.veneer) {
+          // write a veneer that jumps to the target, using ip as scratch; the target's mode comes
+          // from its label, or stays the same as the caller if it isn't a plain label
+          const thumb = pex.pool.veneer === 'thumb';
+          const targetLabel = typeof pv === 'number' ? false : pv.label();
+          const target = (v: number) => {
+            const mode = (targetLabel && this.labelModes[targetLabel]) || pex.pool?.veneer;
+            return mode === 'thumb' ? v | 1 : v;
+          };
+          this.align(4);
+          poolAddress = this.nextAddress();
+          if (thumb) {
+            this.write16(0x4778); // bx pc
+            this.write16(0x46c0); // nop
+          }
+          this.write32(0xe59fc000); // ldr ip, [pc]
+          this.write32(0xe12fff1c); // bx ip
+          if (typeof writev === 'number') {
+            this.write32(target(writev));
+          } else {
+            const rewrite = this.rewrite32();
+            pex.rewritePool = (v) => rewrite(target(v));
+          }
+          if (key !== false) {
+            written.push({ key, addr: poolAddress });
+          }
+          this.veneerCount++;
         } else {
           // we haven't written this constant, so write it
 
@@ -417,7 +679,7 @@ export class Bytes {
             } else {
               throw new Error('Invalid byte size for pool value');
             }
-            written.push({ v: writev, addr: poolAddress });
+            written.push({ key: `${writev}`, addr: poolAddress });
           } else {
             // we don't know the constant yet, so rewrite it instead
             if (pex.pool.bytes === 1) {
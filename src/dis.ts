@@ -56,6 +56,7 @@ export function parseARM(opcode: number, runOnly = false): { op: ARM.IOp; syms:
           syms[part.sym] = { v, part };
           break;
         case 'pcoffset12':
+        case 'offset12':
           if (part.sym) {
             if (part.sign) {
               if (v === 0) {
@@ -70,7 +71,6 @@ export function parseARM(opcode: number, runOnly = false): { op: ARM.IOp; syms:
         case 'ignored':
         case 'immediate':
         case 'rotimm':
-        case 'offset12':
         case 'reglist':
           if (part.sym) {
             syms[part.sym] = { v, part };
@@ -179,11 +179,7 @@ export function parseThumb(
           }
           break;
         case 'word':
-          if (v & (1 << (part.s - 1))) {
-            syms[part.sym] = { v: ((-1 << part.s) + v) << 2, part };
-          } else {
-            syms[part.sym] = { v: v << 2, part };
-          }
+          syms[part.sym] = { v: v << 2, part };
           break;
         case 'negword': {
           const vv = -v;
@@ -679,6 +679,22 @@ export class Expression {
     }
   }
 
+  // two expressions with the same key are guaranteed to have the same value, even before their
+  // labels are known; local and anonymous labels can refer to different places, so they have no key
+  public key(): string | false {
+    for (const label of this.labelsNeed) {
+      if (!label.startsWith('@') || label.startsWith('@@')) {
+        return false;
+      }
+    }
+    return JSON.stringify([this.expr, this.labelsHave]);
+  }
+
+  // the label name, if the whole expression is just a reference to a label
+  public label(): string | false {
+    return this.expr.kind === 'label' ? this.expr.label : false;
+  }
+
   public addLabel(label: string, v: number) {
     if (this.labelsNeed.has(label)) {
       this.labelsNeed.delete(label);
@@ -5,13 +5,1536 @@
 // Project Home: https://github.com/velipso/gvasm
 //
 
+// the routines are ARM code that runs from IWRAM; they're assembled in place, but with addresses in
+// IWRAM, and @ext.init copies them there
+//
+// routines follow the usual calling convention: arguments in r0-r3, and r0-r3 and r12 can be
+// clobbered
+//
+// variables are structs in EWRAM at $ext.ewram, and in IWRAM at $ext.iwram before the routines,
+// which @ext.init clears
+
 export const extlib = `
 .once
-@ext.init:
+.if !defined($ext.iwram)
+  .def $ext.iwram = 0x03000000
+.end
+.if !defined($ext.ewram)
+  .if $_base >= 0x02000000 && $_base < 0x03000000
+    .error "Program runs from EWRAM, so define $ext.ewram to place .extlib variables"
+  .end
+  .def $ext.ewram = 0x02000000
+.end
+.if !defined($ext.dmaq.length)
+  .def $ext.dmaq.length = 32
+.end
+.if $ext.dmaq.length > 256 || ($ext.dmaq.length & ($ext.dmaq.length - 1))
+  .error "$ext.dmaq.length must be a power of 2, up to 256"
+.end
+.if !defined($ext.debug)
+  .def $ext.debug = 0
+.end
+.if !defined($ext.co.count)
+  .def $ext.co.count = 8
+.end
+.if !defined($ext.co.stack)
+  .def $ext.co.stack = 1024
+.end
+.if $ext.co.count < 1 || $ext.co.stack < 64 || ($ext.co.stack & 7)
+  .error "$ext.co.count must be at least 1, and $ext.co.stack a multiple of 8, at least 64"
+.end
+.if !defined($ext.mix.count)
+  .def $ext.mix.count = 4
+.end
+.if !defined($ext.mix.length)
+  .def $ext.mix.length = 304
+.end
+.if $ext.mix.count < 1 || $ext.mix.count > 32
+  .error "$ext.mix.count must be 1 to 32"
+.end
+// Timer 0 overflows every 280896 / $ext.mix.length cycles, so there's a whole number of samples in
+// each frame of 280896 cycles
+.if $ext.mix.length < 16 || $ext.mix.length > 1024 || ($ext.mix.length & 15)
+  .error "$ext.mix.length must be a multiple of 16, up to 1024"
+.end
+.if 280896 % $ext.mix.length
+  .error "$ext.mix.length must divide 280896"
+.end
+.if !defined($ext.prof.length)
+  .def $ext.prof.length = 64
+.end
+.if $ext.prof.length > 256 || ($ext.prof.length & ($ext.prof.length - 1))
+  .error "$ext.prof.length must be a power of 2, up to 256"
+.end
+
+// pools are declared by storing a list of {name, block bytes, count, 'ewram' or 'iwram'} under
+// 'ext.pools' before .extlib
+.script
+  for var pool: store.get 'ext.pools', {}
+    if !islist pool || &pool != 4 || !isstr pool[0] || !isnum pool[1] || !isnum pool[2]
+      abort "Invalid pool in ext.pools, expecting {name, block bytes, count, region}"
+    end
+    var name = pool[0]
+    if pool[1] < 4 || pool[1] % 4 != 0
+      abort "Pool $name must have a block size that is a multiple of 4"
+    end
+    if pool[2] < 1
+      abort "Pool $name must have at least one block"
+    end
+    if pool[3] != 'ewram' && pool[3] != 'iwram'
+      abort "Pool $name must be in 'ewram' or 'iwram'"
+    end
+  end
+.end
+
+// profiler zones are declared by storing a list of names under 'ext.prof.zones' before .extlib, and
+// each gets a number at $ext.zone.<name>
+.script
+  var zones = store.get 'ext.prof.zones', {}
+  if !islist zones || &zones > 32
+    abort "Invalid ext.prof.zones, expecting a list of up to 32 names"
+  end
+  var width = 0
+  for var zone, i: zones
+    if !isstr zone
+      abort "Invalid zone in ext.prof.zones, expecting a name"
+    end
+    put '.def $ext.zone.' ~ zone ~ ' = ' ~ i
+    width = num.max width, &zone
+  end
+  put '.def $ext.prof.zones = ' ~ &zones
+  // results are printed after the longest name
+  put '.def $ext.prof.width = ' ~ (width + 1)
+.end
+
+.struct $ext = $ext.ewram
+  .struct dmaq
+    .s32 overflow   // pushes dropped because the queue was full
+    .s32 deferred   // flushes that ran out of budget
+    .s32 head[4]    // next entry to flush, for each priority
+    .s32 tail[4]    // next entry to push, for each priority
+    // dst, src, DMA3CNT, cost; entry i of priority p is at index i * 4 + p
+    .s32 entries[$ext.dmaq.length * 16]
+  .end
+  .struct pool
+    // header (free list, blocks used, most blocks used) followed by the blocks
+    .script
+      for var pool: store.get 'ext.pools', {}
+        if pool[3] == 'ewram'
+          put '.s0 ' ~ pool[0]
+          put '.struct ' ~ pool[0]
+          put '  .s32 free, used, peak'
+          put '  .s32 blocks[' ~ (pool[1] * pool[2] / 4) ~ ']'
+          put '.end'
+        end
+      end
+    .end
+  .end
+  .struct co
+    .s32 stacks[$ext.co.count * $ext.co.stack / 4]
+  .end
+  .struct prof
+    .s32 head       // entries recorded this frame, which can be more than the ring holds
+    .s32 entries[$ext.prof.length * 2]   // zone (+ 0x100 at the end of the zone), then time
+    .s32 overflow   // entries lost because the ring was full
+    .s32 open       // bit for each zone that has begun and not ended
+    .s32 stamps[32] // time each zone began
+    // results of the last frame, for each zone
+    .s32 cycles[32]
+    .s32 calls[32]
+  .end
+  .s0 ewram_end
+.end
+
+.struct $ext = $ext.iwram
+  .struct oam
+    .s32 count         // sprites added since the last sort
+    .s32 shown         // entries shown by the last sort
+    .s8 offsets[256]   // counting sort buckets, one per key
+    // attr0 | attr1 << 16, attr2 | key << 16
+    .s32 sprites[256]
+    // OAM image, sorted by key, and copied to OAM at VBlank
+    .s16 mirror[512]
+  .end
+  .struct pool
+    // header (free list, blocks used, most blocks used) followed by the blocks
+    .script
+      for var pool: store.get 'ext.pools', {}
+        if pool[3] == 'iwram'
+          put '.s0 ' ~ pool[0]
+          put '.struct ' ~ pool[0]
+          put '  .s32 free, used, peak'
+          put '  .s32 blocks[' ~ (pool[1] * pool[2] / 4) ~ ']'
+          put '.end'
+        end
+      end
+    .end
+  .end
+  .struct co
+    .s32 current       // the running coroutine, or 0
+    .s32 main[10]      // r4-r11, sp, lr of the code that resumed it
+    // r4-r11, sp, lr, then 1 if it's alive, and padding
+    .s32 contexts[$ext.co.count * 12]
+  .end
+  .struct mix
+    .s32 current       // the buffer DMA1 is playing, 0 or 1
+    // pointer, fraction << 16, step fraction << 16, step integer, end, loop length (0 to stop at
+    // the end), volume, then 1 if it's playing
+    .s32 channels[$ext.mix.count * 8]
+    .s32 accum[$ext.mix.length]   // sum of the channels for each sample
+    .s8 buffers[$ext.mix.length * 2]
+  .end
+  .struct text
+    .s32 tiles         // VRAM address of the first glyph tile
+    .s32 first         // its tile number, as seen by the background
+    .s32 map           // tilemap address
+    .s32 ink, paper    // colors the glyphs are expanded with
+    .s32 used          // glyph tiles expanded so far
+    .s32 attr          // palette bank << 12, for each map entry
+    .s16 cache[96]     // map entry + 1 of each glyph, or 0 if it isn't expanded yet
+  .end
+  .s0 iwram_code
+.end
 
-  mov pc, lr
+.script
+  for var pool: store.get 'ext.pools', {}
+    put '.def $ext.pool.' ~ pool[0] ~ '.size = ' ~ pool[1]
+    put '.def $ext.pool.' ~ pool[0] ~ '.count = ' ~ pool[2]
+  end
+.end
+
+.begin
+.arm
+
+// copies the IWRAM routines into place and clears the variables, call once at startup
+@ext.init:
+  push  {lr}
+  ldr   r0, =$ext.iwram_code
+  ldr   r1, =@@iwramStart
+  ldr   r2, =@@iwramEnd
+@@copy:
+  ldr   r3, [r1], #4
+  str   r3, [r0], #4
+  cmp   r1, r2
+  blo   @@copy
+  ldr   r0, =$ext.ewram
+  mov   r1, #0
+  ldr   r2, =$ext.ewram_end - $ext.ewram
+  ldr   r3, =@ext.memset32
+  mov   lr, pc
+  bx    r3
+  ldr   r0, =$ext.iwram
+  mov   r1, #0
+  ldr   r2, =$ext.iwram_code - $ext.iwram
+  ldr   r3, =@ext.memset32
+  mov   lr, pc
+  bx    r3
+  // start with every entry shown, so the first sort hides them
+  ldr   r0, =$ext.oam.shown
+  mov   r1, #128
+  str   r1, [r0]
+  .script
+    for var pool: store.get 'ext.pools', {}
+      var name = pool[0]
+      put 'ldr   r0, =$ext.pool.' ~ name
+      put 'ldr   r1, =$ext.pool.' ~ name ~ '.size'
+      put 'ldr   r2, =$ext.pool.' ~ name ~ '.count'
+      put 'ldr   r3, =@ext.pool_reset'
+      put 'mov   lr, pc'
+      put 'bx    r3'
+    end
+  .end
+  pop   {lr}
+  bx    lr
   .pool
 
+.align 4
+@@iwramStart:
+.begin
+.base $ext.iwram_code
+
+// r0 = destination, r1 = source, r2 = bytes; both word aligned, and bytes is a multiple of 4
+@ext.memcpy32:
+  subs  r2, r2, #64
+  bhs   @@copy32Large
+  // less than 64 bytes isn't worth saving registers for, so copy 32 bytes with r3 and r12
+  tst   r2, #32
+  beq   @@copy32Tail
+  ldmia r1!, {r3, r12}
+  stmia r0!, {r3, r12}
+  ldmia r1!, {r3, r12}
+  stmia r0!, {r3, r12}
+  ldmia r1!, {r3, r12}
+  stmia r0!, {r3, r12}
+  ldmia r1!, {r3, r12}
+  stmia r0!, {r3, r12}
+@@copy32Tail:
+  // shift the remaining bytes into C (16 bytes) and N (8 bytes)
+  movs  r2, r2, lsl #28
+  ldmcsia r1!, {r3, r12}
+  stmcsia r0!, {r3, r12}
+  ldmcsia r1!, {r3, r12}
+  stmcsia r0!, {r3, r12}
+  ldmmiia r1!, {r3, r12}
+  stmmiia r0!, {r3, r12}
+  tst   r2, #0x40000000
+  ldrne r3, [r1], #4
+  strne r3, [r0], #4
+  bx    lr
+@@copy32Large:
+  push  {r4-r9}
+  // 64 bytes per loop, so the loop overhead is only paid every 4 ldm/stm
+@@copy32:
+  ldmia r1!, {r3-r9, r12}
+  stmia r0!, {r3-r9, r12}
+  ldmia r1!, {r3-r9, r12}
+  stmia r0!, {r3-r9, r12}
+  subs  r2, r2, #64
+  bhs   @@copy32
+  // r2 is the remaining bytes minus 64, so its low 6 bits are still the remaining bytes
+  tst   r2, #32
+  ldmneia r1!, {r3-r9, r12}
+  stmneia r0!, {r3-r9, r12}
+  ands  r2, r2, #28
+  pop   {r4-r9}
+  bxeq  lr
+  b     @@copy32Tail
+
+// r0 = destination, r1 = 32-bit fill value, r2 = bytes; destination is word aligned, and bytes is
+// a multiple of 4
+@ext.memset32:
+  mov   r3, r1
+  mov   r12, r1
+  subs  r2, r2, #32
+  blo   @@set32Tail
+  push  {r4-r8}
+  mov   r4, r1
+  mov   r5, r1
+  mov   r6, r1
+  mov   r7, r1
+  mov   r8, r1
+@@set32:
+  stmia r0!, {r1, r3-r8, r12}
+  subs  r2, r2, #32
+  bhs   @@set32
+  pop   {r4-r8}
+@@set32Tail:
+  movs  r2, r2, lsl #28
+  stmcsia r0!, {r1, r3, r12}
+  strcs r1, [r0], #4
+  stmmiia r0!, {r1, r3}
+  tst   r2, #0x40000000
+  strne r1, [r0], #4
+  bx    lr
+
+// r0 = destination, r1 = source, r2 = bytes; both halfword aligned, and bytes is a multiple of 2,
+// so it's safe for VRAM, palette, and OAM
+@ext.memcpy16:
+  eor   r3, r0, r1
+  tst   r3, #2
+  bne   @@copy16
+  // both can be word aligned, so copy a halfword if needed, then the last halfword if there's an
+  // odd number, and leave the rest to memcpy32
+  tst   r0, #2
+  beq   @@copy16Even
+  subs  r2, r2, #2
+  bxlo  lr
+  ldrh  r3, [r1], #2
+  strh  r3, [r0], #2
+@@copy16Even:
+  tst   r2, #2
+  beq   @ext.memcpy32
+  sub   r2, r2, #2
+  ldrh  r3, [r1, r2]
+  strh  r3, [r0, r2]
+  b     @ext.memcpy32
+@@copy16:
+  subs  r2, r2, #2
+  ldrhhs r3, [r1], #2
+  strhhs r3, [r0], #2
+  bhi   @@copy16
+  bx    lr
+
+// r0 = destination, r1 = source, r2 = bytes; any alignment, but writes bytes, so it isn't safe for
+// VRAM, palette, or OAM
+@ext.memcpy:
+  eor   r3, r0, r1
+  tst   r3, #1
+  bne   @@copy8
+  // both can be halfword aligned, so copy a byte if needed, then the last byte if there's an odd
+  // number, and leave the rest to memcpy16
+  tst   r0, #1
+  beq   @@copy8Even
+  subs  r2, r2, #1
+  bxlo  lr
+  ldrb  r3, [r1], #1
+  strb  r3, [r0], #1
+@@copy8Even:
+  tst   r2, #1
+  beq   @ext.memcpy16
+  sub   r2, r2, #1
+  ldrb  r3, [r1, r2]
+  strb  r3, [r0, r2]
+  b     @ext.memcpy16
+@@copy8:
+  subs  r2, r2, #1
+  ldrbhs r3, [r1], #1
+  strbhs r3, [r0], #1
+  bhi   @@copy8
+  bx    lr
+
+// r0 = numerator, r1 = denominator; returns r0 = quotient, r1 = remainder, unsigned (dividing by 0
+// returns 0xffffffff and the numerator)
+@ext.udiv:
+  // r2 = bits in the quotient - 1, by a binary search for the largest r2 where r1 << r2 <= r0
+  mov   r2, #0
+  mov   r12, r0
+  .script
+    for var i: {16, 8, 4, 2, 1}
+      put 'cmp   r1, r12, lsr #' ~ i
+      put 'movls r12, r12, lsr #' ~ i
+      put 'addls r2, r2, #' ~ i
+    end
+  .end
+  // jump into the unrolled shift-subtract at bit r2, each bit is 3 instructions
+  rsb   r2, r2, #31
+  add   r2, r2, r2, lsl #1
+  mov   r3, #0
+  add   pc, pc, r2, lsl #2
+  nop
+  .script
+    for var i: range 31, -1, -1
+      put 'cmp   r0, r1, lsl #' ~ i
+      put 'subhs r0, r0, r1, lsl #' ~ i
+      put 'adc   r3, r3, r3'
+    end
+  .end
+  mov   r1, r0
+  mov   r0, r3
+  bx    lr
+
+// r0 = numerator, r1 = denominator; returns r0 = quotient, r1 = remainder, signed, and rounded
+// towards zero like C and BIOS Div
+@ext.sdiv:
+  push  {r4, r5, lr}
+  movs  r4, r0
+  rsbmi r0, r0, #0
+  movs  r5, r1
+  rsbmi r1, r1, #0
+  bl    @ext.udiv
+  teq   r4, r5
+  rsbmi r0, r0, #0
+  cmp   r4, #0
+  rsblt r1, r1, #0
+  pop   {r4, r5, lr}
+  bx    lr
+
+// r0 = value; returns r0 = the integer square root, unsigned, a bit at a time: r2 holds the root
+// found so far, shifted and rotated into place for the next comparison
+@ext.isqrt:
+  mov   r1, #0xc0000000
+  mov   r2, #0x40000000
+  .script
+    for var i: range 16
+      // ror #0 would be rrx
+      var op2 = 'r2'
+      if i > 0
+        op2 = 'r2, ror #' ~ (i * 2)
+      end
+      put 'cmp   r0, ' ~ op2
+      put 'subhs r0, r0, ' ~ op2
+      put 'adc   r2, r1, r2, lsl #1'
+    end
+  .end
+  bic   r0, r2, #0xc0000000
+  bx    lr
+
+// r0 = value (signed 16.16); returns r0 = 1 / value (signed 16.16), saturated to 0x7fffffff or
+// -0x7fffffff when it doesn't fit, including for 0
+@ext.recip16:
+  push  {r4, r5, lr}
+  mov   r5, r0
+  cmp   r0, #0
+  rsblt r4, r0, #0
+  movge r4, r0
+  cmp   r4, #1
+  bls   @@recipSaturate
+  // 2^32 / r4 is 0xffffffff / r4, plus 1 if r4 divides 2^32
+  mvn   r0, #0
+  mov   r1, r4
+  bl    @ext.udiv
+  add   r1, r1, #1
+  cmp   r1, r4
+  addeq r0, r0, #1
+  cmp   r0, #0x80000000
+  mvnhs r0, #0x80000000
+@@recipSign:
+  cmp   r5, #0
+  rsblt r0, r0, #0
+  pop   {r4, r5, lr}
+  bx    lr
+@@recipSaturate:
+  mvn   r0, #0x80000000
+  b     @@recipSign
+
+// r0 = destination, r1 = source; decompresses BIOS LZ77 data (like LZ77UnCompWram) a byte at a
+// time, so not for VRAM
+@ext.lz77:
+  push  {r4, r5}
+  ldr   r2, [r1], #4
+  add   r2, r0, r2, lsr #8
+  // the flags are shifted out of the top of r3, followed by a marker bit, so r3 is zero when the
+  // next flag byte is needed
+  mov   r3, #0
+  b     @@lzNext
+@@lzFlags:
+  ldrb  r3, [r1], #1
+  mov   r3, r3, lsl #24
+  orr   r3, r3, #0x00800000
+@@lzItem:
+  movs  r3, r3, lsl #1
+  beq   @@lzFlags
+  bcs   @@lzMatch
+  ldrb  r12, [r1], #1
+  strb  r12, [r0], #1
+@@lzNext:
+  cmp   r0, r2
+  blo   @@lzItem
+  pop   {r4, r5}
+  bx    lr
+@@lzMatch:
+  ldrb  r12, [r1], #1
+  ldrb  r4, [r1], #1
+  mov   r5, r12, lsl #28
+  orr   r4, r4, r5, lsr #20
+  sub   r4, r0, r4
+  sub   r4, r4, #1
+  // jump into the unrolled copy, skipping 15 - (r12 >> 4) of the 18 bytes
+  mov   r12, r12, lsr #4
+  rsb   r12, r12, #15
+  add   pc, pc, r12, lsl #3
+  nop
+  .script
+    for var j: range 18
+      put 'ldrb  r5, [r4], #1'
+      put 'strb  r5, [r0], #1'
+    end
+  .end
+  cmp   r0, r2
+  blo   @@lzItem
+  pop   {r4, r5}
+  bx    lr
+
+// r0 = destination, r1 = source; like @ext.lz77, but writes halfwords, so it's safe for VRAM (like
+// LZ77UnCompVram, the data can't copy from the byte just before, see lz77.compress)
+@ext.lz77_vram:
+  push  {r4-r6}
+  ldr   r2, [r1], #4
+  add   r2, r0, r2, lsr #8
+  // r6 holds the even byte until the odd one is ready to write with it
+  mov   r3, #0
+  b     @@lzvNext
+@@lzvFlags:
+  ldrb  r3, [r1], #1
+  mov   r3, r3, lsl #24
+  orr   r3, r3, #0x00800000
+@@lzvItem:
+  movs  r3, r3, lsl #1
+  beq   @@lzvFlags
+  bcs   @@lzvMatch
+  ldrb  r5, [r1], #1
+  tst   r0, #1
+  orrne r6, r6, r5, lsl #8
+  strhne r6, [r0, #-1]
+  moveq r6, r5
+  add   r0, r0, #1
+@@lzvNext:
+  cmp   r0, r2
+  blo   @@lzvItem
+  b     @@lzvDone
+@@lzvMatch:
+  ldrb  r12, [r1], #1
+  ldrb  r4, [r1], #1
+  mov   r5, r12, lsl #28
+  orr   r4, r4, r5, lsr #20
+  sub   r4, r0, r4
+  sub   r4, r4, #1
+  // each byte of the unrolled copy is 6 instructions
+  mov   r12, r12, lsr #4
+  rsb   r12, r12, #15
+  add   r12, r12, r12, lsl #1
+  add   pc, pc, r12, lsl #3
+  nop
+  .script
+    for var j: range 18
+      put 'ldrb  r5, [r4], #1'
+      put 'tst   r0, #1'
+      put 'orrne r6, r6, r5, lsl #8'
+      put 'strhne r6, [r0, #-1]'
+      put 'moveq r6, r5'
+      put 'add   r0, r0, #1'
+    end
+  .end
+  cmp   r0, r2
+  blo   @@lzvItem
+@@lzvDone:
+  // an odd size leaves a byte, which is written with the byte after it
+  tst   r0, #1
+  ldrbne r5, [r0]
+  orrne r6, r6, r5, lsl #8
+  strhne r6, [r0, #-1]
+  pop   {r4-r6}
+  bx    lr
+
+// r0 = destination, r1 = source; decompresses BIOS run-length data (like RLUnCompWram) a byte at a
+// time, so not for VRAM
+@ext.rle:
+  ldr   r2, [r1], #4
+  add   r2, r0, r2, lsr #8
+  b     @@rleNext
+@@rleBlock:
+  ldrb  r3, [r1], #1
+  tst   r3, #0x80
+  bne   @@rleRun
+  // copy r3 + 1 literal bytes, one if it's odd, then pairs
+  add   r3, r3, #1
+  movs  r3, r3, lsr #1
+  ldrbcs r12, [r1], #1
+  strbcs r12, [r0], #1
+  beq   @@rleNext
+@@rleLiteral:
+  ldrb  r12, [r1], #1
+  strb  r12, [r0], #1
+  ldrb  r12, [r1], #1
+  strb  r12, [r0], #1
+  subs  r3, r3, #1
+  bne   @@rleLiteral
+  b     @@rleNext
+@@rleRun:
+  // fill (r3 & 0x7f) + 3 bytes, a word at a time once the destination is aligned
+  ldrb  r12, [r1], #1
+  sub   r3, r3, #0x7d
+@@rleHead:
+  tst   r0, #3
+  beq   @@rleWords
+  strb  r12, [r0], #1
+  subs  r3, r3, #1
+  bne   @@rleHead
+  b     @@rleNext
+@@rleWords:
+  orr   r12, r12, r12, lsl #8
+  orr   r12, r12, r12, lsl #16
+  subs  r3, r3, #4
+  blo   @@rleTail
+@@rleWord:
+  str   r12, [r0], #4
+  subs  r3, r3, #4
+  bhs   @@rleWord
+@@rleTail:
+  adds  r3, r3, #4
+  beq   @@rleNext
+@@rleByte:
+  strb  r12, [r0], #1
+  subs  r3, r3, #1
+  bne   @@rleByte
+@@rleNext:
+  cmp   r0, r2
+  blo   @@rleBlock
+  bx    lr
+
+// r0 = destination, r1 = source; like @ext.rle, but writes halfwords, so it's safe for VRAM
+@ext.rle_vram:
+  push  {r4}
+  ldr   r2, [r1], #4
+  add   r2, r0, r2, lsr #8
+  // r4 holds the even byte until the odd one is ready to write with it
+  b     @@rlvNext
+@@rlvBlock:
+  ldrb  r3, [r1], #1
+  tst   r3, #0x80
+  bne   @@rlvRun
+  add   r3, r3, #1
+@@rlvLiteral:
+  ldrb  r12, [r1], #1
+  tst   r0, #1
+  orrne r4, r4, r12, lsl #8
+  strhne r4, [r0, #-1]
+  moveq r4, r12
+  add   r0, r0, #1
+  subs  r3, r3, #1
+  bne   @@rlvLiteral
+  b     @@rlvNext
+@@rlvRun:
+  ldrb  r12, [r1], #1
+  sub   r3, r3, #0x7d
+  // finish the held byte, then fill halfwords, and hold the last byte if there's one left
+  tst   r0, #1
+  orrne r4, r4, r12, lsl #8
+  strhne r4, [r0, #-1]
+  addne r0, r0, #1
+  subne r3, r3, #1
+  orr   r12, r12, r12, lsl #8
+  subs  r3, r3, #2
+  blo   @@rlvOdd
+@@rlvPair:
+  strh  r12, [r0], #2
+  subs  r3, r3, #2
+  bhs   @@rlvPair
+@@rlvOdd:
+  tst   r3, #1
+  andne r4, r12, #0xff
+  addne r0, r0, #1
+@@rlvNext:
+  cmp   r0, r2
+  blo   @@rlvBlock
+  // an odd size leaves a byte, which is written with the byte after it
+  tst   r0, #1
+  ldrbne r12, [r0]
+  orrne r4, r4, r12, lsl #8
+  strhne r4, [r0, #-1]
+  pop   {r4}
+  bx    lr
+
+// r0 = destination, r1 = source, r2 = DMA3CNT (count in the low 16 bits, control in the high 16),
+// r3 = priority 0-3 (0 is flushed first); queues a DMA3 transfer for @ext.dmaq_flush, and returns
+// r0 = 1 if it was queued, or 0 if the queue was full
+@ext.dmaq_push:
+  push  {r4-r6}
+  and   r3, r3, #3
+  ldr   r12, =$ext.dmaq.head
+  add   r12, r12, r3, lsl #2
+  ldr   r4, [r12]
+  ldr   r5, [r12, #$ext.dmaq.tail - $ext.dmaq.head]
+  sub   r4, r5, r4
+  cmp   r4, #$ext.dmaq.length
+  bhs   @@pushFull
+  // estimate 2 cycles per byte, which is the cost from ROM or EWRAM to VRAM, plus the cost of
+  // reading the entry from EWRAM and starting the transfer
+  mov   r4, r2, lsl #16
+  movs  r4, r4, lsr #16
+  moveq r4, #0x10000
+  tst   r2, #0x04000000
+  moveq r4, r4, lsl #2
+  movne r4, r4, lsl #3
+  add   r4, r4, #48
+  orr   r2, r2, #0x80000000
+  and   r6, r5, #$ext.dmaq.length - 1
+  add   r3, r3, r6, lsl #2
+  ldr   r6, =$ext.dmaq.entries
+  add   r3, r6, r3, lsl #4
+  stmia r3, {r0, r1, r2, r4}
+  // only update the tail once the entry is written, so a flush from an interrupt never sees a
+  // partial entry
+  add   r5, r5, #1
+  str   r5, [r12, #$ext.dmaq.tail - $ext.dmaq.head]
+  mov   r0, #1
+  pop   {r4-r6}
+  bx    lr
+@@pushFull:
+  ldr   r12, =$ext.dmaq.overflow
+  ldr   r0, [r12]
+  add   r0, r0, #1
+  str   r0, [r12]
+  mov   r0, #0
+  pop   {r4-r6}
+  bx    lr
+
+// r0 = cycle budget; starts queued transfers in priority order, until the next one would go over
+// the budget, which leaves it and the rest for the next flush; returns r0 = the budget left
+//
+// call this from the VBlank interrupt, so the transfers land while the screen isn't drawing
+@ext.dmaq_flush:
+  push  {r4-r8}
+  ldr   r12, =$ext.dmaq.head
+  ldr   r8, =$ext.dmaq.entries
+  mov   r1, #0
+@@flushPriority:
+  ldr   r2, [r12, r1, lsl #2]
+  add   r3, r12, #$ext.dmaq.tail - $ext.dmaq.head
+  ldr   r3, [r3, r1, lsl #2]
+@@flushNext:
+  cmp   r2, r3
+  beq   @@flushDone
+  and   r4, r2, #$ext.dmaq.length - 1
+  add   r4, r1, r4, lsl #2
+  add   r4, r8, r4, lsl #4
+  ldmia r4, {r4-r7}
+  subs  r0, r0, r7
+  bmi   @@flushOver
+  // DMA3SAD, DMA3DAD, DMA3CNT; writing the control starts the transfer, and the CPU waits for it
+  mov   r7, #0x04000000
+  str   r5, [r7, #0xd4]
+  str   r4, [r7, #0xd8]
+  str   r6, [r7, #0xdc]
+  add   r2, r2, #1
+  b     @@flushNext
+@@flushDone:
+  str   r2, [r12, r1, lsl #2]
+  add   r1, r1, #1
+  cmp   r1, #4
+  blo   @@flushPriority
+  pop   {r4-r8}
+  bx    lr
+@@flushOver:
+  add   r0, r0, r7
+  str   r2, [r12, r1, lsl #2]
+  ldr   r1, [r12, #$ext.dmaq.deferred - $ext.dmaq.head]
+  add   r1, r1, #1
+  str   r1, [r12, #$ext.dmaq.deferred - $ext.dmaq.head]
+  pop   {r4-r8}
+  bx    lr
+
+// r0 = attr0 | attr1 << 16, r1 = attr2, r2 = key 0-255; adds a sprite for the next @ext.oam_sort,
+// where lower keys are drawn in front, and returns r0 = 1 if it was added, or 0 if there are
+// already 128
+@ext.oam_add:
+  ldr   r12, =$ext.oam.count
+  ldr   r3, [r12]
+  cmp   r3, #128
+  movhs r0, #0
+  bxhs  lr
+  mov   r1, r1, lsl #16
+  mov   r1, r1, lsr #16
+  and   r2, r2, #0xff
+  orr   r1, r1, r2, lsl #16
+  add   r2, r12, #$ext.oam.sprites - $ext.oam.count
+  add   r2, r2, r3, lsl #3
+  stmia r2, {r0, r1}
+  add   r3, r3, #1
+  str   r3, [r12]
+  mov   r0, #1
+  bx    lr
+
+// sorts the added sprites by key into $ext.oam.mirror with a counting sort, hides the entries that
+// were shown last time but aren't now, and starts over with no sprites; sprites with the same key
+// keep the order they were added
+@ext.oam_sort:
+  push  {r4-r11}
+  ldr   r12, =$ext.oam.count
+  ldr   r11, [r12]
+  add   r10, r12, #$ext.oam.offsets - $ext.oam.count
+  add   r9, r12, #$ext.oam.sprites - $ext.oam.count
+  // clear the 256 buckets
+  mov   r0, #0
+  mov   r1, #0
+  mov   r2, #0
+  mov   r3, #0
+  mov   r4, #0
+  mov   r5, #0
+  mov   r6, #0
+  mov   r7, #0
+  mov   r8, r10
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  stmia r8!, {r0-r7}
+  // count each key, two at a time after counting the odd one
+  add   r2, r9, #6
+  movs  r3, r11, lsr #1
+  ldrcsb r4, [r2], #8
+  ldrcsb r5, [r10, r4]
+  addcs r5, r5, #1
+  strcsb r5, [r10, r4]
+  beq   @@sortCounted
+@@sortCount:
+  ldrb  r4, [r2], #8
+  ldrb  r5, [r2], #8
+  ldrb  r6, [r10, r4]
+  add   r6, r6, #1
+  strb  r6, [r10, r4]
+  ldrb  r6, [r10, r5]
+  add   r6, r6, #1
+  strb  r6, [r10, r5]
+  subs  r3, r3, #1
+  bne   @@sortCount
+@@sortCounted:
+  // turn the counts into offsets, 4 buckets at a time; there are at most 128 sprites, so the sums
+  // fit in a byte, and adding the word shifted by 8 and then 16 adds each byte to the bytes above
+  // it; r7 is the total so far, in every byte
+  mov   r7, #0
+  mov   r8, r10
+  mov   r3, #64
+@@sortOffsets:
+  ldr   r4, [r8]
+  add   r5, r4, r4, lsl #8
+  add   r5, r5, r5, lsl #16
+  sub   r4, r5, r4
+  add   r4, r4, r7
+  str   r4, [r8], #4
+  mov   r5, r5, lsr #24
+  add   r5, r5, r5, lsl #8
+  add   r5, r5, r5, lsl #16
+  add   r7, r7, r5
+  subs  r3, r3, #1
+  bne   @@sortOffsets
+  // move each sprite to its place in the mirror, leaving the fourth halfword of each entry alone,
+  // since it's part of the affine parameters
+  ldr   r8, =$ext.oam.mirror
+  movs  r3, r11, lsr #1
+  bcc   @@sortMovePairs
+  ldmia r9!, {r4, r5}
+  ldrb  r6, [r10, r5, lsr #16]
+  add   r7, r6, #1
+  strb  r7, [r10, r5, lsr #16]
+  add   r6, r8, r6, lsl #3
+  str   r4, [r6]
+  strh  r5, [r6, #4]
+  cmp   r3, #0
+@@sortMovePairs:
+  beq   @@sortMoved
+@@sortMove:
+  ldmia r9!, {r0, r1, r4, r5}
+  ldrb  r6, [r10, r1, lsr #16]
+  add   r7, r6, #1
+  strb  r7, [r10, r1, lsr #16]
+  add   r6, r8, r6, lsl #3
+  str   r0, [r6]
+  strh  r1, [r6, #4]
+  ldrb  r6, [r10, r5, lsr #16]
+  add   r7, r6, #1
+  strb  r7, [r10, r5, lsr #16]
+  add   r6, r8, r6, lsl #3
+  str   r4, [r6]
+  strh  r5, [r6, #4]
+  subs  r3, r3, #1
+  bne   @@sortMove
+@@sortMoved:
+  // hide entries that were shown last time, but aren't now
+  ldr   r3, [r12, #$ext.oam.shown - $ext.oam.count]
+  add   r6, r8, r11, lsl #3
+  mov   r4, #0x0200
+@@sortHide:
+  cmp   r11, r3
+  strlo r4, [r6], #8
+  addlo r11, r11, #1
+  blo   @@sortHide
+  ldr   r11, [r12]
+  str   r11, [r12, #$ext.oam.shown - $ext.oam.count]
+  mov   r0, #0
+  str   r0, [r12]
+  pop   {r4-r11}
+  bx    lr
+
+// copies $ext.oam.mirror to OAM with DMA3, call from the VBlank interrupt
+@ext.oam_copy:
+  mov   r0, #0x04000000
+  ldr   r1, =$ext.oam.mirror
+  str   r1, [r0, #0xd4]
+  mov   r1, #0x07000000
+  str   r1, [r0, #0xd8]
+  ldr   r1, =0x84000100
+  str   r1, [r0, #0xdc]
+  bx    lr
+
+// r0 = pool, like $ext.pool.name; returns r0 = a block, or 0 if they're all in use
+@ext.pool_alloc:
+  ldr   r1, [r0]
+  cmp   r1, #0
+  ldrne r2, [r1]
+  strne r2, [r0]
+.if $ext.debug
+  // count the blocks in use, and remember the most
+  beq   @@allocEmpty
+  ldr   r2, [r0, #4]
+  add   r2, r2, #1
+  str   r2, [r0, #4]
+  ldr   r3, [r0, #8]
+  cmp   r2, r3
+  strhi r2, [r0, #8]
+@@allocEmpty:
+.end
+  mov   r0, r1
+  bx    lr
+
+// r0 = pool, r1 = block from @ext.pool_alloc; returns the block to the pool
+@ext.pool_free:
+  ldr   r2, [r0]
+  str   r2, [r1]
+  str   r1, [r0]
+.if $ext.debug
+  ldr   r2, [r0, #4]
+  sub   r2, r2, #1
+  str   r2, [r0, #4]
+.end
+  bx    lr
+
+// r0 = pool, r1 = block bytes, r2 = count; frees every block, by linking each block to the next
+@ext.pool_reset:
+  add   r3, r0, #12
+  str   r3, [r0]
+  mov   r12, #0
+  str   r12, [r0, #4]
+@@resetBlock:
+  subs  r2, r2, #1
+  addne r12, r3, r1
+  moveq r12, #0
+  str   r12, [r3]
+  mov   r3, r12
+  bne   @@resetBlock
+  bx    lr
+
+// r0 = function (ARM, or Thumb with bit 0 set), r1 = argument; creates a coroutine that calls the
+// function with the argument the first time it's resumed, and returns r0 = the coroutine, or 0 if
+// there are already $ext.co.count
+@ext.co_create:
+  push  {r4, r5}
+  ldr   r2, =$ext.co.contexts
+  ldr   r3, =$ext.co.stacks + $ext.co.stack
+  ldr   r4, =$ext.co.stack
+  ldr   r12, =$ext.co.contexts + $ext.co.count * 48
+@@createFind:
+  ldr   r5, [r2, #40]
+  cmp   r5, #0
+  beq   @@createFound
+  add   r2, r2, #48
+  add   r3, r3, r4
+  cmp   r2, r12
+  blo   @@createFind
+  mov   r0, #0
+  pop   {r4, r5}
+  bx    lr
+@@createFound:
+  // the first resume starts @@coStart, with r4 = argument, r5 = function, on an empty stack
+  str   r1, [r2]
+  str   r0, [r2, #4]
+  str   r3, [r2, #32]
+  ldr   r0, =@@coStart
+  str   r0, [r2, #36]
+  mov   r0, #1
+  str   r0, [r2, #40]
+  mov   r0, r2
+  pop   {r4, r5}
+  bx    lr
+@@coStart:
+  mov   r0, r4
+  mov   lr, pc
+  bx    r5
+  // the function returned, so free the coroutine, and return 0 from @ext.co_resume
+  ldr   r12, =$ext.co.current
+  ldr   r1, [r12]
+  mov   r0, #0
+  str   r0, [r1, #40]
+  str   r0, [r12], #4
+  ldmia r12, {r4-r11, sp, lr}
+  bx    lr
+
+// r0 = coroutine; runs it until it yields or returns, and returns r0 = 1 if it yielded, or 0 if it
+// returned (or already had)
+@ext.co_resume:
+  ldr   r1, [r0, #40]
+  cmp   r1, #0
+  moveq r0, #0
+  bxeq  lr
+  ldr   r12, =$ext.co.current
+  str   r0, [r12], #4
+  stmia r12, {r4-r11, sp, lr}
+  ldmia r0, {r4-r11, sp, lr}
+  bx    lr
+
+// called by the running coroutine to return 1 from @ext.co_resume; the next resume returns here
+@ext.co_yield:
+  ldr   r12, =$ext.co.current
+  ldr   r0, [r12]
+  stmia r0, {r4-r11, sp, lr}
+  mov   r0, #0
+  str   r0, [r12], #4
+  ldmia r12, {r4-r11, sp, lr}
+  mov   r0, #1
+  bx    lr
+
+// resumes each coroutine that's alive once, and returns r0 = how many are still alive
+@ext.co_run:
+  push  {r4-r6, lr}
+  ldr   r4, =$ext.co.contexts
+  ldr   r5, =$ext.co.contexts + $ext.co.count * 48
+  mov   r6, #0
+@@runNext:
+  mov   r0, r4
+  bl    @ext.co_resume
+  add   r6, r6, r0
+  add   r4, r4, #48
+  cmp   r4, r5
+  blo   @@runNext
+  mov   r0, r6
+  pop   {r4-r6, lr}
+  bx    lr
+
+// starts DirectSound A playing the mix buffers: Timer 0 plays $ext.mix.length samples per frame,
+// and DMA1 feeds FIFO A; call @ext.mix_vblank at the start of every VBlank after this
+@ext.mix_start:
+  ldr   r0, =0x04000084
+  mov   r1, #0x80           // SOUNDCNT_X: sound on
+  strh  r1, [r0]
+  ldr   r1, =0x0b04         // SOUNDCNT_H: DirectSound A at full volume, both sides, Timer 0
+  strh  r1, [r0, #-2]
+  ldr   r0, =$ext.mix.current
+  mov   r1, #0
+  str   r1, [r0]
+  ldr   r0, =0x040000bc     // DMA1SAD
+  ldr   r1, =$ext.mix.buffers
+  ldr   r2, =0x040000a0     // FIFO_A
+  ldr   r3, =0xb6400000     // repeat, 32-bit, when the FIFO asks, to a fixed address
+  stmia r0, {r1-r3}
+  ldr   r0, =0x04000100
+  ldr   r1, =0x00800000 | (0x10000 - 280896 / $ext.mix.length)
+  str   r1, [r0]
+  bx    lr
+
+// restarts DMA1 at the buffer mixed during the last frame; call at the start of VBlank, which is
+// when the playing buffer runs out
+@ext.mix_vblank:
+  ldr   r0, =$ext.mix.current
+  ldr   r1, [r0]
+  eor   r1, r1, #1
+  str   r1, [r0]
+  ldr   r2, =$ext.mix.buffers
+  ldr   r3, =$ext.mix.length
+  mla   r2, r1, r3, r2
+  ldr   r0, =0x040000c4     // DMA1CNT
+  mov   r1, #0
+  str   r1, [r0]
+  str   r2, [r0, #-8]
+  ldr   r1, =0xb6400000
+  str   r1, [r0]
+  bx    lr
+
+// r0 = channel, r1 = sound, r2 = step (16.16, under 32.0), r3 = volume 0-64; the sound is three
+// words: the start of its signed 8-bit samples, the end, and where to loop back to at the end, or
+// 0 to stop
+@ext.mix_play:
+  push  {r4-r7}
+  ldr   r12, =$ext.mix.channels
+  add   r12, r12, r0, lsl #5
+  mov   r6, r3
+  mov   r3, r2, lsr #16
+  mov   r2, r2, lsl #16
+  ldmia r1, {r0, r4, r5}
+  cmp   r5, #0
+  subne r5, r4, r5
+  mov   r1, #0
+  mov   r7, #1
+  // the playing flag is stored last, in case it interrupted a mix
+  stmia r12, {r0-r7}
+  pop   {r4-r7}
+  bx    lr
+
+// r0 = channel, r1 = step (16.16), r2 = volume 0-64; changes a playing channel
+@ext.mix_set:
+  ldr   r12, =$ext.mix.channels + 8
+  add   r12, r12, r0, lsl #5
+  mov   r0, r1, lsl #16
+  mov   r1, r1, lsr #16
+  stmia r12, {r0, r1}
+  str   r2, [r12, #16]
+  bx    lr
+
+// r0 = channel
+@ext.mix_stop:
+  ldr   r12, =$ext.mix.channels + 28
+  mov   r1, #0
+  str   r1, [r12, r0, lsl #5]
+  bx    lr
+
+// mixes the next frame into the buffer that isn't playing, call once per frame
+@ext.mix:
+  push  {r4-r11, lr}
+  ldr   r12, =$ext.mix.channels
+  add   lr, r12, #$ext.mix.count * 32
+@@mixChannel:
+  ldr   r11, [r12, #28]
+  cmp   r11, #0
+  beq   @@mixNext
+  // r4 = pointer, r5 = fraction, r6 = step fraction, r7 = step integer, r8 = end,
+  // r9 = loop length, r10 = volume, r11 = samples left in the frame
+  ldmia r12, {r4-r10}
+  ldr   r0, =$ext.mix.accum
+  ldr   r11, =$ext.mix.length
+@@mixSegment:
+  // mix up to the end of the sound, or the frame, so there's no check in the inner loop
+  mov   r2, r6, lsr #16
+  orr   r2, r2, r7, lsl #16
+  sub   r1, r8, r4
+  cmp   r1, #0x8000
+  movhs r3, r11
+  bhs   @@mixSamples
+  mov   r1, r1, lsl #16
+  sub   r1, r1, r5, lsr #16
+  sub   r3, r11, #1
+  mul   r3, r2, r3
+  cmp   r1, r3
+  movhi r3, r11
+  bhi   @@mixSamples
+  // the end is in this frame, so r3 = ceil(r1 / r2) samples, which is less than 1024
+  add   r1, r1, r2
+  sub   r1, r1, #1
+  mov   r3, #0
+  .script
+    for var i: range 9, -1, -1
+      put 'cmp   r1, r2, lsl #' ~ i
+      put 'subhs r1, r1, r2, lsl #' ~ i
+      put 'adc   r3, r3, r3'
+    end
+  .end
+@@mixSamples:
+  sub   r11, r11, r3
+  tst   r3, #3
+  beq   @@mixFour
+@@mixOne:
+  ldrsb r1, [r4]
+  adds  r5, r5, r6
+  adc   r4, r4, r7
+  ldr   r2, [r0]
+  mla   r2, r1, r10, r2
+  str   r2, [r0], #4
+  sub   r3, r3, #1
+  tst   r3, #3
+  bne   @@mixOne
+  cmp   r3, #0
+  beq   @@mixEnd
+@@mixFour:
+  .script
+    for var j: range 4
+      put 'ldrsb r1, [r4]'
+      put 'adds  r5, r5, r6'
+      put 'adc   r4, r4, r7'
+      put 'ldr   r2, [r0]'
+      put 'mla   r2, r1, r10, r2'
+      put 'str   r2, [r0], #4'
+    end
+  .end
+  subs  r3, r3, #4
+  bne   @@mixFour
+@@mixEnd:
+  cmp   r4, r8
+  blo   @@mixSave
+  // reached the end, so loop back, or stop
+  cmp   r9, #0
+  streq r9, [r12, #28]
+  beq   @@mixSave
+@@mixLoop:
+  sub   r4, r4, r9
+  cmp   r4, r8
+  bhs   @@mixLoop
+  cmp   r11, #0
+  bne   @@mixSegment
+@@mixSave:
+  stmia r12, {r4, r5}
+@@mixNext:
+  add   r12, r12, #32
+  cmp   r12, lr
+  blo   @@mixChannel
+  // convert the sums to 8-bit samples, clipping them, and clear them for the next frame
+  ldr   r0, =$ext.mix.accum
+  ldr   r1, =$ext.mix.current
+  ldr   r1, [r1]
+  ldr   r2, =$ext.mix.buffers
+  ldr   r3, =$ext.mix.length
+  eor   r1, r1, #1
+  mla   r2, r1, r3, r2
+  mov   r5, #0x7f
+  mov   r12, #0
+  // a sample is in range if the bits above it all match the sign, otherwise it's 127 or -128
+@@mixClip:
+  .script
+    for var j: range 4
+      put 'ldr   r1, [r0]'
+      put 'str   r12, [r0], #4'
+      put 'mov   r1, r1, asr #6'
+      put 'mov   r4, r1, asr #7'
+      put 'teq   r4, r1, asr #31'
+      put 'eorne r1, r5, r1, asr #31'
+      put 'strb  r1, [r2], #1'
+    end
+  .end
+  subs  r3, r3, #4
+  bne   @@mixClip
+  pop   {r4-r11, lr}
+  bx    lr
+
+// r0 = VRAM address for the glyph tiles (room for 96), r1 = tile number of that address as seen by
+// the background, r2 = tilemap address (32 tiles wide), r3 = ink color | paper color << 4; also
+// empties the glyph cache
+@ext.text_init:
+  ldr   r12, =$ext.text.tiles
+  stmia r12!, {r0-r2}
+  and   r0, r3, #15
+  mov   r1, r3, lsr #4
+  and   r1, r1, #15
+  mov   r2, #0
+  mov   r3, #0
+  stmia r12!, {r0-r3}
+  mov   r0, r12
+  mov   r1, #0
+  mov   r2, #192
+  b     @ext.memset32
+
+// r0 = palette bank for the text printed after this
+@ext.text_palette:
+  ldr   r12, =$ext.text.attr
+  mov   r0, r0, lsl #12
+  str   r0, [r12]
+  bx    lr
+
+// r0 = string (zero terminated, and 10 starts a new line), r1 = x, r2 = y; writes the string into
+// the tilemap, expanding each glyph into a tile the first time it's used
+@ext.text_print:
+  push  {r4-r11, lr}
+  ldr   r4, =$ext.text.tiles
+  ldr   r3, [r4, #$ext.text.map - $ext.text.tiles]
+  add   r2, r1, r2, lsl #5
+  add   r3, r3, r2, lsl #1
+  mov   r5, r3
+  ldr   r6, =$ext.text.cache
+  ldr   r7, [r4, #$ext.text.attr - $ext.text.tiles]
+@@printChar:
+  ldrb  r12, [r0], #1
+  subs  r12, r12, #32
+  blo   @@printControl
+  // characters past the font are solid blocks
+  cmp   r12, #96
+  movhs r12, #95
+  mov   r1, r12, lsl #1
+  ldrh  r2, [r6, r1]
+  cmp   r2, #0
+  beq   @@printExpand
+@@printGlyph:
+  sub   r2, r2, #1
+  orr   r2, r2, r7
+  strh  r2, [r3], #2
+  b     @@printChar
+@@printControl:
+  cmn   r12, #32 - 10
+  addeq r5, r5, #64
+  moveq r3, r5
+  beq   @@printChar
+  cmn   r12, #32
+  bne   @@printChar
+  pop   {r4-r11, lr}
+  bx    lr
+@@printExpand:
+  // the next tile in the cache is r8 - 1, at r9
+  ldr   r2, [r4, #$ext.text.used - $ext.text.tiles]
+  add   r2, r2, #1
+  str   r2, [r4, #$ext.text.used - $ext.text.tiles]
+  ldr   r8, [r4, #$ext.text.first - $ext.text.tiles]
+  add   r8, r8, r2
+  strh  r8, [r6, r1]
+  ldr   r9, [r4]
+  add   r9, r9, r2, lsl #5
+  sub   r9, r9, #32
+  ldr   r10, =@ext.font
+  add   r10, r10, r12, lsl #5
+  ldr   r11, [r4, #$ext.text.ink - $ext.text.tiles]
+  ldr   r1, [r4, #$ext.text.paper - $ext.text.tiles]
+  ldr   r12, =0x11111111
+  // each pixel of the font is a nibble that's 0 or 1, so multiplying a row by a color sets every
+  // pixel at once
+  .script
+    for var j: range 8
+      put 'ldr   r2, [r10], #4'
+      put 'mul   lr, r2, r11'
+      put 'eor   r2, r2, r12'
+      put 'mla   lr, r2, r1, lr'
+      put 'str   lr, [r9], #4'
+    end
+  .end
+  mov   r2, r8
+  b     @@printGlyph
+
+// r0 = value, r1 = x, r2 = y, r3 = digits (1-8); prints the value in hexadecimal
+@ext.text_hex:
+  push  {lr}
+  sub   sp, sp, #12
+  mov   r12, #0
+  strb  r12, [sp, r3]
+@@hexDigit:
+  and   r12, r0, #15
+  cmp   r12, #10
+  addlo r12, r12, #48
+  addhs r12, r12, #87
+  subs  r3, r3, #1
+  strb  r12, [sp, r3]
+  mov   r0, r0, lsr #4
+  bne   @@hexDigit
+  mov   r0, sp
+  bl    @ext.text_print
+  add   sp, sp, #12
+  pop   {lr}
+  bx    lr
+
+// r0 = value, r1 = x, r2 = y; prints the value in decimal, unsigned
+@ext.text_uint:
+  push  {r4, r5, lr}
+  sub   sp, sp, #12
+  add   r4, sp, #11
+  mov   r12, #0
+  strb  r12, [r4]
+  ldr   r5, =0xcccccccd
+@@uintDigit:
+  // r3 = r0 / 10, by multiplying by 2^35 / 10
+  umull r12, r3, r0, r5
+  mov   r3, r3, lsr #3
+  add   r12, r3, r3, lsl #2
+  sub   r12, r0, r12, lsl #1
+  add   r12, r12, #48
+  strb  r12, [r4, #-1]!
+  movs  r0, r3
+  bne   @@uintDigit
+  mov   r0, r4
+  bl    @ext.text_print
+  add   sp, sp, #12
+  pop   {r4, r5, lr}
+  bx    lr
+
+// starts Timer 2 counting cycles, and Timer 3 counting its overflows, for the profiler
+@ext.prof_start:
+  ldr   r12, =0x04000108
+  mov   r0, #0
+  str   r0, [r12]
+  mov   r0, #0x00840000
+  str   r0, [r12, #4]
+  mov   r0, #0x00800000
+  str   r0, [r12]
+  bx    lr
+
+// r0 = zone; records the end of the zone
+@ext.prof_end:
+  orr   r0, r0, #0x100
+// r0 = zone; records the beginning of the zone
+@ext.prof_begin:
+  // if Timer 2 overflowed between reading Timer 3 twice, the low half says which one goes with it
+  ldr   r12, =0x04000108
+  ldrh  r1, [r12, #4]
+  ldrh  r2, [r12]
+  ldrh  r3, [r12, #4]
+  tst   r2, #0x8000
+  moveq r1, r3
+  orr   r1, r2, r1, lsl #16
+  ldr   r12, =$ext.prof.head
+  ldr   r2, [r12]
+  add   r3, r2, #1
+  str   r3, [r12]
+  and   r2, r2, #$ext.prof.length - 1
+  add   r12, r12, r2, lsl #3
+  stmib r12, {r0, r1}
+  bx    lr
+
+// totals the cycles and calls of each zone from the entries recorded since the last call, into
+// $ext.prof.cycles and $ext.prof.calls, then empties the ring; call once per frame
+@ext.prof_frame:
+  push  {r4-r9, lr}
+  ldr   r4, =$ext.prof.head
+  ldr   r5, [r4]
+  mov   r0, #0
+  str   r0, [r4]
+  ldr   r0, =$ext.prof.cycles
+  mov   r1, #0
+  mov   r2, #256
+  bl    @ext.memset32
+  ldr   r7, =$ext.prof.open
+  ldr   r7, [r7]
+  // when the ring wrapped, only the newest entries are left
+  subs  r6, r5, #$ext.prof.length
+  movlo r6, #0
+  ldrhi r0, =$ext.prof.overflow
+  ldrhi r1, [r0]
+  addhi r1, r1, r6
+  strhi r1, [r0]
+  ldr   r8, =$ext.prof.entries
+  ldr   r9, =$ext.prof.stamps
+  cmp   r6, r5
+  beq   @@frameDone
+@@frameEntry:
+  and   r0, r6, #$ext.prof.length - 1
+  add   r0, r8, r0, lsl #3
+  ldmia r0, {r0, r1}
+  and   r2, r0, #31
+  mov   r3, #1
+  mov   r3, r3, lsl r2
+  tst   r0, #0x100
+  bne   @@frameEnd
+  str   r1, [r9, r2, lsl #2]
+  orr   r7, r7, r3
+  b     @@frameNext
+@@frameEnd:
+  // ends without a beginning are ignored
+  tst   r7, r3
+  beq   @@frameNext
+  bic   r7, r7, r3
+  ldr   r3, [r9, r2, lsl #2]
+  sub   r1, r1, r3
+  add   r12, r9, #$ext.prof.cycles - $ext.prof.stamps
+  ldr   r3, [r12, r2, lsl #2]
+  add   r3, r3, r1
+  str   r3, [r12, r2, lsl #2]
+  add   r12, r9, #$ext.prof.calls - $ext.prof.stamps
+  ldr   r3, [r12, r2, lsl #2]
+  add   r3, r3, #1
+  str   r3, [r12, r2, lsl #2]
+@@frameNext:
+  add   r6, r6, #1
+  cmp   r6, r5
+  bne   @@frameEntry
+@@frameDone:
+  ldr   r0, =$ext.prof.open
+  str   r7, [r0]
+  pop   {r4-r9, lr}
+  bx    lr
+
+// r0 = x, r1 = y; prints the name and cycles of each zone from the last frame, a line each, with
+// the text routines
+@ext.prof_draw:
+  push  {r4-r6, lr}
+  mov   r4, r0
+  mov   r5, r1
+  mov   r6, #0
+@@drawZone:
+  cmp   r6, #$ext.prof.zones
+  popeq {r4-r6, lr}
+  bxeq  lr
+  ldr   r0, =@ext.prof_names
+  ldr   r0, [r0, r6, lsl #2]
+  mov   r1, r4
+  add   r2, r5, r6
+  bl    @ext.text_print
+  // clear the old number, which could be longer
+  ldr   r0, =@ext.prof_blank
+  add   r1, r4, #$ext.prof.width
+  add   r2, r5, r6
+  bl    @ext.text_print
+  ldr   r0, =$ext.prof.cycles
+  ldr   r0, [r0, r6, lsl #2]
+  add   r1, r4, #$ext.prof.width
+  add   r2, r5, r6
+  bl    @ext.text_uint
+  add   r6, r6, #1
+  b     @@drawZone
+
+.pool
+.align 4
+@ext.iwram_end:
+.end
+@@iwramEnd:
+.end
+
+.align 4
+@ext.prof_names:
+  .script
+    for var zone: store.get 'ext.prof.zones', {}
+      put '.i32 @ext.prof_name.' ~ zone
+    end
+    for var zone: store.get 'ext.prof.zones', {}
+      put '@ext.prof_name.' ~ zone ~ ':'
+      put '.i8 "' ~ zone ~ '", 0'
+    end
+  .end
+@ext.prof_blank:
+  .i8 "          ", 0
+
 .align 4
 @ext.font:
   // 00 space
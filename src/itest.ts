@@ -21,8 +21,11 @@ import { load as sinkLoad } from './itests/sink.ts';
 import { load as stdlibLoad } from './itests/stdlib.ts';
 import { load as regsLoad } from './itests/regs.ts';
 import { load as runLoad } from './itests/run.ts';
+import { load as extlibLoad } from './itests/extlib.ts';
+import { load as apiLoad } from './itests/api.ts';
 import { makeFromFile } from './make.ts';
 import { runResult } from './run.ts';
+import { PerfLint } from './perflint.ts';
 import * as sink from './sink.ts';
 import { assertNever } from './util.ts';
 
@@ -45,6 +48,7 @@ interface ITestRun {
   name: string;
   desc: string;
   kind: 'run';
+  perfLint?: boolean;
   stdout: string[];
   files: { [filename: string]: string };
 }
@@ -56,7 +60,16 @@ interface ITestSink {
   files: { [fiename: string]: string };
 }
 
-export type ITest = ITestMake | ITestRun | ITestSink;
+// calls the API directly, and compares what it logs against stdout
+interface ITestApi {
+  name: string;
+  desc: string;
+  kind: 'api';
+  stdout: string[];
+  run: (log: (str: string) => void) => Promise<void>;
+}
+
+export type ITest = ITestMake | ITestRun | ITestSink | ITestApi;
 
 function extractBytes(data: string): number[] {
   const bytes = data
@@ -222,6 +235,8 @@ async function itestRun(test: ITestRun): Promise<boolean> {
     res.arm,
     res.debug,
     (str: string) => stdout.push(str),
+    false,
+    test.perfLint ? new PerfLint(res.lines) : false,
   );
 
   for (let i = 0; i < Math.max(test.stdout.length, stdout.length); i++) {
@@ -238,6 +253,22 @@ async function itestRun(test: ITestRun): Promise<boolean> {
   return true;
 }
 
+async function itestApi(test: ITestApi): Promise<boolean> {
+  const stdout: string[] = [];
+  await test.run((str) => stdout.push(str));
+  for (let i = 0; i < Math.max(test.stdout.length, stdout.length); i++) {
+    const exp = test.stdout[i];
+    const got = stdout[i];
+    if (exp !== got) {
+      console.error(`\nStdout doesn't match as expected on line ${i + 1}`);
+      console.error(`  expected: ${JSON.stringify(exp)}`);
+      console.error(`  got:      ${JSON.stringify(got)}`);
+      return false;
+    }
+  }
+  return true;
+}
+
 async function itestSink(test: ITestSink): Promise<boolean> {
   const scr = sink.scr_new(
     {
@@ -346,6 +377,8 @@ export async function itest({ filters }: IItestArgs): Promise<number> {
   stdlibLoad(def);
   regsLoad(def);
   runLoad(def);
+  extlibLoad(def);
+  apiLoad(def);
 
   // execute the tests that match any filter
   const indexDigits = Math.ceil(Math.log10(tests.length));
@@ -381,6 +414,9 @@ export async function itest({ filters }: IItestArgs): Promise<number> {
         case 'sink':
           pass = await itestSink(test.test);
           break;
+        case 'api':
+          pass = await itestApi(test.test);
+          break;
         default:
           assertNever(test.test);
       }
@@ -0,0 +1,445 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { ITest } from '../itest.ts';
+import { Assembler, IAssemblerResult } from '../assembler.ts';
+import { lspServe } from '../lsp.ts';
+import { makeFromFile } from '../make.ts';
+import * as sink from '../sink.ts';
+import { multibootImage } from '../multiboot.ts';
+import { diffSectors, IPatchSector, patchChunks, PatchRead } from '../patch.ts';
+
+function logBuild(log: (str: string) => void, res: IAssemblerResult) {
+  if ('errors' in res) {
+    for (const err of res.errors) {
+      log(err);
+    }
+    return;
+  }
+  log([...res.rom].map((n) => n.toString(16).padStart(2, '0')).join(' '));
+}
+
+function hexBytes(bytes: Uint8Array) {
+  return [...bytes].map((n) => n.toString(16).padStart(2, '0')).join(' ');
+}
+
+function memoryReader(data: Uint8Array): PatchRead {
+  let pos = 0;
+  return (buf) => {
+    // return short reads, like a file would
+    const n = Math.min(buf.length, data.length - pos, 0x1234);
+    buf.set(data.subarray(pos, pos + n));
+    pos += n;
+    return Promise.resolve(n <= 0 ? null : n);
+  };
+}
+
+// reference decoder for the BIOS LZ77 format, see lz77.ts
+function lz77Decode(data: Uint8Array): Uint8Array {
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  const out = new Uint8Array(view.getUint32(0, true) >>> 8);
+  let src = 4;
+  let dst = 0;
+  while (dst < out.length) {
+    const flags = data[src++];
+    for (let bit = 0x80; bit && dst < out.length; bit >>= 1) {
+      if (flags & bit) {
+        const b0 = data[src++];
+        const b1 = data[src++];
+        const from = dst - (((b0 & 0xf) << 8) | b1) - 1;
+        for (let i = 0; i < (b0 >> 4) + 3 && dst < out.length; i++) {
+          out[dst++] = out[from + i];
+        }
+      } else {
+        out[dst++] = data[src++];
+      }
+    }
+  }
+  return out;
+}
+
+function logSectors(log: (str: string) => void, list: IPatchSector[]) {
+  log(list.map(({ start, length }) => `${start.toString(16)}+${length.toString(16)}`).join(' '));
+}
+
+export function load(def: (test: ITest) => void) {
+  def({
+    name: 'api.assembler.build',
+    desc: 'Assemble from an in-memory filesystem, with symbol and line tables',
+    kind: 'api',
+    stdout: [
+      '02 00 a0 e3 fe ff ff ea',
+      '@main = 08000000, @loop = 08000004',
+      '/src/main.gvasm:3 08000000 +0 4',
+      '/src/main.gvasm:5 08000004 +4 4',
+      'foo',
+    ],
+    run: async (log) => {
+      const asm = new Assembler();
+      asm.writeFile('/src/main.gvasm', [
+        '.include "inc.gvasm"',
+        '@main:',
+        'mov r0, #$value',
+        '@loop:',
+        'b @loop',
+        '.printf "foo"',
+      ].join('\n'));
+      asm.writeFile('src/inc.gvasm', '.def $value = 2\n');
+      const res = await asm.assemble('/src/main.gvasm');
+      logBuild(log, res);
+      if ('errors' in res) {
+        return;
+      }
+      const sym = (name: string) => `${name} = ${res.symbols[name].toString(16).padStart(8, '0')}`;
+      log(`${sym('@main')}, ${sym('@loop')}`);
+      for (const { filename, line, addr, offset, size } of res.lines) {
+        log(`${filename}:${line} ${addr.toString(16).padStart(8, '0')} +${offset} ${size}`);
+      }
+      for (const str of res.logs) {
+        log(str);
+      }
+    },
+  });
+
+  def({
+    name: 'api.assembler.rebuild',
+    desc: 'Rebuild after editing, adding, and removing includes',
+    kind: 'api',
+    stdout: [
+      '01 00 a0 e3 02 00 a0 e3',
+      '01 00 a0 e3 05 00 a0 e3',
+      '/b.gvasm:1:1: Failed to include file: /c.gvasm',
+      '01 00 a0 e3 03 00 a0 e3',
+    ],
+    run: async (log) => {
+      const asm = new Assembler();
+      asm.writeFile('/main.gvasm', '.include "a.gvasm"\n.include "b.gvasm"\n');
+      asm.writeFile('/a.gvasm', 'mov r0, #1\n');
+      asm.writeFile('/b.gvasm', 'mov r0, #2\n');
+      logBuild(log, await asm.assemble('/main.gvasm'));
+      // only b.gvasm changed, so a.gvasm comes from the previous build
+      asm.writeFile('/b.gvasm', 'mov r0, #5\n');
+      logBuild(log, await asm.assemble('/main.gvasm'));
+      asm.writeFile('/b.gvasm', '.include "c.gvasm"\n');
+      logBuild(log, await asm.assemble('/main.gvasm'));
+      asm.writeFile('/c.gvasm', 'mov r0, #3\n');
+      logBuild(log, await asm.assemble('/main.gvasm'));
+    },
+  });
+
+  def({
+    name: 'api.assembler.concurrent',
+    desc: 'Overlapping builds on one session each see their own files',
+    kind: 'api',
+    stdout: [
+      '01 00 a0 e3 02 00 a0 e3',
+      '01 00 a0 e3 03 00 a0 e3',
+      '01 00 a0 e3 02 00 a0 e3',
+    ],
+    run: async (log) => {
+      const asm = new Assembler();
+      asm.writeFile('/one.gvasm', '.include "common.gvasm"\nmov r0, #2\n');
+      asm.writeFile('/two.gvasm', '.include "common.gvasm"\nmov r0, #3\n');
+      asm.writeFile('/common.gvasm', 'mov r0, #1\n');
+      const results = await Promise.all([
+        asm.assemble('/one.gvasm'),
+        asm.assemble('/two.gvasm'),
+        asm.assemble('/one.gvasm'),
+      ]);
+      for (const res of results) {
+        logBuild(log, res);
+      }
+    },
+  });
+
+  def({
+    name: 'api.lsp.diagnostics',
+    desc: 'Language server publishes diagnostics for open documents',
+    kind: 'api',
+    stdout: [
+      'response 1: gvasm',
+      'diagnostics /lsp/main.gvasm: 2:0 Unknown arm statement: bad',
+      'diagnostics /lsp/main.gvasm: none',
+      'response 2: null',
+      'exit 0',
+    ],
+    run: async (log) => {
+      const encoder = new TextEncoder();
+      const decoder = new TextDecoder();
+      const uri = 'file:///lsp/main.gvasm';
+      const frames: Uint8Array[] = [];
+      let wake = () => {};
+      const send = (msg: unknown) => {
+        const body = encoder.encode(JSON.stringify({ jsonrpc: '2.0', ...(msg as object) }));
+        frames.push(encoder.encode(`Content-Length: ${body.length}\r\n\r\n`), body);
+        wake();
+      };
+      const read = async (buf: Uint8Array) => {
+        while (frames.length <= 0) {
+          await new Promise<void>((resolve) => wake = resolve);
+        }
+        const frame = frames.shift() as Uint8Array;
+        buf.set(frame);
+        return frame.length;
+      };
+      let published = 0;
+      const write = (buf: Uint8Array) => {
+        const text = decoder.decode(buf);
+        const msg = JSON.parse(text.substr(text.indexOf('\r\n\r\n') + 4));
+        if (msg.id !== undefined) {
+          log(`response ${msg.id}: ${msg.result?.serverInfo?.name ?? msg.result}`);
+        } else if (msg.method === 'textDocument/publishDiagnostics') {
+          const diags = msg.params.diagnostics.map((d: {
+            range: { start: { line: number; character: number } };
+            message: string;
+          }) => `${d.range.start.line}:${d.range.start.character} ${d.message}`);
+          log(
+            `diagnostics ${new URL(msg.params.uri).pathname}: ${
+              diags.length > 0 ? diags.join(', ') : 'none'
+            }`,
+          );
+          published++;
+          if (published === 1) {
+            // fix the error by replacing the bad line
+            send({
+              method: 'textDocument/didChange',
+              params: {
+                textDocument: { uri, version: 2 },
+                contentChanges: [{
+                  range: { start: { line: 2, character: 0 }, end: { line: 2, character: 6 } },
+                  text: 'nop',
+                }],
+              },
+            });
+          } else {
+            send({ id: 2, method: 'shutdown' });
+            send({ method: 'exit' });
+          }
+        }
+        return Promise.resolve(buf.length);
+      };
+      send({ id: 1, method: 'initialize', params: {} });
+      send({ method: 'initialized', params: {} });
+      send({
+        method: 'textDocument/didOpen',
+        params: {
+          textDocument: {
+            uri,
+            languageId: 'gvasm',
+            version: 1,
+            text: '.arm\nmov r0, #1\nbad r1\n',
+          },
+        },
+      });
+      log(`exit ${await lspServe({ input: false, defines: [] }, read, write)}`);
+    },
+  });
+
+  def({
+    name: 'api.patch.header',
+    desc: 'Patch file layout without a previous build',
+    kind: 'api',
+    stdout: [
+      '1 of 1',
+      '47 56 50 54 06 00 00 00 01 00 00 00',
+      '00 00 00 00 06 00 00 00',
+      '01 02 03 04 05 06',
+    ],
+    run: async (log) => {
+      const rom = new Uint8Array([1, 2, 3, 4, 5, 6]);
+      const { changed, total } = await diffSectors(rom, 's29gl', false);
+      log(`${changed.length} of ${total}`);
+      for (const chunk of patchChunks(rom, changed)) {
+        log(hexBytes(chunk));
+      }
+    },
+  });
+
+  def({
+    name: 'api.patch.changed',
+    desc: 'Only sectors that differ from the previous build are in the patch',
+    kind: 'api',
+    stdout: [
+      '3 of 3',
+      '0+2000 2000+2000 4000+1000',
+      '0 of 3',
+      '',
+      '2 of 3',
+      '2000+2000 4000+1000',
+      '47 56 50 54 00 50 00 00 02 00 00 00',
+      '00 20 00 00 00 20 00 00',
+      '00 01 02',
+    ],
+    run: async (log) => {
+      const rom = new Uint8Array(0x5000);
+      for (let i = 0; i < rom.length; i++) {
+        rom[i] = i & 0xff;
+      }
+      const check = async (old: Uint8Array | false) => {
+        const { changed, total } = await diffSectors(rom, 'm58wr064fb', old && memoryReader(old));
+        log(`${changed.length} of ${total}`);
+        logSectors(log, changed);
+        return changed;
+      };
+      await check(false);
+      // a previous build that's longer than the new ROM
+      const same = new Uint8Array(0x6000);
+      same.set(rom);
+      await check(same);
+      // one byte different, and a previous build that ends in the middle of the last sector
+      const old = rom.slice(0, 0x4800);
+      old[0x2000] = 0xff;
+      const changed = await check(old);
+      const chunks = patchChunks(rom, changed);
+      log(hexBytes(chunks[0]));
+      log(hexBytes(chunks[1]));
+      log(hexBytes(chunks[2].subarray(0, 3)));
+    },
+  });
+
+  def({
+    name: 'api.patch.chips',
+    desc: 'Flash chip sector tables',
+    kind: 'api',
+    stdout: [
+      'm58wr064ft 135',
+      '0+10000 7e0000+10000 7f0000+2000 7fe000+2000',
+      'm58wr064fb 135',
+      '0+2000 e000+2000 10000+10000 7f0000+10000',
+      'm58wr064fb 9',
+      '0+2000 e000+2000 10000+1',
+      's29gl 512',
+      '0+20000 20000+20000 3fe0000+20000',
+      'ROM is larger than the flash chip m58wr064ft',
+      'Unknown flash chip: foo',
+    ],
+    run: async (log) => {
+      const check = async (chip: string, length: number, pick: number[]) => {
+        try {
+          const { changed, total } = await diffSectors(new Uint8Array(length), chip, false);
+          log(`${chip} ${total}`);
+          logSectors(log, pick.map((i) => changed[i < 0 ? changed.length + i : i]));
+        } catch (e) {
+          log(`${e}`);
+        }
+      };
+      // first sector, and the sectors around where the size changes
+      await check('m58wr064ft', 0x800000, [0, 126, 127, -1]);
+      await check('m58wr064fb', 0x800000, [0, 7, 8, -1]);
+      await check('m58wr064fb', 0x10001, [0, 7, 8]);
+      await check('s29gl', 0x4000000, [0, 1, -1]);
+      await check('m58wr064ft', 0x800001, []);
+      await check('foo', 1, []);
+    },
+  });
+
+  def({
+    name: 'api.multiboot.image',
+    desc: 'Multiboot image header, decompression stub, and padding',
+    kind: 'api',
+    stdout: [
+      'size 16n: 1',
+      'branches: ea000037 ea000007 eaffffff',
+      'header: 1',
+      'stub: e59f003c e59f103c e59f203c e5303004',
+      'pool: end 1, 02040000, 02000134',
+      'padding: 1',
+      'program: 1',
+      'Multiboot program must start with a GBA header',
+    ],
+    run: (log) => {
+      const rom = new Uint8Array(0x1000);
+      for (let i = 0; i < rom.length; i++) {
+        rom[i] = i < 0xc0 ? (i * 37) & 0xff : (i >> 5) & 0xff;
+      }
+      const image = multibootImage(rom);
+      const view = new DataView(image.buffer);
+      const word = (offset: number) => view.getUint32(offset, true).toString(16).padStart(8, '0');
+      log(`size 16n: ${image.length % 16 === 0 ? 1 : 0}`);
+      log(`branches: ${word(0x000)} ${word(0x0c0)} ${word(0x0e0)}`);
+      let header = 1;
+      for (let i = 4; i < 0xc0; i++) {
+        if (image[i] !== rom[i]) {
+          header = 0;
+        }
+      }
+      log(`header: ${header}`);
+      log(`stub: ${word(0x0e4)} ${word(0x0e8)} ${word(0x0ec)} ${word(0x0f0)}`);
+      // the pool at the end of the stub points at the compressed data
+      const end = view.getUint32(0x128, true) - 0x02000000;
+      const endOk = end > 0x134 && end <= image.length;
+      log(`pool: end ${endOk ? 1 : 0}, ${word(0x12c)}, ${word(0x130)}`);
+      let padding = 1;
+      for (let i = end; i < image.length; i++) {
+        if (image[i] !== 0) {
+          padding = 0;
+        }
+      }
+      log(`padding: ${padding}`);
+      const program = lz77Decode(image.subarray(0x134, end));
+      const same = program.length === rom.length && program.every((b, i) => b === rom[i]);
+      log(`program: ${same ? 1 : 0}`);
+      try {
+        multibootImage(new Uint8Array(0x80));
+      } catch (e) {
+        log(`${e}`);
+      }
+      return Promise.resolve();
+    },
+  });
+
+  def({
+    name: 'api.make.auto-pool-lines',
+    desc: 'Labels and line tables skip over automatic pools',
+    kind: 'api',
+    stdout: [
+      '@table = 08000008',
+      '@end = 0800045a',
+      '3: 08000000 +0 2',
+      '6: 08000008 +8 1100',
+      '7: 08000454 +1108 4',
+      '8: 08000458 +1112 2',
+    ],
+    run: async (log) => {
+      const text = [
+        '.thumb',
+        '.pool auto',
+        'ldr r0, =0x12345678',
+        '// the pool is written before the data, between the label and the data',
+        '@table:',
+        '.i8fill 1100, 0xaa',
+        '.i32 @table',
+        'b @end',
+        '@end:',
+      ].join('\n');
+      const res = await makeFromFile(
+        '/main.gvasm',
+        [],
+        true,
+        (f) => f.startsWith('/'),
+        (f) => Promise.resolve(f === '/main.gvasm' ? sink.fstype.FILE : sink.fstype.NONE),
+        () => Promise.resolve(text),
+        () => Promise.reject('no binary files'),
+        () => {},
+      );
+      if ('errors' in res) {
+        for (const err of res.errors) {
+          log(err);
+        }
+        return;
+      }
+      for (const { name, addr } of res.defs) {
+        if (addr !== undefined) {
+          log(`${name} = ${addr.toString(16).padStart(8, '0')}`);
+        }
+      }
+      for (const { line, addr, offset, size } of res.lines) {
+        log(`${line}: ${addr.toString(16).padStart(8, '0')} +${offset} ${size}`);
+      }
+    },
+  });
+}
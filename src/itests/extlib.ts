@@ -0,0 +1,1386 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { ITest } from '../itest.ts';
+
+// copies every length up to maxLen, from every source alignment to every destination alignment (in
+// steps of `step`), and checks the bytes around the copy aren't touched
+function copyTest(routine: string, step: number, maxLen: number) {
+  const name = routine.substr(5);
+  return `
+  ldr   r7, =${routine}
+  mov   r4, #0
+@src_${name}:
+  mov   r5, #0
+@dst_${name}:
+  mov   r6, #0
+@len_${name}:
+  ldr   r0, =0x02001000
+  mov   r1, #0xee
+  mov   r2, #0
+@clear_${name}:
+  strb  r1, [r0, r2]
+  add   r2, r2, #1
+  cmp   r2, #${maxLen + 8}
+  blo   @clear_${name}
+  ldr   r0, =0x02001000
+  add   r0, r0, r5
+  ldr   r1, =0x02000000
+  add   r1, r1, r4
+  mov   r2, r6
+  mov   lr, pc
+  bx    r7
+  ldr   r0, =0x02001000
+  mov   r2, #0
+@check_${name}:
+  ldrb  r1, [r0, r2]
+  sub   r3, r2, r5
+  cmp   r3, r6
+  addlo r3, r3, r4
+  movhs r3, #0xee
+  cmp   r1, r3
+  addne r11, r11, #1
+  add   r2, r2, #1
+  cmp   r2, #${maxLen + 8}
+  blo   @check_${name}
+  add   r6, r6, #${step}
+  cmp   r6, #${maxLen}
+  bls   @len_${name}
+  add   r5, r5, #${step}
+  cmp   r5, #4
+  blo   @dst_${name}
+  add   r4, r4, #${step}
+  cmp   r4, #4
+  blo   @src_${name}
+  _log  "${routine} failures: %d", r11
+`;
+}
+
+// source bytes are 0, 1, 2, ...
+const fillSource = `
+  ldr   r0, =0x02000000
+  mov   r1, #0
+@fill:
+  strb  r1, [r0, r1]
+  add   r1, r1, #1
+  cmp   r1, #256
+  blo   @fill
+  mov   r11, #0
+`;
+
+export function load(def: (test: ITest) => void) {
+  def({
+    name: 'extlib.memcpy',
+    desc: 'Copy routines handle every alignment and length',
+    kind: 'run',
+    stdout: [
+      '@ext.memcpy failures: 0',
+      '@ext.memcpy16 failures: 0',
+      '@ext.memcpy32 failures: 0',
+    ],
+    files: {
+      '/root/main': `
+bl    @ext.init
+${fillSource}
+${copyTest('@ext.memcpy', 1, 40)}
+${copyTest('@ext.memcpy16', 2, 40)}
+${copyTest('@ext.memcpy32', 4, 136)}
+_exit
+nop
+.pool
+.extlib
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.memset32',
+    desc: 'Fill words without touching the words around them',
+    kind: 'run',
+    stdout: [
+      'ffffffff 12345678 12345678 ffffffff',
+      'ffffffff 12345678 12345678 ffffffff',
+      'r4-r8 kept',
+    ],
+    files: {
+      '/root/main': `
+bl    @ext.init
+ldr   r0, =0x03004000
+mvn   r1, #0
+mov   r2, #512
+bl    @ext.memset32
+ldr   r4, =0x04040404
+ldr   r5, =0x05050505
+ldr   r6, =0x06060606
+ldr   r7, =0x07070707
+ldr   r8, =0x08080808
+// 7 words, which only uses the tail
+ldr   r0, =0x03004004
+ldr   r1, =0x12345678
+mov   r2, #28
+bl    @ext.memset32
+ldr   r0, =0x03004000
+_log  "%08x %08x %08x %08x", [r0], [r0 + 4], [r0 + 28], [r0 + 32]
+// 57 words, which uses the loop and the tail
+ldr   r0, =0x03004044
+ldr   r1, =0x12345678
+mov   r2, #228
+bl    @ext.memset32
+ldr   r0, =0x03004040
+_log  "%08x %08x %08x %08x", [r0], [r0 + 4], [r0 + 228], [r0 + 232]
+ldr   r0, =0x04040404
+cmp   r4, r0
+ldreq r0, =0x05050505
+cmpeq r5, r0
+ldreq r0, =0x06060606
+cmpeq r6, r0
+ldreq r0, =0x07070707
+cmpeq r7, r0
+ldreq r0, =0x08080808
+cmpeq r8, r0
+bne   @fail
+_log  "r4-r8 kept"
+@fail:
+_exit
+nop
+.pool
+.extlib
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.memcpy-cycles',
+    desc: 'Time memcpy32 against CpuFastSet with a timer',
+    kind: 'run',
+    stdout: [
+      'IWRAM to IWRAM, 64 bytes: memcpy32 129, CpuFastSet 134',
+      'IWRAM to IWRAM, 100 bytes: memcpy32 163, CpuFastSet 180',
+      'IWRAM to IWRAM, 256 bytes: memcpy32 255, CpuFastSet 272',
+      'IWRAM to IWRAM, 1024 bytes: memcpy32 759, CpuFastSet 824',
+      'EWRAM to EWRAM, 1024 bytes: memcpy32 3319, CpuFastSet 3384',
+      'IWRAM to VRAM, 1024 bytes: memcpy32 1015, CpuFastSet 1080',
+    ],
+    files: {
+      '/root/main': `
+bl    @ext.init
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+.script
+  def bench name, dst, src, bytes
+    put "ldr   r0, =\${dst}"
+    put "ldr   r1, =\${src}"
+    put "mov   r2, #\${bytes}"
+    put "str   r10, [r9]"
+    put "bl    @ext.memcpy32"
+    put "ldrh  r4, [r9]"
+    put "str   r11, [r9]"
+    put "ldr   r0, =\${src}"
+    put "ldr   r1, =\${dst}"
+    put "mov   r2, #\${bytes / 4}"
+    put "str   r10, [r9]"
+    put "swi   0x0c0000"
+    put "ldrh  r5, [r9]"
+    put "str   r11, [r9]"
+    put "_log  \\"\${name}, \${bytes} bytes: memcpy32 %d, CpuFastSet %d\\", r4, r5"
+  end
+  bench 'IWRAM to IWRAM', 0x03004000, 0x03006000, 64
+  bench 'IWRAM to IWRAM', 0x03004000, 0x03006000, 100
+  bench 'IWRAM to IWRAM', 0x03004000, 0x03006000, 256
+  bench 'IWRAM to IWRAM', 0x03004000, 0x03006000, 1024
+  bench 'EWRAM to EWRAM', 0x02010000, 0x02020000, 1024
+  bench 'IWRAM to VRAM', 0x06000000, 0x03006000, 1024
+.end
+_exit
+nop
+.pool
+.extlib
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.dmaq',
+    desc: 'Queue DMA transfers and flush them by priority within a budget',
+    kind: 'run',
+    stdout: [
+      'queued 1 1 1',
+      'flush: left 1320, deferred 0, vram 22222222 11111111',
+      'flush: left 952, deferred 1, vram 33333333',
+      'flush: left 48928, deferred 1, vram 11111111 11111111',
+      'queued 32, overflow 2',
+      'flush 32 transfers of 64 bytes: budget used 5632, measured 5784 cycles',
+    ],
+    files: {
+      '/root/main': `
+// the queue's variables are used below, so include .extlib first
+b     @main
+.extlib
+@main:
+bl    @ext.init
+ldr   r0, =0x02010000
+ldr   r1, =0x11111111
+mov   r2, #0x1000
+bl    @ext.memset32
+ldr   r1, =0x22222222
+mov   r2, #0x1000
+bl    @ext.memset32
+ldr   r1, =0x33333333
+mov   r2, #0x1000
+bl    @ext.memset32
+
+// the low priority transfer is pushed first, but lands last
+ldr   r0, =0x06000000
+ldr   r1, =0x02011000
+ldr   r2, =0x04000040 // 64 words
+mov   r3, #3
+bl    @ext.dmaq_push
+mov   r4, r0
+ldr   r0, =0x06000000
+ldr   r1, =0x02012000
+ldr   r2, =0x04000040
+mov   r3, #0
+bl    @ext.dmaq_push
+mov   r5, r0
+ldr   r0, =0x06000100
+ldr   r1, =0x02010000
+mov   r2, #0x80 // 128 halfwords
+mov   r3, #1
+bl    @ext.dmaq_push
+_log  "queued %d %d %d", r4, r5, r0
+ldr   r0, =3000
+bl    @ext.dmaq_flush
+ldr   r1, =0x06000000
+ldr   r2, =$ext.dmaq.deferred
+_log  "flush: left %d, deferred %d, vram %08x %08x", r0, [r2], [r1], [r1 + 0x100]
+
+// a budget too small for the second transfer defers it
+ldr   r0, =0x06000000
+ldr   r1, =0x02012000
+ldr   r2, =0x04000100 // 256 words, costs 2048
+mov   r3, #2
+bl    @ext.dmaq_push
+ldr   r0, =0x06000000
+ldr   r1, =0x02010000
+ldr   r2, =0x04000100
+mov   r3, #2
+bl    @ext.dmaq_push
+ldr   r0, =3048
+bl    @ext.dmaq_flush
+ldr   r1, =0x06000000
+ldr   r2, =$ext.dmaq.deferred
+_log  "flush: left %d, deferred %d, vram %08x", r0, [r2], [r1 + 0x3fc]
+ldr   r0, =51024
+bl    @ext.dmaq_flush
+ldr   r1, =0x06000000
+ldr   r2, =$ext.dmaq.deferred
+_log  "flush: left %d, deferred %d, vram %08x %08x", r0, [r2], [r1], [r1 + 0x3fc]
+
+// fill one priority past its length
+mov   r6, #0
+mov   r7, #0
+@fill:
+ldr   r0, =0x06000000
+ldr   r1, =0x02010000
+ldr   r2, =0x04000010
+mov   r3, #1
+bl    @ext.dmaq_push
+add   r6, r6, r0
+add   r7, r7, #1
+cmp   r7, #34
+blo   @fill
+ldr   r2, =$ext.dmaq.overflow
+_log  "queued %d, overflow %d", r6, [r2]
+
+// time the flush with TM0
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+ldr   r0, =6000
+str   r10, [r9]
+bl    @ext.dmaq_flush
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r1, =6000
+sub   r0, r1, r0
+_log  "flush 32 transfers of 64 bytes: budget used %d, measured %d cycles", r0, r4
+_exit
+nop
+.pool
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.ewram-base',
+    desc: 'Require $ext.ewram when the program runs from EWRAM',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+.base 0x02000000
+.extlib
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.oam',
+    desc: 'Sort sprites by key into the OAM mirror',
+    kind: 'run',
+    stdout: [
+      'attr0 0001 0003 0000 0004 0002 0200',
+      'attr2 0011 0013 0010 0014 0012, affine 1234',
+      'sorted 128 sprites, out of order 0, in 4745 cycles',
+      'copied 0011 in 594 cycles, hidden 127',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+ldr   r4, =$ext.oam.mirror
+ldr   r0, =0x1234
+strh  r0, [r4, #6]
+
+// keys 5, 2, 9, 2, 7, with attr0 as the order added
+.script
+  for var key, i: {5, 2, 9, 2, 7}
+    put "mov   r0, #$i"
+    put "mov   r1, #\${0x10 + i}"
+    put "mov   r2, #$key"
+    put "bl    @ext.oam_add"
+  end
+.end
+bl    @ext.oam_sort
+ldr   r4, =$ext.oam.mirror
+_log  "attr0 %04x %04x %04x %04x %04x %04x", [r4] & 0xffff, [r4 + 8] & 0xffff, \\
+  [r4 + 16] & 0xffff, [r4 + 24] & 0xffff, [r4 + 32] & 0xffff, [r4 + 40] & 0xffff
+_log  "attr2 %04x %04x %04x %04x %04x, affine %04x", [r4 + 4] & 0xffff, [r4 + 12] & 0xffff, \\
+  [r4 + 20] & 0xffff, [r4 + 28] & 0xffff, [r4 + 36] & 0xffff, [r4 + 6] & 0xffff
+
+// 128 sprites with pseudo-random keys, and the key in attr2 to check the order
+ldr   r6, =12345
+ldr   r7, =1103515245
+mov   r8, #0
+@add:
+mul   r6, r7, r6
+add   r6, r6, #12288
+add   r6, r6, #57
+mov   r2, r6, lsr #24
+mov   r0, r8
+mov   r1, r2
+bl    @ext.oam_add
+add   r8, r8, #1
+cmp   r8, #128
+blo   @add
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+str   r10, [r9]
+bl    @ext.oam_sort
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r4, =$ext.oam.mirror
+mov   r0, #0
+mov   r1, #0
+mov   r2, #0
+@check:
+ldrh  r3, [r4, #4]
+cmp   r3, r0
+addlo r1, r1, #1
+mov   r0, r3
+add   r4, r4, #8
+add   r2, r2, #1
+cmp   r2, #128
+blo   @check
+_log  "sorted 128 sprites, out of order %d, in %d cycles", r1, r5
+
+// a single sprite hides the other 127
+mov   r0, #0
+mov   r1, #0x11
+mov   r2, #0
+bl    @ext.oam_add
+bl    @ext.oam_sort
+str   r10, [r9]
+bl    @ext.oam_copy
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r4, =0x07000000
+mov   r0, #0
+mov   r1, #8
+@hidden:
+ldrh  r2, [r4, r1]
+cmp   r2, #0x0200
+addeq r0, r0, #1
+add   r1, r1, #8
+cmp   r1, #1024
+blo   @hidden
+_log  "copied %04x in %d cycles, hidden %d", [r4 + 4] & 0xffff, r5, r0
+_exit
+nop
+.pool
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.pool',
+    desc: 'Allocate and free fixed-size blocks from pools',
+    kind: 'run',
+    stdout: [
+      'bullets: 02000834 02000844 02000854 02000864 00000000',
+      'foes: 03000914 03000934 03000954, then 00000000',
+      'reused 03000954 03000934',
+      'used 1, peak 3',
+    ],
+    files: {
+      '/root/main': `
+.def $ext.debug = 1
+.script
+  store.set 'ext.pools', {
+    {'bullets', 16, 4, 'ewram'},
+    {'foes', 32, 3, 'iwram'},
+  }
+.end
+b     @main
+.extlib
+@main:
+bl    @ext.init
+.script
+  def alloc pool, reg
+    put "ldr   r0, =\\$ext.pool.$pool"
+    put "bl    @ext.pool_alloc"
+    put "mov   $reg, r0"
+  end
+  def free pool, reg
+    put "ldr   r0, =\\$ext.pool.$pool"
+    put "mov   r1, $reg"
+    put "bl    @ext.pool_free"
+  end
+  for var r: {'r4', 'r5', 'r6', 'r7', 'r8'}
+    alloc 'bullets', r
+  end
+  put "_log  \\"bullets: %08x %08x %08x %08x %08x\\", r4, r5, r6, r7, r8"
+  for var r: {'r4', 'r5', 'r6', 'r7'}
+    alloc 'foes', r
+  end
+  put "_log  \\"foes: %08x %08x %08x, then %08x\\", r4, r5, r6, r7"
+  // freed blocks come back last in, first out
+  free 'foes', 'r4'
+  free 'foes', 'r5'
+  free 'foes', 'r6'
+  alloc 'foes', 'r4'
+  alloc 'foes', 'r5'
+  put "_log  \\"reused %08x %08x\\", r4, r5"
+  free 'foes', 'r4'
+.end
+ldr   r0, =$ext.pool.foes
+_log  "used %d, peak %d", [r0 + 4], [r0 + 8]
+_exit
+nop
+.pool
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.pool-invalid',
+    desc: 'Reject pools with a block size that is not a multiple of 4',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+.script
+  store.set 'ext.pools', {{'bad', 6, 10, 'ewram'}}
+.end
+.extlib
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.co',
+    desc: 'Run ARM and Thumb coroutines round robin',
+    kind: 'run',
+    stdout: [
+      'counter 3',
+      'thumb 7',
+      'frame: alive 2, r4 aa',
+      'counter 2',
+      'thumb 8',
+      'frame: alive 1, r4 aa',
+      'counter 1',
+      'frame: alive 1, r4 aa',
+      'frame: alive 0, r4 aa',
+      'resume again 0',
+      'resume and yield: 211 cycles, resume finished: 71 cycles',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+ldr   r0, =@counter
+mov   r1, #3
+bl    @ext.co_create
+mov   r8, r0
+ldr   r0, =@thumbco + 1
+mov   r1, #7
+bl    @ext.co_create
+// callee-saved registers are kept across the switches
+mov   r4, #0xaa
+@frame:
+bl    @ext.co_run
+_log  "frame: alive %d, r4 %x", r0, r4
+cmp   r0, #0
+bne   @frame
+mov   r0, r8
+bl    @ext.co_resume
+_log  "resume again %d", r0
+
+// time a resume that yields straight back
+ldr   r0, =@yielder
+bl    @ext.co_create
+mov   r8, r0
+bl    @ext.co_resume
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+mov   r0, r8
+str   r10, [r9]
+bl    @ext.co_resume
+ldrh  r5, [r9]
+str   r11, [r9]
+mov   r0, r8
+str   r10, [r9]
+bl    @ext.co_resume
+ldrh  r5, [r9]
+str   r11, [r9]
+// and a resume of a finished coroutine, which returns straight away, to see the cost of calling
+// from ROM
+ldr   r0, =$ext.co.contexts + 48
+str   r10, [r9]
+bl    @ext.co_resume
+ldrh  r6, [r9]
+str   r11, [r9]
+_log  "resume and yield: %d cycles, resume finished: %d cycles", r5, r6
+_exit
+nop
+.pool
+
+@counter:
+  push  {r4, lr}
+  mov   r4, r0
+@@loop:
+  _log  "counter %d", r4
+  bl    @ext.co_yield
+  subs  r4, r4, #1
+  bne   @@loop
+  pop   {r4, lr}
+  bx    lr
+
+@yielder:
+  bl    @ext.co_yield
+  b     @yielder
+  .pool
+
+.thumb
+@thumbco:
+  push  {r4, lr}
+  mov   r4, r0
+  _log  "thumb %d", r4
+  ldr   r1, =@ext.co_yield
+  bl    @callr1
+  add   r4, #1
+  _log  "thumb %d", r4
+  pop   {r4}
+  pop   {r1}
+  bx    r1
+@callr1:
+  bx    r1
+  .pool
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.mix',
+    desc: 'Mix looping, one-shot, and clipping sound channels',
+    kind: 'run',
+    stdout: [
+      'DMA1CNT b6400000, SOUNDCNT_H b04',
+      '251b1107 251b1107 251b1107 281e140a',
+      'blip playing 0',
+      '6e7f786e 7f787f7f 6e7f786e 7f787f7f',
+      '80808080 80808080 80808080 80808080',
+      'mix 0 channels: 3803 cycles, 4 channels: 25843 cycles',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+bl    @ext.mix_start
+ldr   r0, =0x040000c4
+ldr   r1, [r0]
+ldr   r2, =0x04000082
+ldrh  r2, [r2]
+_log  "DMA1CNT %x, SOUNDCNT_H %x", r1, r2
+// a looping ramp at full volume, and a one-shot at half speed and half volume
+mov   r0, #0
+ldr   r1, =@ramp
+mov   r2, #0x10000
+mov   r3, #64
+bl    @ext.mix_play
+mov   r0, #1
+ldr   r1, =@blip
+mov   r2, #0x8000
+mov   r3, #32
+bl    @ext.mix_play
+bl    @ext.mix
+ldr   r0, =$ext.mix.buffers + $ext.mix.length
+bl    @show
+ldr   r0, =$ext.mix.channels + 32 + 28
+ldr   r0, [r0]
+_log  "blip playing %d", r0
+bl    @ext.mix_vblank
+// the ramp at 1.5x, plus a loud loop that clips
+mov   r0, #0
+ldr   r1, =0x18000
+mov   r2, #64
+bl    @ext.mix_set
+mov   r0, #1
+ldr   r1, =@loud
+mov   r2, #0x10000
+mov   r3, #64
+bl    @ext.mix_play
+bl    @ext.mix
+ldr   r0, =$ext.mix.buffers
+bl    @show
+bl    @ext.mix_vblank
+mov   r0, #0
+bl    @ext.mix_stop
+mov   r0, #1
+ldr   r1, =@quiet
+ldr   r2, =0x20000
+mov   r3, #64
+bl    @ext.mix_play
+mov   r0, #2
+ldr   r1, =@quiet
+mov   r2, #0x10000
+mov   r3, #64
+bl    @ext.mix_play
+bl    @ext.mix
+ldr   r0, =$ext.mix.buffers + $ext.mix.length
+bl    @show
+
+// time a frame with no channels, then with 4 channels playing from ROM
+ldr   r9, =0x04000104
+mov   r10, #0x00800000
+mov   r11, #0
+mov   r0, #1
+bl    @ext.mix_stop
+mov   r0, #2
+bl    @ext.mix_stop
+str   r10, [r9]
+bl    @ext.mix
+ldrh  r5, [r9]
+str   r11, [r9]
+mov   r4, #0
+@play:
+mov   r0, r4
+ldr   r1, =@long
+ldr   r2, =0x15eb8
+mov   r3, #16
+bl    @ext.mix_play
+add   r4, r4, #1
+cmp   r4, #4
+blo   @play
+str   r10, [r9]
+bl    @ext.mix
+ldrh  r6, [r9]
+str   r11, [r9]
+_log  "mix 0 channels: %d cycles, 4 channels: %d cycles", r5, r6
+_exit
+nop
+
+@show:
+ldmia r0, {r0-r3}
+_log  "%08x %08x %08x %08x", r0, r1, r2, r3
+bx    lr
+.pool
+
+@ramp:
+.i32 @ramp.data, @ramp.end, @ramp.data
+@blip:
+.i32 @blip.data, @blip.end, 0
+@loud:
+.i32 @loud.data, @loud.end, @loud.data
+@quiet:
+.i32 @quiet.data, @quiet.end, @quiet.data
+// any 2KB of ROM, looping the second half
+@long:
+.i32 @ext.font, @ext.font + 2048, @ext.font + 1024
+@ramp.data:
+.i8 10, 20, 30, 40
+@ramp.end:
+@blip.data:
+.i8 -6, -6, -6, -6, -6, -6
+@blip.end:
+@loud.data:
+.i8 100, 100, 100, 100
+@loud.end:
+@quiet.data:
+.i8 -100, -100, -100, -100
+@quiet.end:
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.decompress',
+    desc: 'Decompress LZ77 and RLE data, and compare with the BIOS',
+    kind: 'run',
+    stdout: [
+      'lz77 to EWRAM: 23424 cycles, BIOS: 31930 cycles, match 1',
+      'lz77 to VRAM: 22760 cycles, BIOS: 29041 cycles, match 1',
+      'rle to EWRAM: 17946 cycles, BIOS: 26556 cycles, match 1',
+      'rle to VRAM: 21715 cycles, BIOS: 27580 cycles, match 1',
+      'odd: 01030201 12040302',
+      'odd: 02020201 12090202',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+
+// decompress 2KB with each routine, and the BIOS, checking the result and timing it
+ldr   r0, =0x02010000
+ldr   r1, =@lz
+str   r10, [r9]
+bl    @ext.lz77
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r0, =@lz
+ldr   r1, =0x02011000
+str   r10, [r9]
+swi   0x110000
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r0, =0x02010000
+ldr   r1, =0x02011000
+bl    @check
+_log  "lz77 to EWRAM: %d cycles, BIOS: %d cycles, match %d", r4, r5, r0
+
+ldr   r0, =0x06000000
+ldr   r1, =@lzv
+str   r10, [r9]
+bl    @ext.lz77_vram
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r0, =@lzv
+ldr   r1, =0x06001000
+str   r10, [r9]
+swi   0x120000
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r0, =0x06000000
+ldr   r1, =0x06001000
+bl    @check
+_log  "lz77 to VRAM: %d cycles, BIOS: %d cycles, match %d", r4, r5, r0
+
+ldr   r0, =0x02012000
+ldr   r1, =@rl
+str   r10, [r9]
+bl    @ext.rle
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r0, =@rl
+ldr   r1, =0x02013000
+str   r10, [r9]
+swi   0x140000
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r0, =0x02012000
+ldr   r1, =0x02013000
+bl    @check
+_log  "rle to EWRAM: %d cycles, BIOS: %d cycles, match %d", r4, r5, r0
+
+ldr   r0, =0x06002000
+ldr   r1, =@rl
+str   r10, [r9]
+bl    @ext.rle_vram
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r0, =@rl
+ldr   r1, =0x06003000
+str   r10, [r9]
+swi   0x150000
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r0, =0x06002000
+ldr   r1, =0x06003000
+bl    @check
+_log  "rle to VRAM: %d cycles, BIOS: %d cycles, match %d", r4, r5, r0
+
+// an odd size keeps the byte after it
+ldr   r0, =0x06004000
+ldr   r1, =0x12345678
+str   r1, [r0, #4]
+ldr   r1, =@odd
+bl    @ext.lz77_vram
+ldr   r0, =0x06004000
+ldr   r1, [r0]
+ldr   r2, [r0, #4]
+_log  "odd: %08x %08x", r1, r2
+ldr   r0, =0x06004000
+mov   r1, #0
+str   r1, [r0]
+ldr   r1, =@oddrl
+bl    @ext.rle_vram
+ldr   r0, =0x06004000
+ldr   r1, [r0]
+ldr   r2, [r0, #4]
+_log  "odd: %08x %08x", r1, r2
+_exit
+nop
+
+// r0, r1 = outputs to compare with @raw, returns r0 = 1 if they match
+@check:
+ldr   r2, =@raw
+mov   r3, #2048
+@@loop:
+ldrb  r12, [r2], #1
+ldrb  r7, [r0], #1
+cmp   r7, r12
+ldrb  r7, [r1], #1
+cmpeq r7, r12
+movne r0, #0
+bxne  lr
+subs  r3, r3, #1
+bne   @@loop
+mov   r0, #1
+bx    lr
+.pool
+
+.script
+  var raw = {}
+  for var i: range 2048
+    if i % 256 < 128
+      list.push raw, (num.floor i / 24) % 8
+    else
+      list.push raw, (num.floor i * 37 / 8) % 16
+    end
+  end
+  put '.align 4'
+  put '@raw:'
+  i8 raw
+  put '.align 4'
+  put '@lz:'
+  i8 lz77.compress raw
+  put '@lzv:'
+  i8 lz77.compress raw, 1
+  put '@rl:'
+  i8 rle.compress raw
+  put '@odd:'
+  i8 lz77.compress {1, 2, 3, 1, 2, 3, 4}, 1
+  put '@oddrl:'
+  i8 rle.compress {1, 2, 2, 2, 2, 2, 9}
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.thumb-call',
+    desc: 'Thumb code in ROM calls the IWRAM routines with bl',
+    kind: 'run',
+    stdout: ['100 / 7 = 14, remainder 2'],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+add   r0, pc, #1
+bx    r0
+.thumb
+movs  r0, #100
+movs  r1, #7
+bl    @ext.udiv
+_log  "100 / 7 = %d, remainder %d", r0, r1
+_exit
+nop
+.pool
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.math',
+    desc: 'Check division, square root, and reciprocal on samples, and compare with the BIOS',
+    kind: 'run',
+    stdout: [
+      'udiv: 0 wrong',
+      'sdiv: 0 wrong',
+      'isqrt: 0 wrong',
+      'recip16: 0 wrong',
+      'udiv 187 cycles, sdiv 210 cycles, BIOS Div 512 cycles',
+      '16-bit quotient: sdiv 165 cycles, BIOS Div 317 cycles',
+      'isqrt 117 cycles, BIOS Sqrt 224 cycles, recip16 214 cycles',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+
+// unsigned division, against results from the script
+ldr   r4, =@divs
+ldr   r5, [r4], #4
+mov   r6, #0
+@udiv:
+ldmia r4!, {r0, r1, r7, r8}
+bl    @ext.udiv
+cmp   r0, r7
+cmpeq r1, r8
+addne r6, r6, #1
+subs  r5, r5, #1
+bne   @udiv
+_log  "udiv: %d wrong", r6
+
+// signed division, against BIOS Div
+ldr   r4, =@divs
+ldr   r5, [r4], #4
+mov   r6, #0
+@sdiv:
+ldmia r4!, {r7, r8}
+add   r4, r4, #8
+mov   r0, r7
+mov   r1, r8
+bl    @ext.sdiv
+mov   r9, r0
+mov   r10, r1
+mov   r0, r7
+mov   r1, r8
+swi   0x060000
+cmp   r0, r9
+cmpeq r1, r10
+addne r6, r6, #1
+subs  r5, r5, #1
+bne   @sdiv
+_log  "sdiv: %d wrong", r6
+
+// square roots of every number up to 4096, and a sample of larger ones, against BIOS Sqrt
+mov   r4, #0
+mov   r6, #0
+@sqrtSmall:
+mov   r0, r4
+bl    @ext.isqrt
+mov   r7, r0
+mov   r0, r4
+swi   0x080000
+cmp   r0, r7
+addne r6, r6, #1
+add   r4, r4, #1
+cmp   r4, #0x1000
+blo   @sqrtSmall
+ldr   r4, =@sqrts
+ldr   r5, [r4], #4
+@sqrtLarge:
+ldr   r0, [r4]
+bl    @ext.isqrt
+mov   r7, r0
+ldr   r0, [r4], #4
+swi   0x080000
+cmp   r0, r7
+addne r6, r6, #1
+subs  r5, r5, #1
+bne   @sqrtLarge
+_log  "isqrt: %d wrong", r6
+
+// reciprocals, against results from the script
+ldr   r4, =@recips
+ldr   r5, [r4], #4
+mov   r6, #0
+@recip:
+ldmia r4!, {r0, r7}
+bl    @ext.recip16
+cmp   r0, r7
+addne r6, r6, #1
+subs  r5, r5, #1
+bne   @recip
+_log  "recip16: %d wrong", r6
+
+// worst cases, which have the most bits in the quotient (isqrt always takes the same time)
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+mvn   r0, #0
+mov   r1, #1
+str   r10, [r9]
+bl    @ext.udiv
+ldrh  r4, [r9]
+str   r11, [r9]
+mov   r0, #0x80000000
+mvn   r1, #0
+str   r10, [r9]
+bl    @ext.sdiv
+ldrh  r5, [r9]
+str   r11, [r9]
+mov   r0, #0x80000000
+mvn   r1, #0
+str   r10, [r9]
+swi   0x060000
+ldrh  r6, [r9]
+str   r11, [r9]
+_log  "udiv %d cycles, sdiv %d cycles, BIOS Div %d cycles", r4, r5, r6
+// and a typical case, with a 16-bit quotient
+ldr   r0, =-0x12345678
+ldr   r1, =0x1234
+str   r10, [r9]
+bl    @ext.sdiv
+ldrh  r5, [r9]
+str   r11, [r9]
+ldr   r0, =-0x12345678
+ldr   r1, =0x1234
+str   r10, [r9]
+swi   0x060000
+ldrh  r6, [r9]
+str   r11, [r9]
+_log  "16-bit quotient: sdiv %d cycles, BIOS Div %d cycles", r5, r6
+mvn   r0, #0
+str   r10, [r9]
+bl    @ext.isqrt
+ldrh  r4, [r9]
+str   r11, [r9]
+mvn   r0, #0
+str   r10, [r9]
+swi   0x080000
+ldrh  r5, [r9]
+str   r11, [r9]
+mov   r0, #2
+str   r10, [r9]
+bl    @ext.recip16
+ldrh  r6, [r9]
+str   r11, [r9]
+_log  "isqrt %d cycles, BIOS Sqrt %d cycles, recip16 %d cycles", r4, r5, r6
+_exit
+nop
+.pool
+
+.script
+  rand.seed 1
+  // numbers of every size, so quotients have every number of bits
+  def sized
+    return int.shr rand.int, rand.range 32
+  end
+
+  // count, then numerator, denominator, quotient, remainder
+  var divs = {{0, 1}, {1, 1}, {0xffffffff, 1}, {0xffffffff, 0xffffffff}, {0x80000000, 0xffffffff},
+    {0x7fffffff, 0x80000000}, {5, 0xfffffffb}, {0xfffffff6, 3}}
+  for var j: range 2000
+    var d = sized
+    if d == 0
+      d = 1
+    end
+    list.push divs, {rand.int, d}
+  end
+  put '@divs:'
+  i32 &divs
+  for var nd: divs
+    var {n, d} = nd
+    i32 n, d, (num.floor n / d), n % d
+  end
+
+  // count, then values
+  put '@sqrts:'
+  var sqrts = {0xffffffff, 0xfffe0001, 0xfffe0000, 0x80000000, 0x7fffffff}
+  for var j: range 500
+    // either side of a square, where a bit in the root changes
+    var k = rand.range 0x10000
+    list.push sqrts, k * k
+    list.push sqrts, k * k - 1
+    list.push sqrts, sized
+  end
+  i32 &sqrts
+  i32 sqrts
+
+  // count, then value, and 2^32 / value rounded towards zero, saturated
+  var recips = {0, 1, -1, 2, -2, 3, 0x10000, -0x10000, 0x7fffffff, -0x7fffffff, -0x80000000}
+  for var j: range 2000
+    // 31 bits, so it can be negated
+    var x = int.shr sized, 1
+    if rand.int < 0x80000000
+      x = -x
+    end
+    list.push recips, x
+  end
+  put '@recips:'
+  i32 &recips
+  for var x: recips
+    var r = 0x7fffffff
+    if x != 0
+      r = num.min 0x7fffffff, (num.floor 4294967296 / num.abs x)
+    end
+    if x < 0
+      r = -r
+    end
+    i32 x, r
+  end
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.text',
+    desc: 'Print strings and numbers with the font, and check the glyph cache',
+    kind: 'run',
+    stdout: [
+      'map: 00110010 00000012 00000000 / 00100010 00000013 00000000',
+      'used: 4',
+      'H: 2ff222ff 2ff222ff 2ff222ff 2fffffff 2ff222ff 2ff222ff 2ff222ff 22222222',
+      'hex: 30143014 30163015 30173016',
+      'uint: 30193018 3018301a 301b301a 3019301c 301d301a / 3014',
+      'used: 14',
+      '30 characters: 6479 cycles expanding, 839 cycles cached',
+      'text_uint 498 cycles, text_hex 378 cycles',
+    ],
+    files: {
+      '/root/main': `
+b     @main
+.extlib
+@main:
+bl    @ext.init
+
+// glyph tiles start at tile 16 of character block 1, and the map is screen block 31
+ldr   r0, =0x06004200
+mov   r1, #16
+ldr   r2, =0x0600f800
+mov   r3, #0x2f
+bl    @ext.text_init
+ldr   r0, =@hello
+mov   r1, #2
+mov   r2, #2
+bl    @ext.text_print
+ldr   r4, =0x0600f800 + (2 * 32 + 2) * 2
+ldmia r4, {r5-r7}
+ldr   r4, =0x0600f800 + (3 * 32 + 2) * 2
+ldmia r4, {r8-r10}
+_log  "map: %08x %08x %08x / %08x %08x %08x", r5, r6, r7, r8, r9, r10
+ldr   r4, =$ext.text.used
+ldr   r4, [r4]
+_log  "used: %d", r4
+
+// 'H' is tile 16 with ink 15 and paper 2
+ldr   r4, =0x06004200
+ldmia r4, {r5-r12}
+_log  "H: %08x %08x %08x %08x %08x %08x %08x %08x", r5, r6, r7, r8, r9, r10, r11, r12
+
+// numbers, in palette bank 3
+mov   r0, #3
+bl    @ext.text_palette
+ldr   r0, =0xbeef
+mov   r1, #0
+mov   r2, #5
+mov   r3, #6
+bl    @ext.text_hex
+mvn   r0, #0
+mov   r1, #0
+mov   r2, #6
+bl    @ext.text_uint
+mov   r0, #0
+mov   r1, #0
+mov   r2, #7
+bl    @ext.text_uint
+ldr   r4, =0x0600f800 + 5 * 32 * 2
+ldmia r4, {r5-r7}
+ldr   r4, =0x0600f800 + 6 * 32 * 2
+ldmia r4, {r8-r12}
+ldr   r4, =0x0600f800 + 7 * 32 * 2
+ldrh  r4, [r4]
+_log  "hex: %08x %08x %08x", r5, r6, r7
+_log  "uint: %08x %08x %08x %08x %08x / %04x", r8, r9, r10, r11, r12, r4
+ldr   r4, =$ext.text.used
+ldr   r4, [r4]
+_log  "used: %d", r4
+
+// a line of 30 new characters, then the same line again from the cache
+ldr   r9, =0x04000100
+mov   r10, #0x00800000
+mov   r11, #0
+ldr   r0, =@line
+mov   r1, #0
+mov   r2, #10
+str   r10, [r9]
+bl    @ext.text_print
+ldrh  r4, [r9]
+str   r11, [r9]
+ldr   r0, =@line
+mov   r1, #0
+mov   r2, #11
+str   r10, [r9]
+bl    @ext.text_print
+ldrh  r5, [r9]
+str   r11, [r9]
+mvn   r0, #0
+mov   r1, #0
+mov   r2, #12
+str   r10, [r9]
+bl    @ext.text_uint
+ldrh  r6, [r9]
+str   r11, [r9]
+mvn   r0, #0
+mov   r1, #0
+mov   r2, #13
+mov   r3, #8
+str   r10, [r9]
+bl    @ext.text_hex
+ldrh  r7, [r9]
+str   r11, [r9]
+_log  "30 characters: %d cycles expanding, %d cycles cached", r4, r5
+_log  "text_uint %d cycles, text_hex %d cycles", r6, r7
+_exit
+nop
+.pool
+
+@hello:
+.i8 "Hi!\\nHH"
+.i8 0xff, 0
+@line:
+.i8 "ABCDEFGIJKLMNOPQRSTUVWXYZ<>[]{\\0"
+`,
+    },
+  });
+
+  def({
+    name: 'extlib.prof',
+    desc: 'Time zones with the cascaded timers, and print the results',
+    kind: 'run',
+    stdout: [
+      'empty: 114 cycles, 1 calls',
+      'loop: 52212 cycles, 2 calls',
+      'outer: 52596 cycles, 1 calls',
+      'long: 0 2600115 0 cycles, 0 1 0 calls',
+      'many: 32 calls, 16 overflow',
+      'overlay: 00010000 00030002 00000004 00070006 00090008 00050005',
+      'overlay: 000d000b 00000003 0000000e 0005000c 00050005 00050005',
+    ],
+    files: {
+      '/root/main': `
+.script
+  store.set 'ext.prof.zones', {'empty', 'loop', 'outer'}
+.end
+b     @main
+.extlib
+@main:
+bl    @ext.init
+bl    @ext.prof_start
+
+// an empty zone measures the overhead of profiling
+mov   r0, #$ext.zone.empty
+bl    @ext.prof_begin
+mov   r0, #$ext.zone.empty
+bl    @ext.prof_end
+
+// a loop of 1000 iterations, twice, inside another zone
+mov   r0, #$ext.zone.outer
+bl    @ext.prof_begin
+mov   r4, #2
+@again:
+mov   r0, #$ext.zone.loop
+bl    @ext.prof_begin
+mov   r0, #1000
+@loop:
+subs  r0, r0, #1
+bne   @loop
+mov   r0, #$ext.zone.loop
+bl    @ext.prof_end
+subs  r4, r4, #1
+bne   @again
+mov   r0, #$ext.zone.outer
+bl    @ext.prof_end
+
+// an end without a beginning is ignored
+mov   r0, #$ext.zone.empty
+bl    @ext.prof_end
+
+bl    @ext.prof_frame
+ldr   r4, =$ext.prof.cycles
+ldmia r4, {r5-r7}
+ldr   r4, =$ext.prof.calls
+ldmia r4, {r8-r10}
+_log  "empty: %d cycles, %d calls", r5, r8
+_log  "loop: %d cycles, %d calls", r6, r9
+_log  "outer: %d cycles, %d calls", r7, r10
+
+// a zone that takes more than 65536 cycles, so Timer 3 counts
+mov   r0, #$ext.zone.loop
+bl    @ext.prof_begin
+ldr   r0, =100000
+@long:
+subs  r0, r0, #1
+bne   @long
+mov   r0, #$ext.zone.loop
+bl    @ext.prof_end
+bl    @ext.prof_frame
+ldr   r4, =$ext.prof.cycles
+ldmia r4, {r5-r7}
+ldr   r4, =$ext.prof.calls
+ldmia r4, {r8-r10}
+_log  "long: %d %d %d cycles, %d %d %d calls", r5, r6, r7, r8, r9, r10
+
+// more entries than the ring holds
+mov   r4, #40
+@many:
+mov   r0, #$ext.zone.empty
+bl    @ext.prof_begin
+mov   r0, #$ext.zone.empty
+bl    @ext.prof_end
+subs  r4, r4, #1
+bne   @many
+bl    @ext.prof_frame
+ldr   r4, =$ext.prof.calls
+ldr   r5, [r4]
+ldr   r4, =$ext.prof.overflow
+ldr   r6, [r4]
+_log  "many: %d calls, %d overflow", r5, r6
+
+// the overlay
+ldr   r0, =0x06004000
+mov   r1, #0
+ldr   r2, =0x0600f800
+mov   r3, #0x01
+bl    @ext.text_init
+mov   r0, #0
+mov   r1, #1
+bl    @ext.prof_draw
+ldr   r4, =0x0600f800 + 32 * 2
+ldmia r4, {r5-r10}
+_log  "overlay: %08x %08x %08x %08x %08x %08x", r5, r6, r7, r8, r9, r10
+ldr   r4, =0x0600f800 + 3 * 32 * 2
+ldmia r4, {r5-r10}
+_log  "overlay: %08x %08x %08x %08x %08x %08x", r5, r6, r7, r8, r9, r10
+_exit
+nop
+.pool
+`,
+    },
+  });
+}
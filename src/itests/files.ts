@@ -128,6 +128,35 @@ export function load(def: (test: ITest) => void) {
     },
   });
 
+  def({
+    name: 'files.include-tree',
+    desc: 'Include a tree of files with lines that depend on the lines before them',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.i32 0             /// 00 00 00 00
+.include "a"
+/// 01 00 00 00
+/// 02 00 00 00 03 00 00 00
+/// 04 00 00 00
+.include "sub/b"   /// 02 00 00 00 03 00 00 00
+.script
+put '.i32 5'       /// 05 00 00 00
+.end
+.i32 -1            /// ff ff ff ff
+`,
+      '/root/a': `
+/* comment
+spanning lines */ .i32 1
+.include "sub/b"
+.include "sub/c"
+`,
+      '/root/sub/b': `.i32 2, \\
+  3`,
+      '/root/sub/c': `.i32 4`,
+    },
+  });
+
   def({
     name: 'files.embed-basic',
     desc: 'Embed another file',
@@ -272,6 +272,199 @@ ldr r2, =12345
 .i32 0
 .i8 0
 .pool
+`,
+    },
+  });
+
+  def({
+    name: 'pool.arm.veneer',
+    desc: 'ARM branches out of range go through a shared veneer',
+    kind: 'make',
+    stdout: ['Created 1 branch veneer'],
+    files: {
+      '/root/main': `
+bl @iwram     /// 00 00 00 eb
+bl @iwram     /// ff ff ff eb
+.pool         /// 00 c0 9f e5 1c ff 2f e1 00 00 00 03
+.base 0x03000000
+@iwram:
+bx lr         /// 1e ff 2f e1
+`,
+    },
+  });
+
+  def({
+    name: 'pool.thumb.veneer',
+    desc: 'Thumb bl out of range goes through an interworking veneer',
+    kind: 'make',
+    stdout: ['Created 1 branch veneer'],
+    files: {
+      '/root/main': `.thumb
+bl @iwram     /// 00 f0 00 f8
+.pool         /// 78 47 c0 46 00 c0 9f e5 1c ff 2f e1 01 00 00 03
+.base 0x03000000
+@iwram:
+bx lr         /// 70 47
+`,
+    },
+  });
+
+  def({
+    name: 'pool.thumb.veneer-arm',
+    desc: 'Thumb bl out of range to ARM code switches to ARM in the veneer',
+    kind: 'make',
+    stdout: ['Created 1 branch veneer'],
+    files: {
+      '/root/main': `.thumb
+bl @iwram     /// 00 f0 00 f8
+.pool         /// 78 47 c0 46 00 c0 9f e5 1c ff 2f e1 00 00 00 03
+.base 0x03000000
+.arm
+@iwram:
+bx lr         /// 1e ff 2f e1
+`,
+    },
+  });
+
+  def({
+    name: 'pool.arm.veneer-thumb',
+    desc: 'ARM bl out of range to Thumb code switches to Thumb in the veneer',
+    kind: 'make',
+    stdout: ['Created 1 branch veneer'],
+    files: {
+      '/root/main': `
+bl @iwram     /// ff ff ff eb
+.pool         /// 00 c0 9f e5 1c ff 2f e1 01 00 00 03
+.base 0x03000000
+.thumb
+@iwram:
+bx lr         /// 70 47
+`,
+    },
+  });
+
+  def({
+    name: 'pool.thumb.veneer-forward',
+    desc: 'Veneer mode is known once a forward label is defined',
+    kind: 'make',
+    stdout: ['Created 2 branch veneers'],
+    files: {
+      '/root/main': `.thumb
+bl @arm       /// 00 f0 02 f8
+bl @thumb     /// 00 f0 08 f8
+.pool         /// 78 47 c0 46 00 c0 9f e5 1c ff 2f e1 00 00 00 03
+              /// 78 47 c0 46 00 c0 9f e5 1c ff 2f e1 05 00 00 03
+.base 0x03000000
+.arm
+@arm:
+bx lr         /// 1e ff 2f e1
+.thumb
+@thumb:
+bx lr         /// 70 47
+`,
+    },
+  });
+
+  def({
+    name: 'pool.veneer-missing',
+    desc: 'Error if a veneer is required but .pool is missing',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+bl @iwram
+.base 0x03000000
+@iwram:
+bx lr
+`,
+    },
+  });
+
+  def({
+    name: 'pool.auto.transfer',
+    desc: 'Automatic pools are written after unconditional control transfers',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.pool auto
+ldr r0, =0x12345678  /// 00 00 9f e5
+pop {pc}             /// 00 80 bd e8
+                     /// 78 56 34 12
+.thumb
+ldr r0, =0x12345678  /// 00 48
+bx lr                /// 70 47
+                     /// 78 56 34 12
+ldr r1, =0x12345678  /// 00 49
+movs r0, #0          /// 00 20
+                     /// 78 56 34 12
+`,
+    },
+  });
+
+  def({
+    name: 'pool.auto.branch-around',
+    desc: 'Automatic pools branch around the pool when there is no natural point',
+    kind: 'make',
+    files: {
+      '/root/main': `.thumb
+.pool auto
+ldr r0, =0x12345678  /// fb 48
+.i16fill 502         /// ${'00 '.repeat(1004)}
+                     /// 01 e0 78 56 34 12
+movs r1, #1          /// 01 21
+`,
+    },
+  });
+
+  def({
+    name: 'pool.auto.data',
+    desc: 'Automatic pools are written before data that would push them out of reach',
+    kind: 'make',
+    files: {
+      '/root/main': `.thumb
+.pool auto
+ldr r0, =0x12345678  /// 00 48
+                     /// 01 e0 78 56 34 12
+// the label points at the data, after the pool
+@table:
+.i8fill 1100, 0xaa   /// ${'aa '.repeat(1100)}
+.i32 @table          /// 08 00 00 08
+`,
+    },
+  });
+
+  def({
+    name: 'pool.auto.jump-table',
+    desc: 'Automatic pools aren\'t written between a computed jump and its table',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.pool auto
+ldr r0, =0x12345678     /// 0c 00 9f e5
+add pc, pc, r1, lsl #2  /// 01 f1 8f e0
+.i32 1, 2               /// 01 00 00 00 02 00 00 00
+bx lr                   /// 1e ff 2f e1
+                        /// 78 56 34 12
+`,
+    },
+  });
+
+  def({
+    name: 'pool.auto.scoped',
+    desc: 'Automatic pools end with their .begin block',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.begin
+  .pool auto
+  ldr r0, =0x12345678   /// 04 00 9f e5
+  nop                   /// 00 00 a0 e1
+                        /// 00 00 00 ea 78 56 34 12
+.end
+ldr r1, =0x11111111     /// 04 10 9f e5
+bx lr                   /// 1e ff 2f e1
+.i32 5                  /// 05 00 00 00
+.pool                   /// 11 11 11 11
 `,
     },
   });
@@ -105,6 +105,295 @@ blt   @again2
 _log  "done"
 _exit
 _log  "shouldn't run"
+`,
+    },
+  });
+
+  def({
+    name: 'run.save.flash',
+    desc: 'Flash save memory ID and byte program',
+    kind: 'run',
+    stdout: [
+      'id = c2 09',
+      'data = 5a',
+      'Save memory (flash128):',
+      '  byte program: 1, worst 354 cycles (0.02ms)',
+    ],
+    files: {
+      '/root/main': `
+.thumb
+ldr   r0, =0x0e005555
+ldr   r1, =0x0e002aaa
+ldr   r5, =0x0e000000
+movs  r2, #0xaa
+movs  r3, #0x55
+
+// read ID
+strb  r2, [r0]
+strb  r3, [r1]
+movs  r4, #0x90
+strb  r4, [r0]
+ldrb  r6, [r5]
+ldrb  r7, [r5, #1]
+_log  "id = %02x %02x", r6, r7
+strb  r2, [r0]
+strb  r3, [r1]
+movs  r4, #0xf0
+strb  r4, [r0]
+
+// program a byte, and wait for it to finish
+strb  r2, [r0]
+strb  r3, [r1]
+movs  r4, #0xa0
+strb  r4, [r0]
+movs  r4, #0x5a
+strb  r4, [r5, #0x10]
+@wait:
+ldrb  r6, [r5, #0x10]
+cmp   r6, #0x5a
+bne   @wait
+_log  "data = %02x", r6
+_exit
+.pool
+.align 4
+.i8   "FLASH1M_V103"
+`,
+    },
+  });
+
+  def({
+    name: 'run.save.eeprom',
+    desc: 'EEPROM save memory write and read using DMA3',
+    kind: 'run',
+    stdout: [
+      '10100101',
+      'Save memory (eeprom):',
+      '  block write: 1, worst 108374 cycles (6.46ms)',
+      '  block read: 1',
+    ],
+    files: {
+      '/root/main': `
+.thumb
+// write request
+ldr   r0, =0x040000d4
+ldr   r1, =@write
+str   r1, [r0]
+ldr   r1, =0x0d000000
+str   r1, [r0, #4]
+ldr   r1, =0x80000049
+str   r1, [r0, #8]
+ldr   r2, =0x0d000000
+@wait:
+ldrh  r3, [r2]
+cmp   r3, #1
+bne   @wait
+
+// read request, then read the reply into EWRAM
+ldr   r1, =@read
+str   r1, [r0]
+ldr   r1, =0x0d000000
+str   r1, [r0, #4]
+ldr   r1, =0x80000009
+str   r1, [r0, #8]
+ldr   r1, =0x0d000000
+str   r1, [r0]
+ldr   r1, =0x02000000
+str   r1, [r0, #4]
+ldr   r1, =0x80000044
+str   r1, [r0, #8]
+_log  "%d%d%d%d%d%d%d%d", i16[0x02000008], i16[0x0200000a], i16[0x0200000c], \
+  i16[0x0200000e], i16[0x02000010], i16[0x02000012], i16[0x02000014], i16[0x02000016]
+_exit
+.pool
+.align 4
+@write:
+.i16  1, 0, 0, 0, 0, 0, 0, 1 // write, address 1
+.i16  1, 0, 1, 0, 0, 1, 0, 1 // 0xa5
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0, 0, 0, 0, 0, 0, 0, 0
+.i16  0
+@read:
+.i16  1, 1, 0, 0, 0, 0, 0, 1, 0 // read, address 1
+.align 4
+.i8   "EEPROM_V124"
+`,
+    },
+  });
+
+  def({
+    name: 'run.bios.lz77',
+    desc: 'Decompress lz77.compress output with the BIOS, to EWRAM and VRAM',
+    kind: 'run',
+    stdout: [
+      'case 0: wram 1, vram 1',
+      'case 1: wram 1, vram 1',
+      'case 2: wram 1, vram 1',
+      'case 3: wram 1, vram 1',
+      'case 4: wram 1, vram 1',
+      'case 5: wram 1, vram 1',
+    ],
+    files: {
+      '/root/main': `
+ldr   r8, =@cases
+mov   r9, #0
+@next:
+ldmia r8!, {r4-r7}
+cmp   r4, #0
+beq   @done
+ldr   r1, =0x02010000
+mov   r0, r6
+swi   0x110000
+ldr   r0, =0x02010000
+mov   r1, r4
+mov   r2, r5
+bl    @check
+mov   r10, r0
+ldr   r1, =0x06000000
+mov   r0, r7
+swi   0x120000
+// VRAM is written a halfword at a time, so an odd last byte is dropped
+ldr   r0, =0x06000000
+mov   r1, r4
+bic   r2, r5, #1
+bl    @check
+_log  "case %d: wram %d, vram %d", r9, r10, r0
+add   r9, r9, #1
+b     @next
+@done:
+_exit
+nop
+
+// r0, r1 = buffers to compare, r2 = length, returns r0 = 1 if they match
+@check:
+subs  r2, r2, #1
+movmi r0, #1
+bxmi  lr
+ldrb  r3, [r0], #1
+ldrb  r12, [r1], #1
+cmp   r3, r12
+beq   @check
+mov   r0, #0
+bx    lr
+.pool
+
+.script
+  var seed = 1
+  def random
+    seed = (seed * 75 + 74) % 65537
+    return seed % 256
+  end
+  var cases = {}
+  // short
+  list.push cases, {7}
+  // a run, which needs a distance of 1 in EWRAM
+  list.push cases, (list.new 300, 5)
+  // short repeating pattern, with an odd length
+  var pattern = {}
+  for var i: range 201
+    list.push pattern, i % 3
+  end
+  list.push cases, pattern
+  // mostly literals
+  var noise = {}
+  for var i: range 1000
+    list.push noise, random
+  end
+  list.push cases, noise
+  // a match at the far end of the window
+  var far = {}
+  for var i: range 50
+    list.push far, random
+  end
+  for var i: range 4046
+    list.push far, 0
+  end
+  for var i: range 50
+    list.push far, far[i]
+  end
+  list.push cases, far
+  // longest matches, mixed with literals
+  var mixed = {}
+  for var i: range 2000
+    if i % 100 < 60
+      list.push mixed, i % 20
+    else
+      list.push mixed, random
+    end
+  end
+  list.push cases, mixed
+
+  put '.align 4'
+  put '@cases:'
+  for var c, i: cases
+    put '.i32 @raw' ~ i ~ ', ' ~ &c ~ ', @lz' ~ i ~ ', @lzv' ~ i
+  end
+  put '.i32 0, 0, 0, 0'
+  for var c, i: cases
+    put '@raw' ~ i ~ ':'
+    i8 c
+    put '.align 4'
+    put '@lz' ~ i ~ ':'
+    i8 lz77.compress c
+    put '@lzv' ~ i ~ ':'
+    i8 lz77.compress c, 1
+  end
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'run.perf-lint.arm',
+    desc: 'Performance lint flags ARM code in ROM',
+    kind: 'run',
+    perfLint: true,
+    stdout: [
+      'Performance lint:',
+      '  /root/main:2: ARM code running from 16-bit ROM, use Thumb or copy it to IWRAM (1 time)',
+      '  /root/main:3: ARM code running from 16-bit ROM, use Thumb or copy it to IWRAM (1 time)',
+    ],
+    files: {
+      '/root/main': `
+movs  r0, #1
+subs  r0, #1
+_exit
+`,
+    },
+  });
+
+  def({
+    name: 'run.perf-lint.thumb',
+    desc: 'Performance lint flags slow memory access',
+    kind: 'run',
+    perfLint: true,
+    stdout: [
+      'Performance lint:',
+      '  /root/main:6: Loop reads a constant from ROM, keep it in a register or IWRAM (20 times)',
+      '  /root/main:7: 8-bit write to VRAM/OAM, which hardware ignores or writes to both bytes (20 times)',
+      '  /root/main:11: Unaligned 32-bit load (1 time)',
+      '  /root/main:13: ldm/stm crosses a memory region boundary (1 time)',
+    ],
+    files: {
+      '/root/main': `
+.thumb
+ldr   r0, =0x06000000
+movs  r1, #20
+@loop:
+ldr   r2, =0x12345678
+strb  r2, [r0]
+subs  r1, #1
+bne   @loop
+ldr   r3, =0x03000002
+ldr   r4, [r3]
+ldr   r3, =0x02fffff8
+ldmia r3!, {r4, r5, r6}
+_exit
+.pool
 `,
     },
   });
@@ -195,6 +195,342 @@ include "../one.sink" /// 01 02
     },
   });
 
+  def({
+    name: 'script.file.read',
+    desc: 'Read binary files into buffers',
+    kind: 'make',
+    stdout: [
+      '6',
+      '4',
+      '{3, 4}',
+      '-1',
+      '513',
+      '258',
+      '0xFFFE0403',
+      '-130045',
+      '{254, 255}',
+    ],
+    files: {
+      '/root/main': `
+.script
+  var buf = file.read './data.bin'
+  say buffer.size buf
+  say buffer.size file.read './data.bin', 2
+  say buffer.list file.read './data.bin', 2, 2
+  say buffer.s8 buf, 5
+  say buffer.u16 buf, 0
+  say buffer.ub16 buf, 0
+  say num.hex (buffer.u32 buf, 2), 8
+  say buffer.s32 buf, 2
+  i8 buf                                  /// 01 02 03 04 fe ff
+  i8 5, (buffer.slice buf, 1, 2), 6       /// 05 02 03 06
+  say str.list buffer.str buffer.slice buf, 4
+.end
+`,
+      '/root/data.bin': '/// 01 02 03 04 fe ff',
+    },
+  });
+
+  def({
+    name: 'script.file.read-image',
+    desc: 'Load images directly from buffers',
+    kind: 'make',
+    stdout: [
+      '{{{0, 0, 0, 255}, {255, 255, 255, 255}, {0, 0, 0, 0}}, ' +
+      '{{255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}}, ' +
+      '{{69, 103, 137, 255}, {76, 59, 42, 127}, {0, 0, 0, 1}}}',
+    ],
+    files: {
+      '/root/main': `
+.script
+  say image.load file.read './img.png'
+.end
+`,
+      '/root/img.png': `
+/// 89 50 4e 47 0d 0a 1a 0a 00 00 00 0d 49 48 44 52
+/// 00 00 00 03 00 00 00 03 08 06 00 00 00 56 28 b5
+/// bf 00 00 00 2d 49 44 41 54 08 99 05 c1 41 01 40
+/// 00 14 40 b1 7d 0d 64 91 41 03 32 68 e0 ea ac 81
+/// b6 cf 06 55 c1 12 c6 a0 ec d7 db 77 1f cf b9 ad
+/// f3 03 ff 1f 0c ac 55 57 90 28 00 00 00 00 49 45
+/// 4e 44 ae 42 60 82
+`,
+    },
+  });
+
+  def({
+    name: 'script.file.read-fail',
+    desc: 'Fail to read past the end of a file',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+.script
+  file.read './data.bin', 2, 10
+.end
+`,
+      '/root/data.bin': '/// 01 02 03 04',
+    },
+  });
+
+  def({
+    name: 'script.file.read-i16-fail',
+    desc: 'Buffers can only be written with i8',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+.script
+  var b = file.read './data.bin'
+  i16 b
+.end
+`,
+      '/root/data.bin': '/// 01 02 03 04',
+    },
+  });
+
+  def({
+    name: 'script.bits',
+    desc: 'Pack and unpack bitstreams',
+    kind: 'make',
+    stdout: ['10', '5', '3', '-1', '6', '5', '127', '0xDEADBEEF'],
+    files: {
+      '/root/main': `
+.script
+  var w = bits.writer
+  bits.write w, 5, 3
+  bits.write w, 3, 2
+  bits.write w, 0x1f, 5
+  say bits.size w
+  i8 w                             /// fd 03
+  bits.align w
+  bits.write w, 0x1234, 16
+  i8 bits.buffer w                 /// fd 03 34 12
+  var m = bits.writer bits.MSB
+  bits.write m, 5, 3
+  bits.write m, 3, 2
+  bits.write m, 0x1f, 5
+  i8 m                             /// bf c0
+  bits.align m, 4
+  bits.write m, 0xdeadbeef, 32
+  i8 bits.buffer m                 /// bf c0 00 00 de ad be ef
+
+  var r = bits.reader {0xfd, 0x03}
+  say bits.read r, 3
+  say bits.read r, 2
+  say bits.sread r, 5
+  say bits.left r
+  r = bits.reader (bits.buffer m), bits.MSB
+  say bits.read r, 3
+  say bits.read r, 7
+  bits.align r, 4
+  say num.hex (bits.read r, 32), 8
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'script.bits-fail',
+    desc: 'Fail to read past the end of a bitstream',
+    kind: 'make',
+    error: true,
+    files: {
+      '/root/main': `
+.script
+  var r = bits.reader {0xff}
+  bits.read r, 9
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'script.audio',
+    desc: 'Convert WAV files to signed 8-bit PCM',
+    kind: 'make',
+    stdout: ['8000', '4', '1', 'nil', '2', '8', '{4, 16}', '16'],
+    files: {
+      '/root/main': `
+.script
+  var snd = audio.load file.read './snd.wav'
+  say audio.rate snd
+  say audio.length snd
+  say audio.channels snd
+  say audio.loop snd
+  say audio.length audio.resample snd, 4000
+  say audio.length audio.resample snd, 16000
+  i8 audio.s8 snd                         /// 00 40 c0 7f
+  snd = audio.align (audio.setloop snd, 1, 4), 4
+  say audio.loop snd
+  say audio.length snd
+  i8 audio.s8 snd                         /// 00 00 00 00 40 c0 7f 40 c0 7f 40 c0 7f 40 c0 7f
+.end
+`,
+      '/root/snd.wav': `
+/// 52 49 46 46 2c 00 00 00 57 41 56 45
+/// 66 6d 74 20 10 00 00 00 01 00 01 00 40 1f 00 00 80 3e 00 00 02 00 10 00
+/// 64 61 74 61 08 00 00 00 00 00 00 40 00 c0 ff 7f
+`,
+    },
+  });
+
+  def({
+    name: 'script.audio-resample-loop',
+    desc: 'Resample a loop that runs to the end by a non-integer ratio, then align it',
+    kind: 'make',
+    stdout: ['{1, 4}', '4', '{4, 16}', '16'],
+    files: {
+      '/root/main': `
+.script
+  var snd = audio.setloop (audio.load file.read './snd.wav'), 1, 4
+  snd = audio.resample snd, 9000
+  say audio.loop snd
+  say audio.length snd
+  snd = audio.align snd, 4
+  say audio.loop snd
+  say audio.length snd
+  // the loop body repeats with no silence in it
+  i8 audio.s8 snd                         /// 00 00 00 09 40 cf 30 40 cf 30 40 cf 30 40 cf 30
+.end
+`,
+      '/root/snd.wav': `
+/// 52 49 46 46 2c 00 00 00 57 41 56 45
+/// 66 6d 74 20 10 00 00 00 01 00 01 00 40 1f 00 00 80 3e 00 00 02 00 10 00
+/// 64 61 74 61 08 00 00 00 00 00 00 40 00 c0 ff 7f
+`,
+    },
+  });
+
+  def({
+    name: 'script.audio-resample-loop-short',
+    desc: 'A short loop near the end keeps at least one sample after resampling',
+    kind: 'make',
+    stdout: ['{3, 4}', '{1, 2}', '2', '{1, 2}'],
+    files: {
+      '/root/main': `
+.script
+  var snd = audio.setloop (audio.load file.read './snd.wav'), 3, 4
+  say audio.loop snd
+  snd = audio.resample snd, 4000
+  say audio.loop snd
+  say audio.length snd
+  say audio.loop audio.align snd, 1
+.end
+`,
+      '/root/snd.wav': `
+/// 52 49 46 46 2c 00 00 00 57 41 56 45
+/// 66 6d 74 20 10 00 00 00 01 00 01 00 40 1f 00 00 80 3e 00 00 02 00 10 00
+/// 64 61 74 61 08 00 00 00 00 00 00 40 00 c0 ff 7f
+`,
+    },
+  });
+
+  def({
+    name: 'script.sprite',
+    desc: 'Pack sprite frames into OBJ tiles',
+    kind: 'make',
+    stdout: [
+      '{{0, 1}, {1, 0}}',
+      '{{{0, 0, 1, 0, 0}}, {{0, 0, 1, 0, 0}}, {{9, 9, 0, 0, 2}}}',
+    ],
+    files: {
+      '/root/main': `
+.script
+  var img = {{{0, 0, 0, 0}, {255, 0, 0, 255}}, {{255, 0, 0, 255}, {0, 0, 0, 0}}}
+  say sprite.indexed img, {0, {255, 0, 0}}
+  var f1 = {}
+  for: range 8
+    list.push f1, (list.new 16, 1)
+  end
+  var f3 = {}
+  for: range 16
+    list.push f3, (list.new 16, 0)
+  end
+  f3[9][9] = 2
+  var pk = sprite.pack {f1, f1, f3}
+  say pk[1]
+  i8 pk[0]
+  /// 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11
+  /// 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11
+  /// 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11
+  /// 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11 11
+  /// 02 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+  /// 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'script.strtab',
+    desc: 'Build string tables',
+    kind: 'make',
+    stdout: [
+      '{0, 6, 2, 12, 4}',
+      '1',
+      '{116, 104, 101, 32}',
+      '{128, 101, 110, 100}',
+      '{0, 5}',
+    ],
+    files: {
+      '/root/main': `
+.script
+  var {data, offsets} = strtab.pack {'hello', 'jello', 'llo', 'world', 'o'}
+  say offsets
+  i8 data /// 68 65 6c 6c 6f 00 6a 65 6c 6c 6f 00 77 6f 72 6c 64 00
+  var {entries, strings} = strtab.dict {'the cat', 'the dog', 'the end'}, 1
+  say &entries
+  say buffer.list entries[0]
+  say buffer.list strings[2]
+  var {tree, hdata, ofs} = strtab.huffman {'ab', 'a'}
+  say ofs
+  i8 tree /// 61 80 01 00 62 80 00 80
+  i8 hdata /// da
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'script.strtab-utf8',
+    desc: 'Store non-ASCII strings in string tables as UTF-8, like i8',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.script
+  i8 'é日'                                /// c3 a9 e6 97 a5
+  var {data, offsets} = strtab.pack {'日本', 'é'}
+  i8 data                                 /// e6 97 a5 e6 9c ac 00 c3 a9 00
+  // dictionary codes stay single bytes
+  var {entries, strings} = strtab.dict {'日本 日本', '日本!'}, 1
+  i8 entries[0]                           /// e6 97 a5 e6 9c ac
+  i8 strings[0]                           /// 80 20 80
+  i8 strings[1]                           /// 80 21
+.end
+`,
+    },
+  });
+
+  def({
+    name: 'script.compress',
+    desc: 'Compress data for the BIOS',
+    kind: 'make',
+    files: {
+      '/root/main': `
+.script
+  i8 rle.compress 'aaaaabcd'      /// 30 08 00 00 82 61 02 62 63 64 00 00
+  i8 lz77.compress 'abcabcabc'    /// 10 09 00 00 10 61 62 63 30 02 00 00
+  i8 lz77.compress 'aaaa'         /// 10 04 00 00 40 61 00 00
+  // VRAM can't copy from the previous byte
+  i8 lz77.compress 'aaaa', 1      /// 10 04 00 00 00 61 61 61 61 00 00 00
+  // byte strings, like embedded files, are one byte per character
+  i8 rle.compress list.str {0x89, 0x89, 0x89, 0xff} /// 30 04 00 00 80 89 00 ff
+.end
+`,
+    },
+  });
+
   def({
     name: 'script.large-put',
     desc: 'Support a lot of puts',
@@ -505,6 +505,25 @@ bl @bot     /// 00 f0 06 f8
 .i16fill 6  /// 00 00 00 00 00 00 00 00 00 00 00 00
 @bot:
 bl lr       /// 00 f8
+`,
+    },
+  });
+
+  def({
+    name: 'thumb.relax',
+    desc: 'Relaxed conditional branches use the long form only when needed',
+    kind: 'make',
+    stdout: ['Relaxed 1 of 2 branches, saving 2 bytes'],
+    files: {
+      '/root/main': `.thumb
+.relax
+beq @near       /// 01 d0
+bne @far        /// 00 d0 81 e0
+@near:
+.i16fill 130    /// ${'00 '.repeat(260)}
+@far:
+.norelax
+beq @far        /// fe d0
 `,
     },
   });
@@ -5,7 +5,7 @@
 // Project Home: https://github.com/velipso/gvasm
 //
 
-import { isAlpha, isNum, isSpace } from './util.ts';
+import { isAlpha, isNum, isSpace, splitLines } from './util.ts';
 
 export interface IFilePos {
   filename: string;
@@ -455,6 +455,148 @@ export function lexAddLine(
   return tks;
 }
 
+// true when the lexer is between tokens, so the next line can be lexed independently of the lines
+// before it
+export function lexIsClean(lx: ILex): boolean {
+  return lx.state === LexEnum.START;
+}
+
+// files can be lexed ahead of time (possibly on a worker) into compact buffers, which avoids
+// serializing token objects
+//
+// toks starts with the line count, followed by the index of the first token of each line, plus
+// one final index marking the end; after that, each token is stored as four ints: kind, chr, and
+// two values (the number for NUM, or the offset and length of the text in chars for the rest)
+//
+// lines that don't start and end in a clean lexer state have their index stored as -1 - index,
+// and must be lexed normally, since their tokens depend on the lines around them
+export interface ILexBuffers {
+  toks: Int32Array;
+  chars: Uint16Array;
+}
+
+const tokKinds = [TokEnum.NEWLINE, TokEnum.ID, TokEnum.NUM, TokEnum.STR, TokEnum.ERROR];
+
+export function lexEncodeFile(
+  filename: string,
+  text: string,
+): ILexBuffers & { includes: string[] } {
+  const lines = splitLines(filename, text, false);
+  const lx = lexNew();
+  const starts: number[] = [];
+  const recs: number[] = [];
+  const strs: string[] = [];
+  let charsLength = 0;
+  const includes: string[] = [];
+  const addStr = (str: string) => {
+    recs.push(charsLength, str.length);
+    strs.push(str);
+    charsLength += str.length;
+  };
+  for (const { line, data } of lines) {
+    const clean = lexIsClean(lx);
+    const tks = lexAddLine(lx, filename, line, data);
+    const start = recs.length >> 2;
+    starts.push(clean && lexIsClean(lx) ? start : -1 - start);
+    for (const tk of tks) {
+      recs.push(tokKinds.indexOf(tk.kind), tk.flp.chr);
+      switch (tk.kind) {
+        case TokEnum.NEWLINE:
+          recs.push(0, 0);
+          break;
+        case TokEnum.ID:
+          addStr(tk.idCase);
+          break;
+        case TokEnum.NUM:
+          recs.push(tk.num, 0);
+          break;
+        case TokEnum.STR:
+          addStr(tk.str);
+          break;
+        case TokEnum.ERROR:
+          addStr(tk.msg);
+          break;
+      }
+    }
+    // report includes so the caller can find the rest of the tree without waiting on assembly
+    if (
+      clean && tks.length === 3 &&
+      tks[0].kind === TokEnum.ID && tks[0].id === '.include' &&
+      tks[1].kind === TokEnum.STR &&
+      tks[2].kind === TokEnum.NEWLINE
+    ) {
+      includes.push(tks[1].str);
+    }
+  }
+  starts.push(recs.length >> 2);
+
+  const toks = new Int32Array(1 + starts.length + recs.length);
+  toks[0] = lines.length;
+  toks.set(starts, 1);
+  toks.set(recs, 1 + starts.length);
+  const chars = new Uint16Array(charsLength);
+  let k = 0;
+  for (const str of strs) {
+    for (let i = 0; i < str.length; i++) {
+      chars[k++] = str.charCodeAt(i);
+    }
+  }
+  return { toks, chars, includes };
+}
+
+function charsToString(chars: Uint16Array, offset: number, length: number): string {
+  let out = '';
+  for (let i = 0; i < length; i += 4096) {
+    out += String.fromCharCode(
+      ...chars.subarray(offset + i, offset + Math.min(length, i + 4096)),
+    );
+  }
+  return out;
+}
+
+// returns the tokens for a line, or false if the line must be lexed normally
+export function lexDecodeLine(
+  buf: ILexBuffers,
+  filename: string,
+  line: number,
+): ITok[] | false {
+  const { toks, chars } = buf;
+  const lineCount = toks[0];
+  if (line < 1 || line > lineCount || toks[line] < 0) {
+    return false;
+  }
+  const start = toks[line];
+  const next = toks[line + 1];
+  const end = next < 0 ? -1 - next : next;
+  const base = lineCount + 2;
+  const tks: ITok[] = [];
+  for (let t = start; t < end; t++) {
+    const k = base + t * 4;
+    const flp = { filename, line, chr: toks[k + 1] };
+    const kind = tokKinds[toks[k]];
+    switch (kind) {
+      case TokEnum.NEWLINE:
+        tks.push(tokNewline(flp));
+        break;
+      case TokEnum.ID:
+        tks.push(tokId(flp, charsToString(chars, toks[k + 2], toks[k + 3])));
+        break;
+      case TokEnum.NUM:
+        tks.push(tokNum(flp, toks[k + 2]));
+        break;
+      case TokEnum.STR:
+        tks.push(tokStr(flp, charsToString(chars, toks[k + 2], toks[k + 3])));
+        break;
+      case TokEnum.ERROR:
+        tks.push(tokError(flp, charsToString(chars, toks[k + 2], toks[k + 3])));
+        break;
+      default:
+        return false;
+    }
+  }
+  return tks;
+}
+
 export function lexKeyValue(line: string): { key: string; value: number } | false {
   const lx = lexNew();
   const tks = lexAddLine(lx, '', 1, line);
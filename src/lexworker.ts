@@ -0,0 +1,17 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+/// <reference no-default-lib="true" />
+/// <reference lib="deno.worker" />
+
+import { lexEncodeFile } from './lexer.ts';
+
+self.onmessage = (e: MessageEvent<{ filename: string; text: string }>) => {
+  const { filename, text } = e.data;
+  const res = lexEncodeFile(filename, text);
+  self.postMessage(res, [res.toks.buffer, res.chars.buffer]);
+};
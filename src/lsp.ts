@@ -0,0 +1,433 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { IMakeDef, IMakeLine, makeFromFile } from './make.ts';
+import { IPrelex } from './prelex.ts';
+import { isIdentBody } from './lexer.ts';
+import { path } from './deps.ts';
+import * as sink from './sink.ts';
+
+export interface ILspArgs {
+  input: string | false;
+  defines: { key: string; value: number }[];
+}
+
+// minimal language server over stdio, speaking JSON-RPC with Content-Length framing
+
+interface IPosition {
+  line: number;
+  character: number;
+}
+
+interface IRange {
+  start: IPosition;
+  end: IPosition;
+}
+
+interface IMessage {
+  id?: number | string;
+  method?: string;
+  params?: unknown;
+}
+
+interface ITextDocumentParams {
+  textDocument: { uri: string; text?: string };
+  position: IPosition;
+  contentChanges: { range?: IRange; text: string }[];
+}
+
+interface IBuild {
+  rom: readonly number[];
+  lines: IMakeLine[];
+  defs: IMakeDef[];
+}
+
+export type LspRead = (buf: Uint8Array) => Promise<number | null>;
+export type LspWrite = (buf: Uint8Array) => Promise<number>;
+
+// how long to wait after an edit before rebuilding
+const BUILD_DELAY = 150;
+
+class LanguageServer {
+  private input: string | false;
+  private defines: { key: string; value: number }[];
+  private docs = new Map<string, string>();
+  private prelex: IPrelex = new Map();
+  private build: IBuild | false = false;
+  private diagnosed = new Set<string>();
+  private timer = -1;
+  private building = false;
+  private dirty = false;
+  private encoder = new TextEncoder();
+  private write: LspWrite;
+  private writing: Promise<unknown> = Promise.resolve();
+  public exitCode: number | false = false;
+  private shutdown = false;
+
+  constructor(input: string | false, defines: { key: string; value: number }[], write: LspWrite) {
+    this.input = input === false ? false : path.resolve(input);
+    this.defines = defines;
+    this.write = write;
+  }
+
+  private send(msg: unknown) {
+    const body = this.encoder.encode(JSON.stringify({ jsonrpc: '2.0', ...(msg as object) }));
+    const head = this.encoder.encode(`Content-Length: ${body.length}\r\n\r\n`);
+    const out = new Uint8Array(head.length + body.length);
+    out.set(head);
+    out.set(body, head.length);
+    // responses and rebuild notifications race each other, so queue whole frames one at a time
+    const res = this.writing.then(async () => {
+      for (let i = 0; i < out.length;) {
+        i += await this.write(out.subarray(i));
+      }
+    });
+    this.writing = res.catch(() => {});
+    return res;
+  }
+
+  public flush() {
+    return this.writing;
+  }
+
+  private notify(method: string, params: unknown) {
+    return this.send({ method, params });
+  }
+
+  public async handle(msg: IMessage) {
+    const { id, method } = msg;
+    const params = msg.params as ITextDocumentParams;
+    try {
+      switch (method) {
+        case 'initialize':
+          await this.send({
+            id,
+            result: {
+              capabilities: {
+                textDocumentSync: { openClose: true, change: 2 }, // incremental
+                definitionProvider: true,
+                hoverProvider: true,
+              },
+              serverInfo: { name: 'gvasm' },
+            },
+          });
+          return;
+        case 'shutdown':
+          this.shutdown = true;
+          await this.send({ id, result: null });
+          return;
+        case 'exit':
+          this.exitCode = this.shutdown ? 0 : 1;
+          return;
+        case 'textDocument/didOpen':
+          this.docs.set(uriToFile(params.textDocument.uri), params.textDocument.text ?? '');
+          this.schedule();
+          return;
+        case 'textDocument/didChange': {
+          const file = uriToFile(params.textDocument.uri);
+          let text = this.docs.get(file) ?? '';
+          for (const change of params.contentChanges) {
+            if (change.range) {
+              text = text.substr(0, positionToOffset(text, change.range.start)) + change.text +
+                text.substr(positionToOffset(text, change.range.end));
+            } else {
+              text = change.text;
+            }
+          }
+          this.docs.set(file, text);
+          this.schedule();
+          return;
+        }
+        case 'textDocument/didClose':
+          this.docs.delete(uriToFile(params.textDocument.uri));
+          this.schedule();
+          return;
+        case 'textDocument/definition':
+          await this.send({ id, result: this.definition(params) });
+          return;
+        case 'textDocument/hover':
+          await this.send({ id, result: this.hover(params) });
+          return;
+      }
+      if (id !== undefined) {
+        await this.send({ id, error: { code: -32601, message: `Unknown method: ${method}` } });
+      }
+    } catch (e) {
+      if (id !== undefined) {
+        await this.send({ id, error: { code: -32603, message: `${e}` } });
+      }
+    }
+  }
+
+  private schedule() {
+    clearTimeout(this.timer);
+    this.timer = setTimeout(() => this.rebuild(), BUILD_DELAY);
+  }
+
+  private async rebuild() {
+    if (this.building) {
+      this.dirty = true;
+      return;
+    }
+    // without an explicit main file, build the first open document
+    const root = this.input === false ? this.docs.keys().next().value : this.input;
+    if (root === undefined) {
+      return;
+    }
+    this.building = true;
+    try {
+      await this.rebuildRoot(root);
+    } finally {
+      this.building = false;
+    }
+    if (this.dirty) {
+      this.dirty = false;
+      this.schedule();
+    }
+  }
+
+  private async rebuildRoot(root: string) {
+    const logs: string[] = [];
+    const res = await makeFromFile(
+      root,
+      this.defines,
+      path.sep === '/',
+      path.isAbsolute,
+      async (file: string) => {
+        if (this.docs.has(file)) {
+          return sink.fstype.FILE;
+        }
+        try {
+          const st = await Deno.stat(file);
+          if (st.isFile) {
+            return sink.fstype.FILE;
+          } else if (st.isDirectory) {
+            return sink.fstype.DIR;
+          }
+        } catch (_) {
+          // fall through
+        }
+        return sink.fstype.NONE;
+      },
+      (file: string) => {
+        const doc = this.docs.get(file);
+        return doc === undefined ? Deno.readTextFile(file) : Promise.resolve(doc);
+      },
+      (file: string) => {
+        const doc = this.docs.get(file);
+        return doc === undefined ? Deno.readFile(file) : Promise.resolve(this.encoder.encode(doc));
+      },
+      (str) => logs.push(str),
+      this.prelex,
+    );
+    for (const message of logs) {
+      await this.notify('window/logMessage', { type: 4, message });
+    }
+
+    const diags = new Map<string, unknown[]>();
+    if ('errors' in res) {
+      for (const err of res.errors) {
+        // errors look like "filename:line:chr: message", but some don't have a location
+        const m = err.match(/^(.*):(\d+):(\d+): ([^]*)$/);
+        const file = m ? m[1] : root;
+        const line = m ? Math.max(0, parseFloat(m[2]) - 1) : 0;
+        const character = m ? Math.max(0, parseFloat(m[3]) - 1) : 0;
+        const list = diags.get(file) ?? [];
+        list.push({
+          range: { start: { line, character }, end: { line, character: character + 1 } },
+          severity: 1,
+          source: 'gvasm',
+          message: m ? m[4] : err,
+        });
+        diags.set(file, list);
+      }
+    } else {
+      // keep the last good build around for definitions and hovers while the code is broken
+      this.build = { rom: res.result, lines: res.lines, defs: res.defs };
+    }
+    for (const file of this.diagnosed) {
+      if (!diags.has(file)) {
+        await this.notify('textDocument/publishDiagnostics', {
+          uri: fileToUri(file),
+          diagnostics: [],
+        });
+      }
+    }
+    for (const [file, diagnostics] of diags) {
+      await this.notify('textDocument/publishDiagnostics', { uri: fileToUri(file), diagnostics });
+    }
+    this.diagnosed = new Set(diags.keys());
+  }
+
+  private wordAt(file: string, pos: IPosition): string | false {
+    const text = this.docs.get(file);
+    if (text === undefined) {
+      return false;
+    }
+    const line = text.split(/\r\n|\r|\n/)[pos.line] ?? '';
+    let start = pos.character;
+    let end = pos.character;
+    while (start > 0 && (isIdentBody(line.charAt(start - 1)) || line.charAt(start - 1) === '.')) {
+      start--;
+    }
+    while (end < line.length && (isIdentBody(line.charAt(end)) || line.charAt(end) === '.')) {
+      end++;
+    }
+    // include the sigil, since labels and constants are stored with it
+    while (start > 0 && (line.charAt(start - 1) === '@' || line.charAt(start - 1) === '$')) {
+      start--;
+    }
+    const word = line.substring(start, end).toLowerCase();
+    return /^(@@?|\$\$?)[a-z_]/.test(word) ? word : false;
+  }
+
+  // local names can be defined many times, so prefer the closest definition before the cursor
+  private findDef(file: string, pos: IPosition, word: string): IMakeDef | false {
+    if (!this.build) {
+      return false;
+    }
+    const isBefore = (def: IMakeDef) => def.flp.filename === file && def.flp.line - 1 <= pos.line;
+    let best: IMakeDef | false = false;
+    for (const def of this.build.defs) {
+      if (def.name !== word) {
+        continue;
+      }
+      if (!word.startsWith('@@') && !word.startsWith('$$')) {
+        return def;
+      }
+      if (!best || (isBefore(def) && (!isBefore(best) || def.flp.line > best.flp.line))) {
+        best = def;
+      }
+    }
+    return best;
+  }
+
+  private definition(params: ITextDocumentParams) {
+    const file = uriToFile(params.textDocument.uri);
+    const word = this.wordAt(file, params.position);
+    const def = word && this.findDef(file, params.position, word);
+    if (!def) {
+      return null;
+    }
+    const start = { line: def.flp.line - 1, character: def.flp.chr - 1 };
+    return {
+      uri: fileToUri(def.flp.filename),
+      range: { start, end: { ...start, character: start.character + def.name.length } },
+    };
+  }
+
+  private hover(params: ITextDocumentParams) {
+    const file = uriToFile(params.textDocument.uri);
+    const out: string[] = [];
+    const word = this.wordAt(file, params.position);
+    const def = word && this.findDef(file, params.position, word);
+    if (def) {
+      if (def.addr !== undefined) {
+        out.push(`\`${def.name}\` = \`0x${hex(def.addr, 8)}\``);
+      } else {
+        // constants can be expressions with parameters, so show their definition
+        const src = this.prelex.get(def.flp.filename)?.lines[def.flp.line - 1];
+        out.push(`\`\`\`gvasm\n${(src ?? def.name).trim()}\n\`\`\``);
+      }
+    }
+    if (this.build) {
+      for (const ln of this.build.lines) {
+        if (ln.filename === file && ln.line - 1 === params.position.line) {
+          const bytes = this.build.rom.slice(ln.offset, ln.offset + Math.min(ln.size, 16));
+          out.push(
+            `\`0x${hex(ln.addr, 8)}\`: \`${bytes.map((b) => hex(b, 2)).join(' ')}${
+              ln.size > 16 ? ' ...' : ''
+            }\``,
+          );
+        }
+      }
+    }
+    return out.length > 0 ? { contents: { kind: 'markdown', value: out.join('\n\n') } } : null;
+  }
+}
+
+function hex(n: number, width: number) {
+  return (n >>> 0).toString(16).padStart(width, '0');
+}
+
+function uriToFile(uri: string) {
+  return uri.startsWith('file:') ? path.fromFileUrl(uri) : uri;
+}
+
+function fileToUri(file: string) {
+  return path.isAbsolute(file) ? path.toFileUrl(file).href : file;
+}
+
+function positionToOffset(text: string, pos: IPosition): number {
+  let offset = 0;
+  for (let line = 0; line < pos.line; line++) {
+    const next = text.indexOf('\n', offset);
+    if (next < 0) {
+      return text.length;
+    }
+    offset = next + 1;
+  }
+  return Math.min(text.length, offset + pos.character);
+}
+
+export function lsp(args: ILspArgs): Promise<number> {
+  return lspServe(args, (buf) => Deno.stdin.read(buf), (buf) => Deno.stdout.write(buf));
+}
+
+export async function lspServe(
+  { input, defines }: ILspArgs,
+  read: LspRead,
+  write: LspWrite,
+): Promise<number> {
+  const server = new LanguageServer(input, defines, write);
+  const decoder = new TextDecoder();
+  let pending = new Uint8Array(0);
+  const chunk = new Uint8Array(65536);
+  while (server.exitCode === false) {
+    const n = await read(chunk);
+    if (n === null) {
+      return 1;
+    }
+    const next = new Uint8Array(pending.length + n);
+    next.set(pending);
+    next.set(chunk.subarray(0, n), pending.length);
+    pending = next;
+
+    // pull out every complete message
+    while (server.exitCode === false) {
+      let headEnd = -1;
+      for (let i = 0; i + 3 < pending.length; i++) {
+        if (
+          pending[i] === 13 && pending[i + 1] === 10 && pending[i + 2] === 13 &&
+          pending[i + 3] === 10
+        ) {
+          headEnd = i;
+          break;
+        }
+      }
+      if (headEnd < 0) {
+        break;
+      }
+      const head = decoder.decode(pending.subarray(0, headEnd));
+      const m = head.match(/content-length:\s*(\d+)/i);
+      if (!m) {
+        console.error('Invalid message header');
+        return 1;
+      }
+      const bodyStart = headEnd + 4;
+      const bodyEnd = bodyStart + parseFloat(m[1]);
+      if (pending.length < bodyEnd) {
+        break;
+      }
+      const body = decoder.decode(pending.subarray(bodyStart, bodyEnd));
+      pending = pending.slice(bodyEnd);
+      await server.handle(JSON.parse(body));
+    }
+  }
+  await server.flush();
+  return server.exitCode;
+}
@@ -0,0 +1,123 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+// LZ77 in the format understood by the BIOS LZ77UnCompWram/LZ77UnCompVram functions
+//
+//   u32  0x10 | (decompressed size << 8)
+//   then groups of a flag byte followed by 8 items, where flag bits are read MSB-first:
+//     0  literal byte
+//     1  two bytes: (length - 3) << 4 | (distance - 1) >> 8, (distance - 1) & 0xff
+//
+// distances are 1..4096, lengths are 3..18
+
+const MIN_MATCH = 3;
+const MAX_MATCH = 18;
+const WINDOW = 4096;
+const HASH_SIZE = 1 << 14;
+const MAX_CHAIN = 256;
+
+// `vram` avoids distance 1, since VRAM can only be written 16 bits at a time, and the BIOS reads
+// back the halfword it's still building
+export function lz77Compress(data: Uint8Array, vram: boolean): Uint8Array {
+  if (data.length >= 1 << 24) {
+    throw 'Data too large to compress with LZ77';
+  }
+  const minDist = vram ? 2 : 1;
+  const out: number[] = [
+    0x10,
+    data.length & 0xff,
+    (data.length >> 8) & 0xff,
+    (data.length >> 16) & 0xff,
+  ];
+
+  // hash chains over 3-byte prefixes
+  const head = new Int32Array(HASH_SIZE).fill(-1);
+  const prev = new Int32Array(data.length);
+  const hash = (i: number) =>
+    ((data[i] << 6) ^ (data[i + 1] << 3) ^ data[i + 2] ^ (data[i] >> 2)) & (HASH_SIZE - 1);
+  let inserted = 0;
+  const insertUpTo = (end: number) => {
+    for (; inserted < end && inserted + 2 < data.length; inserted++) {
+      const h = hash(inserted);
+      prev[inserted] = head[h];
+      head[h] = inserted;
+    }
+  };
+  const findMatch = (i: number) => {
+    let bestLen = 0;
+    let bestDist = 0;
+    if (i + MIN_MATCH > data.length) {
+      return { len: 0, dist: 0 };
+    }
+    const maxLen = Math.min(MAX_MATCH, data.length - i);
+    let chain = MAX_CHAIN;
+    for (let j = head[hash(i)]; j >= 0 && i - j <= WINDOW && chain > 0; j = prev[j], chain--) {
+      if (i - j < minDist) {
+        continue;
+      }
+      let len = 0;
+      while (len < maxLen && data[j + len] === data[i + len]) {
+        len++;
+      }
+      if (len > bestLen) {
+        bestLen = len;
+        bestDist = i - j;
+        if (len >= maxLen) {
+          break;
+        }
+      }
+    }
+    return bestLen >= MIN_MATCH ? { len: bestLen, dist: bestDist } : { len: 0, dist: 0 };
+  };
+
+  let flagPos = -1;
+  let flagBit = 0;
+  const nextFlag = (set: boolean) => {
+    if (flagBit === 0) {
+      flagPos = out.length;
+      out.push(0);
+      flagBit = 0x80;
+    }
+    if (set) {
+      out[flagPos] |= flagBit;
+    }
+    flagBit >>= 1;
+  };
+
+  let i = 0;
+  while (i < data.length) {
+    insertUpTo(i);
+    let m = findMatch(i);
+    if (m.len > 0 && m.len < MAX_MATCH) {
+      // lazy matching: if the next byte starts a longer match, emit a literal first
+      insertUpTo(i + 1);
+      const m2 = findMatch(i + 1);
+      if (m2.len > m.len) {
+        nextFlag(false);
+        out.push(data[i]);
+        i++;
+        m = m2;
+      }
+    }
+    if (m.len > 0) {
+      nextFlag(true);
+      const d = m.dist - 1;
+      out.push(((m.len - MIN_MATCH) << 4) | (d >> 8), d & 0xff);
+      i += m.len;
+    } else {
+      nextFlag(false);
+      out.push(data[i]);
+      i++;
+    }
+  }
+
+  // the BIOS expects the source to be word aligned, so keep the size a multiple of 4 too
+  while (out.length % 4) {
+    out.push(0);
+  }
+  return new Uint8Array(out);
+}
@@ -8,10 +8,13 @@
 import { IInitArgs, init } from './init.ts';
 import { IMakeArgs, make } from './make.ts';
 import { IRunArgs, run } from './run.ts';
+import { SaveType, saveTypes } from './save.ts';
 import { dis, IDisArgs } from './dis.ts';
 import { IItestArgs, itest } from './itest.ts';
+import { ILspArgs, lsp } from './lsp.ts';
 import { argParse, path } from './deps.ts';
 import { lexKeyValue } from './lexer.ts';
+import { flashChips } from './patch.ts';
 
 export const version = 1009004;
 
@@ -34,6 +37,7 @@ Command Summary:
   make      Compile a project into a .gba file
   run       Run a .gvasm file in debug mode
   dis       Disassemble a .gba file into a source
+  lsp       Start a language server for editors, over stdio
   itest     Run internal tests to verify correct behavior
 
 For more help, try:
@@ -157,13 +161,24 @@ function parseInitArgs(args: string[]): number | IInitArgs {
 }
 
 function printMakeHelp() {
-  console.log(`gvasm make <input> [-o <output>] [-d NAME=value]
+  console.log(`gvasm make <input> [-o <output>] [-d NAME=value] [--multiboot]
+                  [--patch-from <old>] [--patch <patch>] [--flash <chip>]
 
-<input>        The input .gvasm file
--o <output>    The output file (default: input with .gba extension)
--d NAME=value  Define the global \$NAME, set to value (integer), ex:
-               -d FOO=1         is equivalent to:
-               .def \$FOO = 1`);
+<input>              The input .gvasm file
+-o <output>          The output file (default: input with .gba extension)
+-d NAME=value        Define the global \$NAME, set to value (integer), ex:
+                       -d FOO=1         is equivalent to:
+                       .def \$FOO = 1
+--multiboot          Build a compressed multiboot image, based at 0x02000000
+--patch-from <old>   Previous .gba build to compare against (default: output)
+--patch <patch>      Write the flash sectors that changed since <old> to <patch>
+--flash <chip>       Sector layout of the flash chip (default: s29gl):
+                       s29gl         S29GL128N/256N/512N
+                       m29w128g      M29W128GH/GL
+                       m58wr064ft    M58WR064FT (top boot)
+                       m58wr064fb    M58WR064FB (bottom boot)
+                       m36w0r6030t0  M36W0R6030T0 (top boot)
+                       m36w0r6030b0  M36W0R6030B0 (bottom boot)`);
 }
 
 function parseDefines(define: string | string[]): { key: string; value: number }[] | false {
@@ -183,8 +198,8 @@ function parseDefines(define: string | string[]): { key: string; value: number }
 function parseMakeArgs(args: string[]): number | IMakeArgs {
   let badArgs = false;
   const a = argParse(args, {
-    string: ['output', 'define'],
-    boolean: ['help'],
+    string: ['output', 'define', 'patch-from', 'patch', 'flash'],
+    boolean: ['help', 'multiboot'],
     alias: { h: 'help', o: 'output', d: 'define' },
     unknown: (_arg: string, key?: string) => {
       if (key) {
@@ -211,33 +226,54 @@ function parseMakeArgs(args: string[]): number | IMakeArgs {
     return 1;
   }
   const input = a._[0] as string;
-  const output = a.output;
+  const output = a.output ??
+    path.format({ ...path.parse(input), base: undefined, ext: '.gba' });
   const defines = parseDefines(a.define);
   if (defines === false) {
     return 1;
   }
+  if (a['patch-from'] && !a.patch) {
+    console.error('Missing --patch output file');
+    return 1;
+  }
+  const flash = a.flash ?? 's29gl';
+  if (!(flash in flashChips)) {
+    console.error(`Unknown flash chip: ${flash}`);
+    return 1;
+  }
   return {
     input,
-    output: output ??
-      path.format({ ...path.parse(input), base: undefined, ext: '.gba' }),
+    output,
     defines,
+    multiboot: !!a.multiboot,
+    patch: a.patch ? { from: a['patch-from'] ?? output, output: a.patch, flash } : false,
   };
 }
 
 function printRunHelp() {
-  console.log(`gvasm run <input> [-d NAME=value]
+  console.log(`gvasm run <input> [-d NAME=value] [--save <type>] [--perf-lint]
 
 <input>        The input .gvasm file
 -d NAME=value  Define the global \$NAME, set to value (integer), ex:
                -d FOO=1         is equivalent to:
-               .def \$FOO = 1`);
+               .def \$FOO = 1
+--save <type>  Emulated save memory, detected from ID strings (like
+               "FLASH1M_V") by default:
+                 none      No save memory
+                 sram      32K SRAM
+                 flash64   64K Flash
+                 flash128  128K Flash
+                 eeprom    EEPROM (512 bytes or 8K)
+--perf-lint    Report slow code patterns seen while running, like ARM code
+               in ROM, 8-bit VRAM writes, unaligned loads, loops reading ROM
+               constants, and ldm/stm crossing memory regions`);
 }
 
 function parseRunArgs(args: string[]): number | IRunArgs {
   let badArgs = false;
   const a = argParse(args, {
-    string: ['define'],
-    boolean: ['help'],
+    string: ['define', 'save'],
+    boolean: ['help', 'perf-lint'],
     alias: { h: 'help', d: 'define' },
     unknown: (_arg: string, key?: string) => {
       if (key) {
@@ -268,7 +304,12 @@ function parseRunArgs(args: string[]): number | IRunArgs {
   if (defines === false) {
     return 1;
   }
-  return { input, defines };
+  const save: string | false = a.save ?? false;
+  if (save !== false && !(saveTypes as string[]).includes(save)) {
+    console.error(`Unknown save type: ${save}`);
+    return 1;
+  }
+  return { input, defines, save: save as SaveType | false, perfLint: !!a['perf-lint'] };
 }
 
 function printDisHelp() {
@@ -326,6 +367,48 @@ function parseDisArgs(args: string[]): number | IDisArgs {
   };
 }
 
+function printLspHelp() {
+  console.log(`gvasm lsp [<input>] [-d NAME=value]
+
+<input>        The main .gvasm file of the project (default: first opened file)
+-d NAME=value  Define the global \$NAME, set to value (integer), ex:
+               -d FOO=1         is equivalent to:
+               .def \$FOO = 1`);
+}
+
+function parseLspArgs(args: string[]): number | ILspArgs {
+  let badArgs = false;
+  const a = argParse(args, {
+    string: ['define'],
+    boolean: ['help', 'stdio'],
+    alias: { h: 'help', d: 'define' },
+    unknown: (_arg: string, key?: string) => {
+      if (key) {
+        console.error(`Unknown argument: -${key}`);
+        badArgs = true;
+        return false;
+      }
+      return true;
+    },
+  });
+  if (badArgs) {
+    return 1;
+  }
+  if (a.help) {
+    printLspHelp();
+    return 0;
+  }
+  if (a._.length > 1) {
+    console.error('Can only have one input file');
+    return 1;
+  }
+  const defines = parseDefines(a.define);
+  if (defines === false) {
+    return 1;
+  }
+  return { input: a._.length > 0 ? a._[0] as string : false, defines };
+}
+
 function printItestHelp() {
   console.log(`gvasm itest [<filters...>]
 
@@ -396,6 +479,12 @@ export async function main(args: string[]): Promise<number> {
       return itestArgs;
     }
     return await itest(itestArgs);
+  } else if (args[0] === 'lsp') {
+    const lspArgs = parseLspArgs(args.slice(1));
+    if (typeof lspArgs === 'number') {
+      return lspArgs;
+    }
+    return await lsp(lspArgs);
   }
   console.error(`Unknown command: ${args[0]}`);
   return 1;
@@ -12,29 +12,64 @@ import {
   isIdentStart,
   ITok,
   lexAddLine,
+  lexDecodeLine,
+  lexIsClean,
   lexNew,
   TokEnum,
 } from './lexer.ts';
 import { assertNever, b16, b32, ILineStr, printf, splitLines } from './util.ts';
 import { ARM, Thumb } from './ops.ts';
 import { Expression, ExpressionBuilder } from './expr.ts';
-import { Bytes, IBase } from './bytes.ts';
+import { Bytes, IBase, ILayout, ILayoutMisses } from './bytes.ts';
 import { path, pathBasename, pathDirname, pathJoin, pathResolve } from './deps.ts';
 import { ConstTable } from './const.ts';
+import { IPrelex, prelexTree } from './prelex.ts';
+import { writePatch } from './patch.ts';
+import { EWRAM_START, multibootImage, multibootTransferSeconds } from './multiboot.ts';
 import { version } from './main.ts';
 import { stdlib } from './stdlib.ts';
 import { extlib } from './extlib.ts';
-import { ILinePut, loadLibIntoContext, loadLibIntoScript } from './sinklib.ts';
+import {
+  bytesToStr,
+  ILinePut,
+  loadLibIntoContext,
+  loadLibIntoScript,
+} from './sinklib.ts';
 import * as sink from './sink.ts';
 
 export interface IMakeArgs {
   input: string;
   output: string;
   defines: { key: string; value: number }[];
+  multiboot: boolean;
+  patch: false | { from: string; output: string; flash: string };
+}
+
+export interface IMakeLine {
+  filename: string;
+  line: number;
+  addr: number;
+  offset: number;
+  size: number;
+}
+
+// where a label or constant was defined, for tooling; labels include their address
+export interface IMakeDef {
+  name: string;
+  flp: IFilePos;
+  addr?: number;
 }
 
 export type IMakeResult =
-  | { result: readonly number[]; base: number; arm: boolean; debug: IDebugStatement[] }
+  | {
+    result: readonly number[];
+    base: number;
+    arm: boolean;
+    debug: IDebugStatement[];
+    symbols: { [label: string]: number };
+    lines: IMakeLine[];
+    defs: IMakeDef[];
+  }
   | { errors: string[] };
 
 interface IDotStackBegin {
@@ -42,6 +77,8 @@ interface IDotStackBegin {
   arm: boolean;
   base: IBase;
   regs: string[];
+  relax: boolean;
+  autoPool: boolean;
   flp: IFilePos;
 }
 
@@ -94,9 +131,12 @@ interface IParseState {
   arm: boolean;
   main: boolean;
   regs: string[];
+  relax: boolean;
+  autoPool: boolean;
   base: IBase;
   bytes: Bytes;
   debug: IDebugStatement[];
+  defs: IMakeDef[];
   ctable: ConstTable;
   active: boolean;
   struct: false | {
@@ -342,6 +382,18 @@ function parseDotStatement(
       state.bytes.align(2);
       setARM(state, false);
       break;
+    case '.relax':
+      if (line.length > 0) {
+        throw 'Invalid .relax statement';
+      }
+      setRelax(state, true);
+      break;
+    case '.norelax':
+      if (line.length > 0) {
+        throw 'Invalid .norelax statement';
+      }
+      setRelax(state, false);
+      break;
     case '.regs': {
       const regs: string[] = [];
       if (line.length <= 0) {
@@ -437,27 +489,38 @@ function parseDotStatement(
       break;
     }
     case '.i8':
-    case '.b8':
+    case '.b8': {
+      // parse everything first, so an automatic pool can't land in the middle of the data
+      const items: (Uint8Array | { hint: string; v: Expression })[] = [];
+      let size = 0;
       while (line.length > 0) {
         const t = line[0];
         if (t.kind === TokEnum.STR) {
           line.shift();
-          for (const n of new TextEncoder().encode(t.str)) {
-            state.bytes.write8(n);
-          }
+          const data = new TextEncoder().encode(t.str);
+          items.push(data);
+          size += data.length;
         } else {
-          state.bytes.expr8(
-            errorString(t.flp, `Invalid ${cmd} statement`),
-            { v: parseExpr(line, state.ctable) },
-            false,
-            ({ v }) => v,
-          );
+          items.push({
+            hint: errorString(t.flp, `Invalid ${cmd} statement`),
+            v: parseExpr(line, state.ctable),
+          });
+          size++;
         }
         if (line.length > 0) {
           parseComma(line, `Invalid ${cmd} statement`);
         }
       }
+      state.bytes.autoPoolBefore(isARM(state), size);
+      for (const item of items) {
+        if (item instanceof Uint8Array) {
+          state.bytes.writeArray(item);
+        } else {
+          state.bytes.expr8(item.hint, { v: item.v }, false, ({ v }) => v);
+        }
+      }
       break;
+    }
     case '.i8fill':
     case '.b8fill': {
       const [amount, fill] = parseNumCommas(
@@ -469,30 +532,35 @@ function parseDotStatement(
       if (amount < 0) {
         throw `Invalid ${cmd} statement`;
       }
+      state.bytes.autoPoolBefore(isARM(state), amount);
       for (let i = 0; i < amount; i++) {
         state.bytes.write8(fill);
       }
       break;
     }
     case '.i16':
-    case '.b16':
+    case '.b16': {
+      const items: { hint: string; v: Expression }[] = [];
       while (line.length > 0) {
-        state.bytes.expr16(
-          errorString(line[0].flp, `Invalid ${cmd} statement`),
-          { v: parseExpr(line, state.ctable) },
-          false,
-          ({ v }) => {
-            if (cmd === '.b16') {
-              return b16(v);
-            }
-            return v;
-          },
-        );
+        items.push({
+          hint: errorString(line[0].flp, `Invalid ${cmd} statement`),
+          v: parseExpr(line, state.ctable),
+        });
         if (line.length > 0) {
           parseComma(line, `Invalid ${cmd} statement`);
         }
       }
+      state.bytes.autoPoolBefore(isARM(state), items.length * 2);
+      for (const { hint, v } of items) {
+        state.bytes.expr16(hint, { v }, false, ({ v }) => {
+          if (cmd === '.b16') {
+            return b16(v);
+          }
+          return v;
+        });
+      }
       break;
+    }
     case '.i16fill':
     case '.b16fill': {
       const [amount, fill] = parseNumCommas(
@@ -504,30 +572,35 @@ function parseDotStatement(
       if (amount < 0) {
         throw `Invalid ${cmd} statement`;
       }
+      state.bytes.autoPoolBefore(isARM(state), amount * 2);
       for (let i = 0; i < amount; i++) {
         state.bytes.write16(cmd === '.b16fill' ? b16(fill) : fill);
       }
       break;
     }
     case '.i32':
-    case '.b32':
+    case '.b32': {
+      const items: { hint: string; v: Expression }[] = [];
       while (line.length > 0) {
-        state.bytes.expr32(
-          errorString(line[0].flp, `Invalid ${cmd} statement`),
-          { v: parseExpr(line, state.ctable) },
-          false,
-          ({ v }) => {
-            if (cmd === '.b32') {
-              return b32(v);
-            }
-            return v;
-          },
-        );
+        items.push({
+          hint: errorString(line[0].flp, `Invalid ${cmd} statement`),
+          v: parseExpr(line, state.ctable),
+        });
         if (line.length > 0) {
           parseComma(line, `Invalid ${cmd} statement`);
         }
       }
+      state.bytes.autoPoolBefore(isARM(state), items.length * 4);
+      for (const { hint, v } of items) {
+        state.bytes.expr32(hint, { v }, false, ({ v }) => {
+          if (cmd === '.b32') {
+            return b32(v);
+          }
+          return v;
+        });
+      }
       break;
+    }
     case '.i32fill':
     case '.b32fill': {
       const [amount, fill] = parseNumCommas(
@@ -539,6 +612,7 @@ function parseDotStatement(
       if (amount < 0) {
         throw `Invalid ${cmd} statement`;
       }
+      state.bytes.autoPoolBefore(isARM(state), amount * 4);
       for (let i = 0; i < amount; i++) {
         state.bytes.write32(cmd === '.b32fill' ? b32(fill) : fill);
       }
@@ -605,17 +679,23 @@ function parseDotStatement(
       break;
     }
     case '.pool':
+      if (isNextId(line, 'auto') || isNextId(line, 'manual')) {
+        setAutoPool(state, isNextId(line, 'auto'));
+        line.shift();
+      } else if (line.length <= 0) {
+        if (state.bytes.writePool()) {
+          state.bytes.align(isARM(state) ? 4 : 2);
+        }
+      }
       if (line.length > 0) {
         throw 'Invalid .pool statement';
       }
-      if (state.bytes.writePool()) {
-        state.bytes.align(isARM(state) ? 4 : 2);
-      }
       break;
     case '.def': {
       if (!isNextId(line, '$')) {
         throw 'Expecting $const after .def';
       }
+      const flp = line[0].flp;
       line.shift();
       let prefix = '$';
       if (isNextId(line, '$')) {
@@ -665,6 +745,7 @@ function parseDotStatement(
         throw 'Invalid .def statement';
       }
       state.ctable.def(prefix + name, paramNames, expr);
+      state.defs.push({ name: prefix + name, flp });
       break;
     }
     default:
@@ -857,6 +938,55 @@ function calcRotImm(v: number): number | false {
   return (((16 - r) & 0xf) << 8) | (v & 0xff);
 }
 
+// look up the value of a code part at parse time, if it's known
+function codePartValue(codeParts: readonly unknown[], syms: ISyms, sym: string): number | false {
+  for (const codePart of codeParts) {
+    const cp = codePart as { k: string; sym?: string; v?: number };
+    if (cp.sym === sym) {
+      if ((cp.k === 'value' || cp.k === 'ignored') && cp.v !== undefined) {
+        return cp.v;
+      }
+      const v = syms[sym];
+      return typeof v === 'number' ? v : false;
+    }
+  }
+  return false;
+}
+
+// unconditional control transfers never fall through to the next instruction; writes to pc like
+// `add pc, ...` and `ldr pc, [pc, ...]` aren't included, since they usually dispatch through a jump
+// table that follows them
+function isARMTransfer(pb: ARM.IParsedBody, syms: ISyms): boolean {
+  const cp = pb.op.codeParts;
+  if (codePartValue(cp, syms, 'cond') !== 14) {
+    return false;
+  }
+  switch (pb.op.category) {
+    case 'Branch':
+      // bx, or b without link
+      return codePartValue(cp, syms, 'link') !== 1;
+    case 'Block Data Transfer': {
+      const rlist = codePartValue(cp, syms, 'Rlist');
+      return /^(pop|ldm)/.test(pb.op.syntax[0]) && rlist !== false && (rlist & 0x8000) !== 0;
+    }
+  }
+  return false;
+}
+
+function isThumbTransfer(pb: Thumb.IParsedBody, syms: ISyms): boolean {
+  const cp = pb.op.codeParts;
+  switch (pb.op.category) {
+    case 'Format 18: Unconditional Branch':
+      return true;
+    case 'Format 5: Hi Register Operations/Branch Exchange':
+      return pb.op.syntax[0].startsWith('bx');
+    case 'Format 14: Push/Pop Registers':
+      // pop {..., pc}
+      return codePartValue(cp, syms, 'l') === 1 && codePartValue(cp, syms, 'r') === 1;
+  }
+  return false;
+}
+
 function parseARMStatement(
   state: IParseState,
   flp: IFilePos,
@@ -928,92 +1058,104 @@ function parseARMStatement(
   }
 
   // great! now constitute the opcode using the symbols
-  state.bytes.expr32(
-    errorString(flp, 'Invalid statement'),
-    syms,
-    false,
-    (syms, address) => {
-      const opcode = new BitNumber(32);
-      for (const codePart of pb.op.codeParts) {
-        switch (codePart.k) {
-          case 'immediate': {
-            const v = syms[codePart.sym];
-            if (v < 0 || v >= (1 << codePart.s)) {
-              throw `Immediate value out of range 0..${
-                (1 << codePart.s) -
-                1
-              }: ${v}`;
-            }
-            opcode.push(codePart.s, v);
-            break;
+  const build = (syms: { [name: string]: number }, address: number) => {
+    const opcode = new BitNumber(32);
+    for (const codePart of pb.op.codeParts) {
+      switch (codePart.k) {
+        case 'immediate': {
+          const v = syms[codePart.sym];
+          if (v < 0 || v >= (1 << codePart.s)) {
+            throw `Immediate value out of range 0..${
+              (1 << codePart.s) -
+              1
+            }: ${v}`;
           }
-          case 'enum':
-          case 'register':
-          case 'reglist':
-            opcode.push(codePart.s, syms[codePart.sym]);
-            break;
-          case 'value':
-          case 'ignored':
-            opcode.push(codePart.s, codePart.v);
-            break;
-          case 'rotimm': {
-            const rotimm = calcRotImm(syms[codePart.sym]);
-            if (rotimm === false) {
-              throw `Can't generate rotated immediate from ${syms[codePart.sym]}`;
-            }
-            opcode.push(12, rotimm);
-            break;
+          opcode.push(codePart.s, v);
+          break;
+        }
+        case 'enum':
+        case 'register':
+        case 'reglist':
+          opcode.push(codePart.s, syms[codePart.sym]);
+          break;
+        case 'value':
+        case 'ignored':
+          opcode.push(codePart.s, codePart.v);
+          break;
+        case 'rotimm': {
+          const rotimm = calcRotImm(syms[codePart.sym]);
+          if (rotimm === false) {
+            throw `Can't generate rotated immediate from ${syms[codePart.sym]}`;
           }
-          case 'word': {
-            const offset = syms[codePart.sym] - address - 8;
-            if (offset & 3) {
-              throw 'Can\'t branch to misaligned memory address';
-            }
-            opcode.push(codePart.s, offset >> 2);
-            break;
+          opcode.push(12, rotimm);
+          break;
+        }
+        case 'word': {
+          const offset = syms[codePart.sym] - address - 8;
+          if (offset & 3) {
+            throw 'Can\'t branch to misaligned memory address';
           }
-          case 'offset12':
-          case 'pcoffset12': {
-            const offset = codePart.k === 'offset12'
-              ? syms[codePart.sym]
-              : syms[codePart.sym] - address - 8;
-            if (codePart.sign) {
-              opcode.push(codePart.s, offset < 0 ? 0 : 1);
-            } else {
-              const v = Math.abs(offset);
-              if (v >= (1 << codePart.s)) {
-                throw `Offset too large: ${v}`;
-              }
-              opcode.push(codePart.s, v);
+          opcode.push(codePart.s, offset >> 2);
+          break;
+        }
+        case 'offset12':
+        case 'pcoffset12': {
+          const offset = codePart.k === 'offset12'
+            ? syms[codePart.sym]
+            : syms[codePart.sym] - address - 8;
+          if (codePart.sign) {
+            opcode.push(codePart.s, offset < 0 ? 0 : 1);
+          } else {
+            const v = Math.abs(offset);
+            if (v >= (1 << codePart.s)) {
+              throw `Offset too large: ${v}`;
             }
-            break;
+            opcode.push(codePart.s, v);
           }
-          case 'offsetsplit':
-          case 'pcoffsetsplit': {
-            const offset = codePart.k === 'offsetsplit'
-              ? syms[codePart.sym]
-              : syms[codePart.sym] - address - 8;
-            if (codePart.sign) {
-              opcode.push(codePart.s, offset < 0 ? 0 : 1);
-            } else {
-              const v = Math.abs(offset);
-              if (v > 0xff) {
-                throw `Offset too large: ${v}`;
-              }
-              opcode.push(
-                codePart.s,
-                codePart.low ? v & 0xf : ((v >> 4) & 0xf),
-              );
+          break;
+        }
+        case 'offsetsplit':
+        case 'pcoffsetsplit': {
+          const offset = codePart.k === 'offsetsplit'
+            ? syms[codePart.sym]
+            : syms[codePart.sym] - address - 8;
+          if (codePart.sign) {
+            opcode.push(codePart.s, offset < 0 ? 0 : 1);
+          } else {
+            const v = Math.abs(offset);
+            if (v > 0xff) {
+              throw `Offset too large: ${v}`;
             }
-            break;
+            opcode.push(
+              codePart.s,
+              codePart.low ? v & 0xf : ((v >> 4) & 0xf),
+            );
           }
-          default:
-            assertNever(codePart);
+          break;
         }
+        default:
+          assertNever(codePart);
       }
-      return opcode.get();
-    },
-  );
+    }
+    return opcode.get();
+  };
+  let branchSym: string | false = false;
+  for (const codePart of pb.op.codeParts) {
+    if (codePart.k === 'word') {
+      branchSym = codePart.sym;
+    }
+  }
+  const es = errorString(flp, 'Invalid statement');
+  state.bytes.autoPoolBefore(true, 4);
+  if (branchSym) {
+    // b/bl reach +/-32MB, which isn't enough to get between ROM and RAM
+    state.bytes.exprBranch(es, syms, branchSym, 'arm', 0x2000000, build);
+  } else {
+    state.bytes.expr32(es, syms, false, build);
+  }
+  if (isARMTransfer(pb, syms)) {
+    state.bytes.autoPoolAfterTransfer(true);
+  }
   return true;
 }
 
@@ -1091,12 +1233,13 @@ function parseARMPoolStatement(
   if (cond < 0) {
     throw 'Invalid arm pool statement';
   }
+  state.bytes.autoPoolBefore(true, 4);
 
   if (cmdSize === 4) {
     state.bytes.expr32(
       errorString(flp, 'Incomplete statement'),
       { ex },
-      { align: 4, bytes: 4, sym: 'ex' },
+      { align: 4, bytes: 4, sym: 'ex', reach: 0x1007 },
       ({ ex }, _) => {
         const mov = calcRotImm(ex);
         if (mov !== false) {
@@ -1140,7 +1283,7 @@ function parseARMPoolStatement(
     state.bytes.expr32(
       errorString(flp, 'Incomplete statement'),
       { ex },
-      { align: 2, bytes: 2, sym: 'ex' },
+      { align: 2, bytes: 2, sym: 'ex', reach: 0x107 },
       () => false,
       (_, address, poolAddress) => {
         // convert to: ldrh rd, [pc, #offset]
@@ -1162,7 +1305,7 @@ function parseARMPoolStatement(
     state.bytes.expr32(
       errorString(flp, 'Incomplete statement'),
       { ex },
-      { align: 1, bytes: 1, sym: 'ex' },
+      { align: 1, bytes: 1, sym: 'ex', reach: 0x107 },
       () => false,
       (_, address, poolAddress) => {
         // convert to: ldrh rd, [pc, #offset]
@@ -1347,12 +1490,40 @@ function parseThumbStatement(
   );
 
   const es = errorString(flp, 'Invalid statement');
-  if (pb.op.doubleInstruction) {
+  state.bytes.autoPoolBefore(false, 4);
+  if (isRelax(state) && pb.op.category === 'Format 16: Conditional Branch') {
+    // when the target is too far, use an inverted branch over an unconditional branch:
+    //   b<!cond> +0
+    //   b target
+    state.bytes.exprRelax(es, syms, 'offset', 256, writer(16), ({ offset, cond }, address) => {
+      const b = offset - address - 6;
+      if (b < -2048 || b >= 2048) {
+        throw `Offset too large: ${b}`;
+      } else if (b & 1) {
+        throw 'Can\'t branch to misaligned memory address';
+      }
+      return (0xd000 | ((cond ^ 1) << 8)) | ((0xe000 | ((b >> 1) & 0x7ff)) << 16);
+    });
+    return true;
+  }
+  let branchSym: string | false = false;
+  for (const codePart of pb.op.codeParts) {
+    if (codePart.k === 'offsetsplit') {
+      branchSym = codePart.sym;
+    }
+  }
+  if (branchSym) {
+    // bl reaches +/-4MB, so calls between ROM and RAM might need a veneer
+    state.bytes.exprBranch(es, syms, branchSym, 'thumb', 0x400000, writer(32));
+  } else if (pb.op.doubleInstruction) {
     // double instructions are 32-bits instead of 16-bits
     state.bytes.expr32(es, syms, false, writer(32));
   } else {
     state.bytes.expr16(es, syms, false, writer(16));
   }
+  if (isThumbTransfer(pb, syms)) {
+    state.bytes.autoPoolAfterTransfer(false);
+  }
   return true;
 }
 
@@ -1365,10 +1536,11 @@ function parseThumbPoolStatement(
   if (cmd !== 'ldr') {
     throw 'Invalid thumb pool statement';
   }
+  state.bytes.autoPoolBefore(false, 4);
   state.bytes.expr16(
     errorString(flp, 'Incomplete statement'),
     { ex },
-    { align: 4, bytes: 4, sym: 'ex' },
+    { align: 4, bytes: 4, sym: 'ex', reach: 0x3fe },
     ({ ex }, address) => {
       // convert to: add rd, pc, #offset
       const offset = ex - (address & 0xfffffffd) - 4;
@@ -1466,6 +1638,8 @@ function parseBlockStatement(
         arm: isARM(state),
         base: getBase(state),
         regs: getRegs(state),
+        relax: isRelax(state),
+        autoPool: state.bytes.autoPool,
         flp,
       });
       return true;
@@ -1496,11 +1670,7 @@ function parseBlockStatement(
               }
               try {
                 const data = await state.readBinaryFile(file);
-                let text = '';
-                for (const b of data) {
-                  text += String.fromCharCode(b);
-                }
-                await sink.scr_write(scr, text, body[0]?.line ?? 1);
+                await sink.scr_write(scr, bytesToStr(data), body[0]?.line ?? 1);
                 return true;
               } catch (_e) {
                 // ignore errors
@@ -1722,10 +1892,14 @@ function parseBlockStatement(
       ) {
         throw 'Unexpected .end statement';
       }
+      if (ds.kind === 'begin' && state.active) {
+        state.bytes.autoPoolEnd(isARM(state));
+      }
       state.dotStack.pop();
       if (ds.kind === 'begin' && state.active) {
         state.ctable.scopeEnd();
         state.bytes.scopeEnd();
+        restoreAutoPool(state);
         if (ds.arm !== isARM(state)) {
           // if we're switching Thumb <-> ARM due to .end, then realign
           state.bytes.align(ds.arm ? 2 : 4);
@@ -1768,6 +1942,7 @@ function parseLine(
   if (!state.struct) {
     // check for labels
     while (true) {
+      const flp = line.length > 0 ? line[0].flp : false;
       let label;
       try {
         label = parseLabel(line);
@@ -1792,7 +1967,14 @@ function parseLine(
           line.shift();
         }
         if (state.active) {
-          state.bytes.addLabel(label);
+          // with automatic pools, the label might move past a pool, so record where it lands
+          const name = label;
+          const onDefine = flp && label.startsWith('@')
+            ? (addr: number) => {
+              state.defs.push({ name, flp, addr });
+            }
+            : undefined;
+          state.bytes.addLabel(label, isARM(state) ? 'arm' : 'thumb', onDefine);
         }
       } else {
         break;
@@ -1955,6 +2137,55 @@ function setRegs(state: IParseState, regs: string[]) {
   state.regs = regs;
 }
 
+function isRelax(state: IParseState): boolean {
+  for (let i = state.dotStack.length - 1; i >= 0; i--) {
+    const ds = state.dotStack[i];
+    if (ds.kind === 'begin') {
+      return ds.relax;
+    }
+  }
+  return state.relax;
+}
+
+// the Bytes object reads the current setting, and the stack remembers it for each .begin block
+function setAutoPool(state: IParseState, autoPool: boolean) {
+  state.bytes.autoPool = autoPool;
+  for (let i = state.dotStack.length - 1; i >= 0; i--) {
+    const ds = state.dotStack[i];
+    if (ds.kind === 'begin') {
+      ds.autoPool = autoPool;
+      return;
+    }
+  }
+  state.autoPool = autoPool;
+}
+
+function restoreAutoPool(state: IParseState) {
+  for (let i = state.dotStack.length - 1; i >= 0; i--) {
+    const ds = state.dotStack[i];
+    if (ds.kind === 'begin') {
+      state.bytes.autoPool = ds.autoPool;
+      return;
+    }
+  }
+  state.bytes.autoPool = state.autoPool;
+}
+
+function setRelax(state: IParseState, relax: boolean) {
+  for (let i = state.dotStack.length - 1; i >= 0; i--) {
+    const ds = state.dotStack[i];
+    if (ds.kind === 'begin') {
+      ds.relax = relax;
+      return;
+    }
+  }
+  state.relax = relax;
+}
+
+// each pass can only add veneers or lengthen branches, which moves code further apart, so this
+// converges quickly
+const MAX_LAYOUT_PASSES = 8;
+
 export async function makeFromFile(
   filename: string,
   defines: { key: string; value: number }[],
@@ -1964,25 +2195,94 @@ export async function makeFromFile(
   readTextFile: (filename: string) => Promise<string>,
   readBinaryFile: (filename: string) => Promise<number[] | Uint8Array>,
   log: (str: string) => void,
+  prelexCache?: IPrelex,
+  base = 0x08000000,
 ): Promise<IMakeResult> {
+  // the include tree is lexed once, up front, and shared by every pass
+  const prelex = await prelexTree(
+    filename,
+    posix,
+    isAbsolute,
+    readTextFile,
+    navigator.hardwareConcurrency ?? 1,
+    prelexCache,
+  );
+  if (prelexCache) {
+    // keep the cache in sync with the latest tree, so it doesn't grow forever
+    prelexCache.clear();
+    for (const [key, file] of prelex) {
+      prelexCache.set(key, file);
+    }
+  }
+  const layout: ILayout = { veneers: new Set(), relaxed: new Set() };
+  for (let pass = 0; pass < MAX_LAYOUT_PASSES; pass++) {
+    // only show output from the final pass
+    const logs: string[] = [];
+    const res = await makePass(
+      filename,
+      defines,
+      posix,
+      isAbsolute,
+      fileType,
+      readTextFile,
+      readBinaryFile,
+      (str) => logs.push(str),
+      layout,
+      prelex,
+      base,
+    );
+    if ('misses' in res) {
+      for (const site of res.misses.veneers) {
+        layout.veneers.add(site);
+      }
+      for (const site of res.misses.relaxed) {
+        layout.relaxed.add(site);
+      }
+      continue;
+    }
+    for (const str of logs) {
+      log(str);
+    }
+    return res;
+  }
+  return { errors: ['Failed to lay out branches'] };
+}
+
+async function makePass(
+  filename: string,
+  defines: { key: string; value: number }[],
+  posix: boolean,
+  isAbsolute: (filename: string) => boolean,
+  fileType: (filename: string) => Promise<sink.fstype>,
+  readTextFile: (filename: string) => Promise<string>,
+  readBinaryFile: (filename: string) => Promise<number[] | Uint8Array>,
+  log: (str: string) => void,
+  layout: ILayout,
+  prelex: IPrelex,
+  base: number,
+): Promise<IMakeResult | { misses: ILayoutMisses }> {
   let data;
   try {
-    data = await readTextFile(filename);
+    data = prelex.get(filename)?.text ?? await readTextFile(filename);
   } catch (_) {
     return { errors: [`Failed to read file: ${filename}`] };
   }
 
   const linePuts: ILinePut[] = splitLines(filename, data, true);
   const lx = lexNew();
-  const bytes = new Bytes();
+  const bytes = new Bytes(layout);
+  bytes.setBase(bytes.makeBase(base));
   const state: IParseState = {
     firstARM: true,
     arm: true,
     base: bytes.getBase(),
     main: true,
     regs: defaultRegs,
+    relax: false,
+    autoPool: false,
     bytes,
     debug: [],
+    defs: [],
     ctable: new ConstTable(
       [
         '$_version',
@@ -2036,11 +2336,13 @@ export async function makeFromFile(
   }
 
   const alreadyIncluded = new Set<string>();
+  const lines: IMakeLine[] = [];
   const tokens: ITok[] = [];
   let linePut;
   while ((linePut = linePuts.shift())) {
     switch (linePut.kind) {
       case 'bytes':
+        state.bytes.autoPoolBefore(isARM(state), linePut.data.length);
         state.bytes.writeArray(linePut.data);
         break;
       case 'str': {
@@ -2067,7 +2369,15 @@ export async function makeFromFile(
                   f_warn: () => Promise.resolve(sink.NIL),
                   f_ask: () => Promise.resolve(sink.NIL),
                 });
-                loadLibIntoContext(ctx, put, state.store, linePut.main, state.ctable);
+                loadLibIntoContext(
+                  ctx,
+                  put,
+                  state.store,
+                  linePut.main,
+                  state.ctable,
+                  posix,
+                  readBinaryFile,
+                );
                 const run = await sink.ctx_run(ctx);
                 if (run === sink.run.PASS) {
                   linePuts.unshift(linePut);
@@ -2101,8 +2411,12 @@ export async function makeFromFile(
             }
           }
         } else {
-          // process assembly
-          tokens.push(...lexAddLine(lx, filename, line, data));
+          // process assembly, using the pre-lexed tokens when the line came straight from a file
+          // (scripts can output lines that claim to be from a file, so make sure it matches)
+          const pre = lexIsClean(lx) && prelex.get(filename);
+          const preTokens = pre && pre.lines[line - 1] === data &&
+            lexDecodeLine(pre, filename, line);
+          tokens.push(...(preTokens || lexAddLine(lx, filename, line, data)));
 
           const errors: string[] = [];
           if (
@@ -2122,6 +2436,8 @@ export async function makeFromFile(
             tokens.pop(); // remove newline
             if (tokens.length > 0) {
               const flp = tokens[0].flp;
+              const lineStart = state.bytes.length();
+              const lineAddr = state.bytes.nextAddress();
               try {
                 const includeEmbed = parseLine(state, tokens);
                 tokens.splice(0, tokens.length); // remove all tokens
@@ -2146,7 +2462,7 @@ export async function makeFromFile(
 
                   let data2;
                   try {
-                    data2 = await readTextFile(full);
+                    data2 = prelex.get(full)?.text ?? await readTextFile(full);
                   } catch (_) {
                     return {
                       errors: [errorString(flp, `Failed to include file: ${full}`)],
@@ -2169,8 +2485,26 @@ export async function makeFromFile(
                     };
                   }
 
+                  state.bytes.autoPoolBefore(isARM(state), data2.length);
                   state.bytes.writeArray(data2);
                 }
+                // automatic pools written while parsing the line aren't part of it
+                const lineEnd = state.bytes.length();
+                let start = lineStart;
+                const pools = state.bytes.takeAutoPools();
+                pools.push({ start: lineEnd, end: lineEnd });
+                for (const pool of pools) {
+                  if (pool.start > start) {
+                    lines.push({
+                      filename: flp.filename,
+                      line: flp.line,
+                      addr: lineAddr + start - lineStart,
+                      offset: start,
+                      size: pool.start - start,
+                    });
+                  }
+                  start = Math.max(start, pool.end);
+                }
               } catch (e) {
                 if (typeof e === 'string') {
                   return { errors: [errorString(flp, e)] };
@@ -2198,6 +2532,24 @@ export async function makeFromFile(
     };
   }
 
+  // anything left over goes at the end
+  if (state.bytes.autoPool) {
+    try {
+      state.bytes.writePool();
+    } catch (e) {
+      if (typeof e === 'string') {
+        return { errors: [e] };
+      }
+      throw e;
+    }
+  }
+
+  // branches that couldn't reach need another pass with veneers or long forms
+  const misses = state.bytes.getLayoutMisses();
+  if (misses.veneers.length > 0 || misses.relaxed.length > 0) {
+    return { misses };
+  }
+
   let result;
   try {
     result = state.bytes.get();
@@ -2207,12 +2559,33 @@ export async function makeFromFile(
     }
     throw e;
   }
-  return { result, base: state.bytes.firstBase, arm: state.firstARM, debug: state.debug };
+  const veneers = state.bytes.getVeneerCount();
+  if (veneers > 0) {
+    log(`Created ${veneers} branch veneer${veneers === 1 ? '' : 's'}`);
+  }
+  const relax = state.bytes.getRelaxStats();
+  if (relax.sites > 0) {
+    log(
+      `Relaxed ${relax.long} of ${relax.sites} branch${relax.sites === 1 ? '' : 'es'}, saving ${
+        (relax.sites - relax.long) * 2
+      } bytes`,
+    );
+  }
+  return {
+    result,
+    base: state.bytes.firstBase,
+    arm: state.firstARM,
+    debug: state.debug,
+    symbols: state.bytes.getLabels(),
+    lines,
+    defs: state.defs,
+  };
 }
 
 export function makeResult(
   input: string,
   defines: { key: string; value: number }[],
+  base?: number,
 ): Promise<IMakeResult> {
   return makeFromFile(
     input,
@@ -2233,12 +2606,16 @@ export function makeResult(
     Deno.readTextFile,
     Deno.readFile,
     (str) => console.log(str),
+    undefined,
+    base,
   );
 }
 
-export async function make({ input, output, defines }: IMakeArgs): Promise<number> {
+export async function make(
+  { input, output, defines, multiboot, patch }: IMakeArgs,
+): Promise<number> {
   try {
-    const result = await makeResult(input, defines);
+    const result = await makeResult(input, defines, multiboot ? EWRAM_START : undefined);
 
     if ('errors' in result) {
       for (const e of result.errors) {
@@ -2247,7 +2624,45 @@ export async function make({ input, output, defines }: IMakeArgs): Promise<numbe
       throw false;
     }
 
-    await Deno.writeFile(output, new Uint8Array(result.result));
+    let rom = new Uint8Array(result.result);
+    if (multiboot) {
+      try {
+        rom = multibootImage(rom);
+      } catch (e) {
+        if (typeof e === 'string') {
+          console.error(e);
+          throw false;
+        }
+        throw e;
+      }
+      console.log(
+        `Multiboot: ${rom.length} bytes (program is ${result.result.length} bytes), about ${
+          multibootTransferSeconds(rom.length).toFixed(1)
+        }s to transfer`,
+      );
+    }
+    if (patch) {
+      // diff against the old ROM before it's possibly overwritten by the new one
+      try {
+        const { changed, total, bytes, missing } = await writePatch(
+          rom,
+          patch.from,
+          patch.output,
+          patch.flash,
+        );
+        if (missing) {
+          console.log(`Patch: no previous build at ${patch.from}, so every sector is included`);
+        }
+        console.log(`Patch: ${changed} of ${total} sectors changed, ${bytes} bytes`);
+      } catch (e) {
+        if (typeof e === 'string') {
+          console.error(e);
+          throw false;
+        }
+        throw e;
+      }
+    }
+    await Deno.writeFile(output, rom);
 
     return 0;
   } catch (e) {
@@ -0,0 +1,82 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { lz77Compress } from './lz77.ts';
+
+// multiboot images are loaded into EWRAM and start at 0x020000c0; the image built here keeps the
+// program's header, but replaces the rest with a stub that decompresses the LZ77 compressed
+// program back to 0x02000000 and jumps to it
+//
+//   0x000  b @stub
+//   0x004  logo, title, etc, copied from the program
+//   0x0c0  b @stub (multiboot entry point)
+//   0x0c4  boot mode and slave ID, filled in by the BIOS
+//   0x0e0  b @stub (joybus entry point)
+//   0x0e4  @stub
+//   0x134  compressed program, then zeros to a multiple of 16 bytes
+
+export const EWRAM_START = 0x02000000;
+const EWRAM_END = 0x02040000;
+const DATA_OFFSET = 0x134;
+
+// multi-play mode at 115200 bps sends 16 data bits plus start and stop bits per halfword
+const TRANSFER_BYTES_PER_SECOND = 115200 / 18 * 2;
+
+export function multibootImage(rom: Uint8Array): Uint8Array {
+  if (rom.length < 0xc0) {
+    throw 'Multiboot program must start with a GBA header';
+  }
+  const data = lz77Compress(rom, false);
+  // the compressed data is moved to the end of EWRAM before decompressing, so they can't overlap
+  if (rom.length + data.length > EWRAM_END - EWRAM_START) {
+    throw `Multiboot program too large, ${rom.length} bytes plus ${data.length} compressed bytes ` +
+      `must fit in 256K`;
+  }
+
+  // the BIOS only sends multiboot images in 16 byte chunks
+  const image = new Uint8Array(Math.ceil((DATA_OFFSET + data.length) / 16) * 16);
+  const view = new DataView(image.buffer);
+  image.set(rom.subarray(4, 0xc0), 4);
+  const words = (offset: number, ...values: number[]) => {
+    values.forEach((v, i) => view.setUint32(offset + i * 4, v >>> 0, true));
+  };
+  const branch = (from: number, to: number) => 0xea000000 | (((to - from - 8) >> 2) & 0xffffff);
+  words(0x000, branch(0x000, 0x0e4));
+  words(0x0c0, branch(0x0c0, 0x0e4));
+  words(0x0e0, branch(0x0e0, 0x0e4));
+  // deno-fmt-ignore
+  words(0x0e4,
+    0xe59f003c, //         ldr   r0, =end of compressed data
+    0xe59f103c, //         ldr   r1, =end of EWRAM
+    0xe59f203c, //         ldr   r2, =start of compressed data
+    // copy backwards, since the regions can overlap
+    0xe5303004, // @copy:  ldr   r3, [r0, #-4]!
+    0xe5213004, //         str   r3, [r1, #-4]!
+    0xe1500002, //         cmp   r0, r2
+    0x8afffffb, //         bhi   @copy
+    // decompressing overwrites this stub, so finish from IWRAM
+    0xe28f2014, //         add   r2, pc, #(@tramp - $_pc)
+    0xe3a03403, //         mov   r3, #0x03000000
+    0xe8920070, //         ldmia r2, {r4-r6}
+    0xe8830070, //         stmia r3, {r4-r6}
+    0xe1a00001, //         mov   r0, r1
+    0xe3a01402, //         mov   r1, #0x02000000
+    0xe12fff13, //         bx    r3
+    0xef110000, // @tramp: swi   0x11 (LZ77UnCompWram)
+    0xe3a00402, //         mov   r0, #0x02000000
+    0xe12fff10, //         bx    r0
+    EWRAM_START + DATA_OFFSET + data.length,
+    EWRAM_END,
+    EWRAM_START + DATA_OFFSET,
+  );
+  image.set(data, DATA_OFFSET);
+  return image;
+}
+
+export function multibootTransferSeconds(size: number) {
+  return size / TRANSFER_BYTES_PER_SECOND;
+}
@@ -5,8 +5,9 @@
 // Project Home: https://github.com/velipso/gvasm
 //
 
-import { assertNever, isAlpha, isNum, isSpace } from './util.ts';
+import { assertNever, isAlpha, isNum, isSpace, popcount } from './util.ts';
 import { CPU, SymReader } from './run.ts';
+import { bios } from './bios.ts';
 
 type IEnum = string | false;
 
@@ -258,6 +259,193 @@ export namespace ARM {
     enum: conditionEnum,
   };
 
+  // the second operand is a register shifted by an immediate, a register shifted by a register, or
+  // a rotated immediate
+  const runDataProcessing =
+    (operand: 'shift' | 'register' | 'immediate') => (cpu: CPU, sym: SymReader) => {
+      const oper = sym('oper');
+      const s = !!sym('s');
+      const cond = sym('cond');
+      const Rd = sym('Rd');
+      const Rn = sym('Rn');
+      if (cpu.test(cond)) {
+        let b: number;
+        if (operand === 'immediate') {
+          b = cpu.rotateImmediate(sym('expression'));
+        } else if (operand === 'shift') {
+          b = cpu.shift(cpu.reg(sym('Rm')), sym('shift'), sym('amount'), false);
+        } else {
+          // reading Rs takes an internal cycle
+          cpu.idle(1);
+          b = cpu.shift(cpu.reg(sym('Rm')), sym('shift'), cpu.reg(sym('Rs')) & 0xff, true);
+        }
+        if (cpu.alu(oper, Rd, cpu.reg(Rn), b, s)) {
+          return;
+        }
+      }
+      cpu.next();
+    };
+
+  // ldr/str/ldrb/strb with an immediate or shifted register offset, either pre-indexed (written back
+  // to Rn with w) or post-indexed (always written back)
+  const runSingleDataTransfer = (register: boolean) => (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const b = sym('b');
+    const cond = sym('cond');
+    const Rd = sym('Rd');
+    const Rn = sym('Rn');
+    const p = sym('p');
+    const w = sym('w');
+    if (cpu.test(cond)) {
+      let offset = sym(register ? 'Rm' : 'offset');
+      if (register) {
+        offset = cpu.shift(cpu.reg(offset), sym('shift'), sym('amount'), false);
+        if (!sym('u')) {
+          offset = -offset;
+        }
+      }
+      const base = cpu.reg(Rn);
+      const addr = p ? base + offset : base;
+      const value = Rd === 15 ? cpu.reg(15) + 4 : cpu.reg(Rd);
+      if (!p || w) {
+        cpu.mov(Rn, base + offset);
+      }
+      if (oper) {
+        const data = cpu.load(addr, b ? 1 : 4);
+        if (Rd === 15) {
+          cpu.jump(data);
+          return;
+        }
+        cpu.mov(Rd, data);
+      } else {
+        cpu.store(addr, b ? 1 : 4, value);
+      }
+    }
+    cpu.next();
+  };
+
+  // ldrh/strh/ldrsb/ldrsh, where sh is 1 = h, 2 = sb, 3 = sh, with an immediate or register offset
+  const runHalfwordTransfer = (register: boolean) => (cpu: CPU, sym: SymReader) => {
+    const sh = sym('sh');
+    const l = sym('l');
+    const cond = sym('cond');
+    const Rd = sym('Rd');
+    const Rn = sym('Rn');
+    const p = sym('p');
+    const w = sym('w');
+    if (cpu.test(cond)) {
+      let offset = sym(register ? 'Rm' : 'offset');
+      if (register) {
+        offset = sym('u') ? cpu.reg(offset) : -cpu.reg(offset);
+      }
+      const base = cpu.reg(Rn);
+      const addr = p ? base + offset : base;
+      const value = cpu.reg(Rd);
+      if (!p || w) {
+        cpu.mov(Rn, base + offset);
+      }
+      if (l) {
+        cpu.mov(
+          Rd,
+          sh === 1
+            ? cpu.load(addr, 2)
+            : sh === 2
+            ? (cpu.load(addr, 1) << 24) >> 24
+            : (cpu.load(addr, 2) << 16) >> 16,
+        );
+      } else {
+        cpu.store(addr, 2, value);
+      }
+    }
+    cpu.next();
+  };
+
+  const runBranchExchange = (cpu: CPU, sym: SymReader) => {
+    const cond = sym('cond');
+    const Rn = sym('Rn');
+    if (cpu.test(cond)) {
+      cpu.bx(cpu.reg(Rn));
+    } else {
+      cpu.next();
+    }
+  };
+
+  // mul/mla, which don't change C or V on ARMv4 (C is actually left meaningless)
+  const runMultiply = (accumulate: boolean) => (cpu: CPU, sym: SymReader) => {
+    const s = !!sym('s');
+    const cond = sym('cond');
+    const Rd = sym('Rd');
+    if (cpu.test(cond)) {
+      const rs = cpu.reg(sym('Rs'));
+      let result = Math.imul(cpu.reg(sym('Rm')), rs);
+      if (accumulate) {
+        result = (result + cpu.reg(sym('Rn'))) | 0;
+      }
+      cpu.idle(cpu.multiplyCycles(rs) + (accumulate ? 1 : 0));
+      cpu.mov(Rd, result);
+      if (s) {
+        cpu.setZNFromValue(result);
+      }
+    }
+    cpu.next();
+  };
+
+  // umull/umlal/smull/smlal, where u is 0 = unsigned, 1 = signed
+  const runMultiplyLong = (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const signed = !!sym('u');
+    const s = !!sym('s');
+    const cond = sym('cond');
+    const RdLo = sym('RdLo');
+    const RdHi = sym('RdHi');
+    if (cpu.test(cond)) {
+      const rm = cpu.reg(sym('Rm'));
+      const rs = cpu.reg(sym('Rs'));
+      const big = (v: number) => signed ? BigInt(v) : BigInt(v >>> 0);
+      let result = big(rm) * big(rs);
+      if (oper) {
+        result += (BigInt(cpu.reg(RdHi)) << 32n) + BigInt(cpu.reg(RdLo) >>> 0);
+      }
+      cpu.idle(cpu.multiplyCycles(rs, signed) + (oper ? 2 : 1));
+      cpu.mov(RdLo, Number(BigInt.asIntN(32, result)));
+      cpu.mov(RdHi, Number(BigInt.asIntN(32, result >> 32n)));
+      if (s) {
+        cpu.setZ(BigInt.asIntN(64, result) === 0n).setN(cpu.reg(RdHi) < 0);
+      }
+    }
+    cpu.next();
+  };
+
+  // BIOS calls in ARM state take the call number from bits 16-23
+  const runSoftwareInterrupt = (cpu: CPU, sym: SymReader) => {
+    const cond = sym('cond');
+    if (cpu.test(cond)) {
+      bios(cpu, (sym('comment') >> 16) & 0xff);
+    }
+    cpu.next();
+  };
+
+  // pu is the P and U bits: 0 = da, 1 = ia, 2 = db, 3 = ib
+  const runBlockTransfer = (load: boolean) => (cpu: CPU, sym: SymReader) => {
+    const cond = sym('cond');
+    const Rn = sym('Rn');
+    const Rlist = sym('Rlist');
+    const pu = sym('pu');
+    const w = sym('w');
+    if (cpu.test(cond)) {
+      const base = cpu.reg(Rn);
+      const size = popcount(Rlist) * 4;
+      const start = pu & 1 ? base + (pu & 2 ? 4 : 0) : base - size + (pu & 2 ? 0 : 4);
+      if (w) {
+        cpu.mov(Rn, pu & 1 ? base + size : base - size);
+      }
+      if (cpu.blockTransfer(load, start, Rlist)) {
+        return;
+      }
+    }
+    cpu.next();
+  };
+
   export const ops: readonly IOp[] = Object.freeze([
     //
     // BRANCH
@@ -274,6 +462,7 @@ export namespace ARM {
         'bx$cond $Rn',
         'bx.$cond $Rn',
       ],
+      run: runBranchExchange,
     },
     {
       ref: '4.4',
@@ -294,7 +483,7 @@ export namespace ARM {
         const offset = sym('offset');
         if (cpu.test(cond)) {
           if (link) {
-            throw `Not implemented: bl`;
+            cpu.mov(14, cpu.reg(15) - 4);
           }
           cpu.bx(cpu.reg(15) + offset);
         } else {
@@ -946,42 +1135,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, $Rm, $shift #$amount',
         '$oper$cond$s $Rd, $Rm, $shift #$amount',
       ],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const s = !!sym('s');
-        const cond = sym('cond');
-        const Rd = sym('Rd');
-        const Rm = sym('Rm');
-        const shift = sym('shift');
-        const amount = sym('amount');
-        if (cpu.test(cond)) {
-          switch (oper) {
-            case 13: // mov
-              switch (shift) {
-                case 0: // lsl
-                  if (amount === 0) {
-                    cpu.mov(Rd, cpu.reg(Rm));
-                    if (s) {
-                      cpu.setZNFromReg(Rd);
-                    }
-                  } else {
-                    throw 'Not implemented: mov Rd, Rm, lsl #amount';
-                  }
-                  break;
-                case 1: // lsr
-                  throw 'Not implemented: mov Rd, Rm, lsr #amount';
-                case 2: // asr
-                  throw 'Not implemented: mov Rd, Rm, asr #amount';
-                case 3: // ror
-                  throw 'Not implemented: mov Rd, Rm, ror #amount';
-              }
-              break;
-            case 15: // mvn
-              throw 'Not implemented: mvn';
-          }
-        }
-        cpu.next();
-      },
+      run: runDataProcessing('shift'),
     },
     {
       ref: '4.5,4.5.2,4.5.8.1',
@@ -1032,6 +1186,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, $Rm, $shift $Rs',
         '$oper$cond$s $Rd, $Rm, $shift $Rs',
       ],
+      run: runDataProcessing('register'),
     },
     {
       ref: '4.5,4.5.3,4.5.8.1',
@@ -1073,30 +1228,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, #$expression',
         '$oper$cond$s $Rd, #$expression',
       ],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const s = sym('s');
-        const cond = sym('cond');
-        const Rd = sym('Rd');
-        const expression = sym('expression');
-        if (cpu.test(cond)) {
-          switch (oper) {
-            case 13: // mov
-              cpu.mov(Rd, expression);
-              break;
-            case 15: // mvn
-              cpu.mov(Rd, ~expression);
-              break;
-          }
-          if (s) {
-            if (Rd === 15) {
-              throw `Not implemented: set status when Rd is r15`;
-            }
-            cpu.setZNFromReg(Rd);
-          }
-        }
-        cpu.next();
-      },
+      run: runDataProcessing('immediate'),
     },
     // tst/teq/cmp/cmn
     {
@@ -1324,6 +1456,7 @@ export namespace ARM {
         '$oper$cond $Rn, $Rm, $shift #$amount',
         '$oper.$cond $Rn, $Rm, $shift #$amount',
       ],
+      run: runDataProcessing('shift'),
     },
     {
       ref: '4.5,4.5.2,4.5.8.2',
@@ -1373,6 +1506,7 @@ export namespace ARM {
         '$oper$cond $Rn, $Rm, $shift $Rs',
         '$oper.$cond $Rn, $Rm, $shift $Rs',
       ],
+      run: runDataProcessing('register'),
     },
     {
       ref: '4.5,4.5.3,4.5.8.2',
@@ -1413,27 +1547,7 @@ export namespace ARM {
         '$oper$cond $Rn, #$expression',
         '$oper.$cond $Rn, #$expression',
       ],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const cond = sym('cond');
-        const Rn = sym('Rn');
-        const expression = sym('expression');
-        if (cpu.test(cond)) {
-          switch (oper) {
-            case 8: // tst
-              throw `Not implemented: tst`;
-            case 9: // teq
-              throw `Not implemented: teq`;
-            case 10: // cmp
-              cpu.sub(cpu.reg(Rn), expression, true);
-              break;
-            case 11: // cmn
-              cpu.add(cpu.reg(Rn), expression, true);
-              break;
-          }
-        }
-        cpu.next();
-      },
+      run: runDataProcessing('immediate'),
     },
     // and,eor,sub,rsb,add,adc,sbc,rsc,orr,bic
     {
@@ -1854,6 +1968,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, $Rn, $Rm, $shift #$amount',
         '$oper$cond$s $Rd, $Rn, $Rm, $shift #$amount',
       ],
+      run: runDataProcessing('shift'),
     },
     {
       ref: '4.5,4.5.2,4.5.8.3',
@@ -1953,6 +2068,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, $Rn, $Rm, $shift $Rs',
         '$oper$cond$s $Rd, $Rn, $Rm, $shift $Rs',
       ],
+      run: runDataProcessing('register'),
     },
     {
       ref: '4.5,4.5.2,4.5.8.3',
@@ -2085,39 +2201,7 @@ export namespace ARM {
         '$oper$s.$cond $Rd, $Rn, #$expression',
         '$oper$cond$s $Rd, $Rn, #$expression',
       ],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const s = !!sym('s');
-        const cond = sym('cond');
-        const Rd = sym('Rd');
-        const Rn = sym('Rn');
-        const expression = sym('expression');
-        if (cpu.test(cond)) {
-          switch (oper) {
-            case 0: // and
-            case 1: // eor
-            case 12: // orr
-            case 14: // bic
-              throw `Not implemented: and/eor/orr/bic`;
-
-            case 2: // sub
-              cpu.mov(Rd, cpu.sub(cpu.reg(Rn), expression, s));
-              break;
-            case 3: // rsb
-              cpu.mov(Rd, cpu.sub(expression, cpu.reg(Rn), s));
-              break;
-            case 4: // add
-              cpu.mov(Rd, cpu.add(cpu.reg(Rn), expression, s));
-              break;
-
-            case 5: // adc
-            case 6: // sbc
-            case 7: // rsc
-              throw `Not implemented: adc/sbc/rsc`;
-          }
-        }
-        cpu.next();
-      },
+      run: runDataProcessing('immediate'),
     },
 
     //
@@ -2282,6 +2366,7 @@ export namespace ARM {
         'mul$s.$cond $Rd, $Rm, $Rs',
         'mul$cond$s $Rd, $Rm, $Rs',
       ],
+      run: runMultiply(false),
     },
     {
       ref: '4.7,4.7.4.2',
@@ -2342,6 +2427,7 @@ export namespace ARM {
         'mla$s.$cond $Rd, $Rm, $Rs, $Rn',
         'mla$cond$s $Rd, $Rm, $Rs, $Rn',
       ],
+      run: runMultiply(true),
     },
 
     //
@@ -2368,6 +2454,7 @@ export namespace ARM {
         '$u$oper$s.$cond $RdLo, $RdHi, $Rm, $Rs',
         '$u$oper$cond$s $RdLo, $RdHi, $Rm, $Rs',
       ],
+      run: runMultiplyLong,
     },
 
     //
@@ -2395,6 +2482,7 @@ export namespace ARM {
         '$oper$b.$cond $Rd, [$Rn]',
         '$oper$cond$b $Rd, [$Rn]',
       ],
+      run: runSingleDataTransfer(false),
     },
     {
       ref: '4.9,4.9.8.2.2',
@@ -2417,29 +2505,7 @@ export namespace ARM {
         '$oper$b.$cond $Rd, [#$offset]$w',
         '$oper$cond$b $Rd, [#$offset]$w',
       ],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const b = sym('b');
-        const cond = sym('cond');
-        const Rd = sym('Rd');
-        const offset = sym('offset');
-        const w = sym('w');
-        if (w) {
-          throw 'Not implemented: write back';
-        }
-        if (cpu.test(cond)) {
-          switch (oper) {
-            case 0: // str
-              throw `Not implemented: str`;
-            case 1: { // ldr
-              const addr = cpu.reg(15) + offset;
-              cpu.mov(Rd, b ? cpu.read8(addr) : cpu.read32(addr));
-              break;
-            }
-          }
-        }
-        cpu.next();
-      },
+      run: runSingleDataTransfer(false),
     },
     {
       ref: '4.9,4.9.8.2.2',
@@ -2462,6 +2528,7 @@ export namespace ARM {
         '$oper$b.$cond $Rd, [$Rn, #$offset]$w',
         '$oper$cond$b $Rd, [$Rn, #$offset]$w',
       ],
+      run: runSingleDataTransfer(false),
     },
     {
       ref: '4.9,4.9.8.2.3',
@@ -2602,6 +2669,7 @@ export namespace ARM {
         '$oper$b.$cond $Rd, [$Rn, $u$Rm, $shift #$amount]$w',
         '$oper$cond$b $Rd, [$Rn, $u$Rm, $shift #$amount]$w',
       ],
+      run: runSingleDataTransfer(true),
     },
     {
       ref: '4.9,4.9.8.3.1',
@@ -2624,6 +2692,7 @@ export namespace ARM {
         '$oper$b$w.$cond $Rd, [$Rn], #$offset',
         '$oper$cond$b$w $Rd, [$Rn], #$offset',
       ],
+      run: runSingleDataTransfer(false),
     },
     {
       ref: '4.9,4.9.8.3.2',
@@ -2764,6 +2833,7 @@ export namespace ARM {
         '$oper$b$w.$cond $Rd, [$Rn], $u$Rm, $shift #$amount',
         '$oper$cond$b$w $Rd, [$Rn], $u$Rm, $shift #$amount',
       ],
+      run: runSingleDataTransfer(true),
     },
 
     //
@@ -2794,6 +2864,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [$Rn]',
         'str$cond$sh $Rd, [$Rn]',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.2',
@@ -2819,6 +2890,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [#$offset]$w',
         'str$cond$sh $Rd, [#$offset]$w',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.2',
@@ -2844,6 +2916,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [$Rn, #$offset]$w',
         'str$cond$sh $Rd, [$Rn, #$offset]$w',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.3',
@@ -2869,6 +2942,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [$Rn, $u$Rm]$w',
         'str$cond$sh $Rd, [$Rn, $u$Rm]$w',
       ],
+      run: runHalfwordTransfer(true),
     },
     {
       ref: '4.10,4.10.8.3.1',
@@ -2894,6 +2968,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [$Rn], #$offset',
         'str$cond$sh $Rd, [$Rn], #$offset',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.3.2',
@@ -2919,6 +2994,7 @@ export namespace ARM {
         'str$sh.$cond $Rd, [$Rn], $u$Rm',
         'str$cond$sh $Rd, [$Rn], $u$Rm',
       ],
+      run: runHalfwordTransfer(true),
     },
     {
       ref: '4.10,4.10.8.2.1',
@@ -2944,6 +3020,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [$Rn]',
         'ldr$cond$sh $Rd, [$Rn]',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.2',
@@ -2969,6 +3046,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [#$offset]$w',
         'ldr$cond$sh $Rd, [#$offset]$w',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.2',
@@ -2994,6 +3072,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [$Rn, #$offset]$w',
         'ldr$cond$sh $Rd, [$Rn, #$offset]$w',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.2.3',
@@ -3019,6 +3098,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [$Rn, $u$Rm]$w',
         'ldr$cond$sh $Rd, [$Rn, $u$Rm]$w',
       ],
+      run: runHalfwordTransfer(true),
     },
     {
       ref: '4.10,4.10.8.3.1',
@@ -3044,6 +3124,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [$Rn], #$offset',
         'ldr$cond$sh $Rd, [$Rn], #$offset',
       ],
+      run: runHalfwordTransfer(false),
     },
     {
       ref: '4.10,4.10.8.3.2',
@@ -3069,6 +3150,7 @@ export namespace ARM {
         'ldr$sh.$cond $Rd, [$Rn], $u$Rm',
         'ldr$cond$sh $Rd, [$Rn], $u$Rm',
       ],
+      run: runHalfwordTransfer(true),
     },
 
     //
@@ -3092,6 +3174,7 @@ export namespace ARM {
         'push$cond $Rlist$s',
         'push.$cond $Rlist$s',
       ],
+      run: runBlockTransfer(false),
     },
     {
       ref: '4.11,4.11.9',
@@ -3116,6 +3199,7 @@ export namespace ARM {
         'stm$pu.$cond $Rn$w, $Rlist$s',
         'stm$cond$pu $Rn$w, $Rlist$s',
       ],
+      run: runBlockTransfer(false),
     },
     {
       ref: '4.11,4.11.9',
@@ -3134,6 +3218,7 @@ export namespace ARM {
         'pop$cond $Rlist$s',
         'pop.$cond $Rlist$s',
       ],
+      run: runBlockTransfer(true),
     },
     {
       ref: '4.11,4.11.9',
@@ -3158,6 +3243,7 @@ export namespace ARM {
         'ldm$pu.$cond $Rn$w, $Rlist$s',
         'ldm$cond$pu $Rn$w, $Rlist$s',
       ],
+      run: runBlockTransfer(true),
     },
 
     //
@@ -3200,6 +3286,7 @@ export namespace ARM {
         'swi$cond $comment',
         'swi.$cond $comment',
       ],
+      run: runSoftwareInterrupt,
     },
   ]);
 
@@ -3306,6 +3393,118 @@ export namespace Thumb {
     run?(cpu: CPU, sym: SymReader): void;
   }
 
+  // formats 9 and 10 only differ by transfer size
+  const runLoadStore = (size: 1 | 2 | 4) => (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const Rd = sym('Rd');
+    const addr = cpu.reg(sym('Rb')) + sym('offset');
+    if (oper) {
+      cpu.mov(Rd, cpu.load(addr, size));
+    } else {
+      cpu.store(addr, size, cpu.reg(Rd));
+    }
+    cpu.next();
+  };
+
+  const runMoveShifted = (cpu: CPU, sym: SymReader) => {
+    const Rd = sym('Rd');
+    cpu.alu(13, Rd, 0, cpu.shift(cpu.reg(sym('Rs')), sym('oper'), sym('shift'), false), true);
+    cpu.next();
+  };
+
+  // format 4 operations that map directly to ARM data processing operations, otherwise -1
+  const aluOperations = [0, 1, -1, -1, -1, 5, 6, -1, 8, 3, 10, 11, 12, -1, 14, 15];
+
+  const runALU = (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const Rd = sym('Rd');
+    const Rs = sym('Rs');
+    switch (oper) {
+      case 2: // lsls
+      case 3: // lsrs
+      case 4: // asrs
+      case 7: // rors
+        cpu.idle(1);
+        cpu.alu(
+          13,
+          Rd,
+          0,
+          cpu.shift(cpu.reg(Rd), oper === 7 ? 3 : oper - 2, cpu.reg(Rs) & 0xff, true),
+          true,
+        );
+        break;
+      case 9: // negs
+        cpu.alu(3, Rd, cpu.reg(Rs), 0, true);
+        break;
+      case 13: // muls
+        cpu.idle(cpu.multiplyCycles(cpu.reg(Rd)));
+        cpu.mov(Rd, Math.imul(cpu.reg(Rd), cpu.reg(Rs)));
+        cpu.setZNFromReg(Rd);
+        break;
+      default:
+        // a shift by 0 leaves the carry for logical operations
+        cpu.alu(aluOperations[oper], Rd, cpu.reg(Rd), cpu.shift(cpu.reg(Rs), 0, 0, true), true);
+        break;
+    }
+    cpu.next();
+  };
+
+  // add/cmp/mov where either register can be r8-r15; only cmp sets status
+  const runHiRegister = (dst: string, src: string) => (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const Rd = sym(dst);
+    const value = cpu.shift(cpu.reg(sym(src)), 0, 0, true);
+    if (!cpu.alu([4, 10, 13][oper], Rd, cpu.reg(Rd), value, oper === 1)) {
+      cpu.next();
+    }
+  };
+
+  const runBranchExchange = (src: string) => (cpu: CPU, sym: SymReader) => {
+    cpu.bx(cpu.reg(sym(src)));
+  };
+
+  const runRegisterOffset = (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const size = sym('b') ? 1 : 4;
+    const Rd = sym('Rd');
+    const addr = cpu.reg(sym('Rb')) + cpu.reg(sym('Ro'));
+    if (oper) {
+      cpu.mov(Rd, cpu.load(addr, size));
+    } else {
+      cpu.store(addr, size, cpu.reg(Rd));
+    }
+    cpu.next();
+  };
+
+  // strh/ldrh, or with s, ldsb/ldsh
+  const runSignExtended = (s: boolean) => (cpu: CPU, sym: SymReader) => {
+    const oper = sym('oper');
+    const Rd = sym('Rd');
+    const addr = cpu.reg(sym('Rb')) + cpu.reg(sym('Ro'));
+    if (s) {
+      cpu.mov(
+        Rd,
+        oper ? (cpu.load(addr, 2) << 16) >> 16 : (cpu.load(addr, 1) << 24) >> 24,
+      );
+    } else if (oper) {
+      cpu.mov(Rd, cpu.load(addr, 2));
+    } else {
+      cpu.store(addr, 2, cpu.reg(Rd));
+    }
+    cpu.next();
+  };
+
+  // push/pop use r = 1 to include lr/pc
+  const runPushPop = (load: boolean) => (cpu: CPU, sym: SymReader) => {
+    const Rlist = sym('Rlist') | (sym('r') ? 1 << (load ? 15 : 14) : 0);
+    const size = popcount(Rlist) * 4;
+    const sp = cpu.reg(13);
+    cpu.mov(13, load ? sp + size : sp - size);
+    if (!cpu.blockTransfer(load, load ? sp : sp - size, Rlist)) {
+      cpu.next();
+    }
+  };
+
   export const ops: readonly IOp[] = Object.freeze([
     //
     // FORMAT 1: MOVE SHIFTED REGISTER
@@ -3344,6 +3543,7 @@ export namespace Thumb {
         { s: 3, k: 'value', v: 0 },
       ],
       syntax: ['$oper $Rd, $Rs, #$shift'],
+      run: runMoveShifted,
     },
 
     //
@@ -3547,49 +3747,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 16 },
       ],
       syntax: ['$oper $Rd, $Rs'],
-      run: (cpu: CPU, sym: SymReader) => {
-        const oper = sym('oper');
-        const Rd = sym('Rd');
-        const Rs = sym('Rs');
-        switch (oper) {
-          case 0: // ands
-            throw 'Not implemented: ands';
-          case 1: // eors
-            throw 'Not implemented: eors';
-          case 2: // lsls
-            throw 'Not implemented: lsls';
-          case 3: // lsrs
-            throw 'Not implemented: lsrs';
-          case 4: // asrs
-            throw 'Not implemented: asrs';
-          case 5: // adcs
-            throw 'Not implemented: adcs';
-          case 6: // sbcs
-            throw 'Not implemented: sbcs';
-          case 7: // rors
-            throw 'Not implemented: rors';
-          case 8: // tst
-            throw 'Not implemented: tst';
-          case 9: // negs
-            throw 'Not implemented: negs';
-          case 10: // cmp
-            throw 'Not implemented: cmp';
-          case 11: // cmn
-            throw 'Not implemented: cmn';
-          case 12: // orrs
-            throw 'Not implemented: orrs';
-          case 13: // muls
-            cpu.mov(Rd, Math.imul(cpu.reg(Rd), cpu.reg(Rs)));
-            cpu.setZNFromReg(Rd);
-            cpu.setC(false);
-            break;
-          case 14: // bics
-            throw 'Not implemented: bics';
-          case 15: // mvns
-            throw 'Not implemented: mvns';
-        }
-        cpu.next();
-      },
+      run: runALU,
     },
 
     //
@@ -3621,6 +3779,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 17 },
       ],
       syntax: ['$oper $Rd, $Hs'],
+      run: runHiRegister('Rd', 'Hs'),
     },
     {
       ref: '5.5',
@@ -3634,6 +3793,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 17 },
       ],
       syntax: ['$oper $Hd, $Rs'],
+      run: runHiRegister('Hd', 'Rs'),
     },
     {
       ref: '5.5',
@@ -3647,6 +3807,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 17 },
       ],
       syntax: ['$oper $Hd, $Hs'],
+      run: runHiRegister('Hd', 'Hs'),
     },
     {
       ref: '5.5',
@@ -3660,6 +3821,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 17 },
       ],
       syntax: ['bx $Rs'],
+      run: runBranchExchange('Rs'),
     },
     {
       ref: '5.5',
@@ -3673,6 +3835,7 @@ export namespace Thumb {
         { s: 6, k: 'value', v: 17 },
       ],
       syntax: ['bx $Hs'],
+      run: runBranchExchange('Hs'),
     },
 
     //
@@ -3711,8 +3874,8 @@ export namespace Thumb {
       run: (cpu: CPU, sym: SymReader) => {
         const Rd = sym('Rd');
         const offset = sym('offset');
-        const addr = cpu.reg(15) + offset;
-        cpu.mov(Rd, cpu.read32(addr));
+        const addr = (cpu.reg(15) & ~2) + offset;
+        cpu.mov(Rd, cpu.load(addr, 4));
         cpu.next();
       },
     },
@@ -3734,6 +3897,7 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 5 },
       ],
       syntax: ['$oper$b $Rd, [$Rb, $Ro]'],
+      run: runRegisterOffset,
     },
 
     //
@@ -3753,6 +3917,7 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 5 },
       ],
       syntax: ['$oper $Rd, [$Rb, $Ro]'],
+      run: runSignExtended(false),
     },
     {
       ref: '5.8',
@@ -3767,6 +3932,7 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 5 },
       ],
       syntax: ['$oper $Rd, [$Rb, $Ro]'],
+      run: runSignExtended(true),
     },
 
     //
@@ -3785,6 +3951,7 @@ export namespace Thumb {
         { s: 3, k: 'value', v: 3 },
       ],
       syntax: ['$oper $Rd, [$Rb]'],
+      run: runLoadStore(4),
     },
     {
       ref: '5.9',
@@ -3798,6 +3965,7 @@ export namespace Thumb {
         { s: 3, k: 'value', v: 3 },
       ],
       syntax: ['$oper $Rd, [$Rb, #$offset]'],
+      run: runLoadStore(4),
     },
     {
       ref: '5.9',
@@ -3811,6 +3979,7 @@ export namespace Thumb {
         { s: 3, k: 'value', v: 3 },
       ],
       syntax: ['$oper $Rd, [$Rb]'],
+      run: runLoadStore(1),
     },
     {
       ref: '5.9',
@@ -3824,6 +3993,7 @@ export namespace Thumb {
         { s: 3, k: 'value', v: 3 },
       ],
       syntax: ['$oper $Rd, [$Rb, #$offset]'],
+      run: runLoadStore(1),
     },
 
     //
@@ -3841,6 +4011,7 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 8 },
       ],
       syntax: ['$oper $Rd, [$Rb]'],
+      run: runLoadStore(2),
     },
     {
       ref: '5.10',
@@ -3853,6 +4024,7 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 8 },
       ],
       syntax: ['$oper $Rd, [$Rb, #$offset]'],
+      run: runLoadStore(2),
     },
 
     //
@@ -3886,10 +4058,10 @@ export namespace Thumb {
         const offset = sym('offset');
         switch (oper) {
           case 0: // str
-            cpu.write32(cpu.reg(13) + offset, cpu.reg(Rd));
+            cpu.store(cpu.reg(13) + offset, 4, cpu.reg(Rd));
             break;
           case 1: // ldr
-            cpu.mov(Rd, cpu.read32(cpu.reg(13) + offset));
+            cpu.mov(Rd, cpu.load(cpu.reg(13) + offset, 4));
             break;
         }
         cpu.next();
@@ -3910,6 +4082,13 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 10 },
       ],
       syntax: ['add $Rd, $Rs, #$offset'],
+      run: (cpu: CPU, sym: SymReader) => {
+        const Rd = sym('Rd');
+        const Rs = sym('Rs');
+        const offset = sym('offset');
+        cpu.mov(Rd, (Rs ? cpu.reg(13) : cpu.reg(15) & ~2) + offset);
+        cpu.next();
+      },
     },
 
     //
@@ -3945,6 +4124,10 @@ export namespace Thumb {
         { s: 8, k: 'value', v: 176 },
       ],
       syntax: ['add sp, #$offset'],
+      run: (cpu: CPU, sym: SymReader) => {
+        cpu.mov(13, cpu.reg(13) + sym('offset'));
+        cpu.next();
+      },
     },
     {
       ref: '5.13',
@@ -3955,6 +4138,10 @@ export namespace Thumb {
         { s: 8, k: 'value', v: 176 },
       ],
       syntax: ['sub sp, #$offset'],
+      run: (cpu: CPU, sym: SymReader) => {
+        cpu.mov(13, cpu.reg(13) - sym('offset'));
+        cpu.next();
+      },
     },
 
     //
@@ -3976,6 +4163,7 @@ export namespace Thumb {
         'stmdb sp!, $Rlist',
         'stmfd sp!, $Rlist',
       ],
+      run: runPushPop(false),
     },
     {
       ref: '5.14',
@@ -3992,6 +4180,7 @@ export namespace Thumb {
         'stmdb sp!, $Rlist',
         'stmfd sp!, $Rlist',
       ],
+      run: runPushPop(false),
     },
     {
       ref: '5.14',
@@ -4008,6 +4197,7 @@ export namespace Thumb {
         'ldmia sp!, $Rlist',
         'ldmfd sp!, $Rlist',
       ],
+      run: runPushPop(true),
     },
     {
       ref: '5.14',
@@ -4024,6 +4214,7 @@ export namespace Thumb {
         'ldmia sp!, $Rlist',
         'ldmfd sp!, $Rlist',
       ],
+      run: runPushPop(true),
     },
 
     //
@@ -4040,6 +4231,15 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 12 },
       ],
       syntax: ['$oper $Rb!, $Rlist'],
+      run: (cpu: CPU, sym: SymReader) => {
+        const oper = sym('oper');
+        const Rb = sym('Rb');
+        const Rlist = sym('Rlist');
+        const base = cpu.reg(Rb);
+        cpu.mov(Rb, base + popcount(Rlist) * 4);
+        cpu.blockTransfer(oper === 1, base, Rlist);
+        cpu.next();
+      },
     },
 
     //
@@ -4100,6 +4300,10 @@ export namespace Thumb {
         { s: 8, k: 'value', v: 223 },
       ],
       syntax: ['swi $comment'],
+      run: (cpu: CPU, sym: SymReader) => {
+        bios(cpu, sym('comment'));
+        cpu.next();
+      },
     },
 
     //
@@ -4117,6 +4321,9 @@ export namespace Thumb {
         'b $offset',
         'bal $offset',
       ],
+      run: (cpu: CPU, sym: SymReader) => {
+        cpu.bx(cpu.reg(15) + sym('offset') + 1);
+      },
     },
 
     //
@@ -4146,6 +4353,14 @@ export namespace Thumb {
         { s: 4, k: 'value', v: 15 },
       ],
       syntax: ['bl $offset'],
+      run: (cpu: CPU, sym: SymReader) => {
+        // the 22-bit offset is in halfwords
+        const offset = (sym('offset') << 10) >> 9;
+        // pc is 4 bytes ahead of the first half, so it's already the return address
+        const ret = cpu.reg(15);
+        cpu.mov(14, ret | 1);
+        cpu.bx((ret + offset) | 1);
+      },
     },
   ]);
 
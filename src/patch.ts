@@ -0,0 +1,156 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+// flash carts can only erase whole sectors, so a patch contains every sector that differs from the
+// previous build, and the flashing tool can skip the rest
+//
+// patch format (little-endian):
+//   u32  magic 'GVPT'
+//   u32  length of the new ROM
+//   u32  number of sectors that follow
+//   then for each sector:
+//     u32  offset into the ROM
+//     u32  length of data (the sector size, or less for the last sector of the ROM)
+//     u8[] new data
+
+// sector layouts, listed from the lowest address, from the datasheets in mirror/
+export const flashChips: { [name: string]: { count: number; size: number }[] } = {
+  // uniform 64 Kword sectors
+  's29gl': [{ count: 512, size: 0x20000 }],
+  'm29w128g': [{ count: 128, size: 0x20000 }],
+  // 127 main blocks of 32 Kword, and 8 parameter blocks of 4 Kword at the top or bottom
+  'm58wr064ft': [{ count: 127, size: 0x10000 }, { count: 8, size: 0x2000 }],
+  'm58wr064fb': [{ count: 8, size: 0x2000 }, { count: 127, size: 0x10000 }],
+  'm36w0r6030t0': [{ count: 127, size: 0x10000 }, { count: 8, size: 0x2000 }],
+  'm36w0r6030b0': [{ count: 8, size: 0x2000 }, { count: 127, size: 0x10000 }],
+};
+
+function* sectors(chip: string, length: number) {
+  let start = 0;
+  for (const { count, size } of flashChips[chip]) {
+    for (let i = 0; i < count && start < length; i++) {
+      yield { start, size };
+      start += size;
+    }
+  }
+  if (start < length) {
+    throw `ROM is larger than the flash chip ${chip}`;
+  }
+}
+
+export type PatchRead = (buf: Uint8Array) => Promise<number | null>;
+
+async function readFull(read: PatchRead, buf: Uint8Array): Promise<number> {
+  let total = 0;
+  while (total < buf.length) {
+    const n = await read(buf.subarray(total));
+    if (n === null) {
+      break;
+    }
+    total += n;
+  }
+  return total;
+}
+
+async function writeFull(file: Deno.File, buf: Uint8Array) {
+  for (let i = 0; i < buf.length;) {
+    i += await file.write(buf.subarray(i));
+  }
+}
+
+function u32(...values: number[]): Uint8Array {
+  const out = new Uint8Array(values.length * 4);
+  const view = new DataView(out.buffer);
+  values.forEach((v, i) => view.setUint32(i * 4, v, true));
+  return out;
+}
+
+export interface IPatchSector {
+  start: number;
+  length: number;
+}
+
+// streams the old ROM a sector at a time, so only the new ROM needs to be in memory; without an
+// old ROM, every sector is changed
+export async function diffSectors(
+  rom: Uint8Array,
+  chip: string,
+  read: PatchRead | false,
+): Promise<{ changed: IPatchSector[]; total: number }> {
+  if (!(chip in flashChips)) {
+    throw `Unknown flash chip: ${chip}`;
+  }
+  const changed: IPatchSector[] = [];
+  let total = 0;
+  let oldBuf = new Uint8Array(0);
+  for (const { start, size } of sectors(chip, rom.length)) {
+    const length = Math.min(size, rom.length - start);
+    total++;
+    if (!read) {
+      changed.push({ start, length });
+      continue;
+    }
+    if (oldBuf.length !== size) {
+      oldBuf = new Uint8Array(size);
+    }
+    // read the whole sector, even past the end of the new ROM, to stay in sync with the file
+    const oldLen = await readFull(read, oldBuf);
+    let same = oldLen >= length;
+    for (let i = 0; same && i < length; i++) {
+      same = oldBuf[i] === rom[start + i];
+    }
+    if (!same) {
+      changed.push({ start, length });
+    }
+  }
+  return { changed, total };
+}
+
+// the patch file in pieces, so the sector data doesn't need to be copied
+export function patchChunks(rom: Uint8Array, changed: IPatchSector[]): Uint8Array[] {
+  const out = [u32(0x54505647, rom.length, changed.length)];
+  for (const { start, length } of changed) {
+    out.push(u32(start, length), rom.subarray(start, start + length));
+  }
+  return out;
+}
+
+export async function writePatch(
+  rom: Uint8Array,
+  oldFile: string,
+  patchFile: string,
+  chip: string,
+): Promise<{ changed: number; total: number; bytes: number; missing: boolean }> {
+  let old: Deno.File | false = false;
+  try {
+    old = await Deno.open(oldFile, { read: true });
+  } catch (e) {
+    if (!(e instanceof Deno.errors.NotFound)) {
+      throw `Failed to read previous build: ${oldFile}`;
+    }
+    // first build, so the whole ROM needs to be flashed
+  }
+  try {
+    const file = old;
+    const { changed, total } = await diffSectors(rom, chip, file && ((buf) => file.read(buf)));
+    const out = await Deno.open(patchFile, { write: true, create: true, truncate: true });
+    try {
+      let bytes = 0;
+      for (const buf of patchChunks(rom, changed)) {
+        await writeFull(out, buf);
+        bytes += buf.length;
+      }
+      return { changed: changed.length, total, bytes, missing: !old };
+    } finally {
+      out.close();
+    }
+  } finally {
+    if (old) {
+      old.close();
+    }
+  }
+}
@@ -0,0 +1,110 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { IAccessWatcher } from './run.ts';
+import { IMakeLine } from './make.ts';
+
+// watches `gvasm run` for code that works, but is slow (or subtly broken) on hardware, and reports
+// each finding against the source line that caused it
+
+interface IFinding {
+  message: string;
+  pc: number;
+  count: number;
+}
+
+// a load from the same ROM address by the same instruction this many times is a loop constant
+const ROM_CONSTANT_REPEATS = 16;
+
+function isROM(addr: number) {
+  // game pak ROM and its wait state mirrors, but not EEPROM or SRAM
+  return addr >= 0x08000000 && addr < 0x0d000000;
+}
+
+export class PerfLint implements IAccessWatcher {
+  private lines: IMakeLine[];
+  private pc = 0;
+  private findings = new Map<string, IFinding>();
+  private romReads = new Map<string, { pc: number; count: number }>();
+
+  constructor(lines: IMakeLine[]) {
+    this.lines = lines;
+  }
+
+  private add(message: string, pc = this.pc, count = 1) {
+    const key = `${pc}:${message}`;
+    const finding = this.findings.get(key);
+    if (finding) {
+      finding.count += count;
+    } else {
+      this.findings.set(key, { message, pc, count });
+    }
+  }
+
+  public step(pc: number, arm: boolean) {
+    this.pc = pc;
+    if (arm && isROM(pc)) {
+      this.add('ARM code running from 16-bit ROM, use Thumb or copy it to IWRAM');
+    }
+  }
+
+  public access(addr: number, size: 1 | 2 | 4, write: boolean) {
+    addr = addr >>> 0;
+    if (write && size === 1 && (addr >>> 24 === 0x06 || addr >>> 24 === 0x07)) {
+      this.add('8-bit write to VRAM/OAM, which hardware ignores or writes to both bytes');
+    }
+    if (addr & (size - 1)) {
+      this.add(`Unaligned ${size * 8}-bit ${write ? 'store' : 'load'}`);
+    }
+    if (!write && isROM(addr)) {
+      const key = `${this.pc}:${addr}`;
+      const read = this.romReads.get(key);
+      if (read) {
+        read.count++;
+      } else {
+        this.romReads.set(key, { pc: this.pc, count: 1 });
+      }
+    }
+  }
+
+  public block(addr: number, size: number, _write: boolean) {
+    addr = addr >>> 0;
+    if (size > 0 && addr >>> 24 !== (addr + size - 1) >>> 24) {
+      this.add('ldm/stm crosses a memory region boundary');
+    }
+  }
+
+  private where(pc: number) {
+    for (const ln of this.lines) {
+      if (pc >= ln.addr && pc < ln.addr + ln.size) {
+        return `${ln.filename}:${ln.line}`;
+      }
+    }
+    return `0x${(pc >>> 0).toString(16).padStart(8, '0')}`;
+  }
+
+  public report(): string[] {
+    for (const { pc, count } of this.romReads.values()) {
+      if (count >= ROM_CONSTANT_REPEATS) {
+        this.add('Loop reads a constant from ROM, keep it in a register or IWRAM', pc, count);
+      }
+    }
+    this.romReads.clear();
+    if (this.findings.size <= 0) {
+      return [];
+    }
+    const findings = Array.from(this.findings.values()).sort((a, b) =>
+      b.count - a.count || a.pc - b.pc
+    );
+    return [
+      'Performance lint:',
+      ...findings.map(({ message, pc, count }) =>
+        `  ${this.where(pc)}: ${message} (${count} time${count === 1 ? '' : 's'})`
+      ),
+    ];
+  }
+}
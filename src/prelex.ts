@@ -0,0 +1,181 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { ILexBuffers, lexEncodeFile } from './lexer.ts';
+import { pathDirname, pathJoin } from './deps.ts';
+import { splitLines } from './util.ts';
+
+// lexing is independent of assembly, so the include tree can be read and lexed up front, in
+// parallel, while assembly still processes the lines strictly in order
+
+export interface IPrelexFile extends ILexBuffers {
+  text: string;
+  lines: string[];
+  includes: string[];
+}
+
+export type IPrelex = Map<string, IPrelexFile>;
+
+type ILexResult = ILexBuffers & { includes: string[] };
+
+interface IJob {
+  filename: string;
+  text: string;
+  resolve: (res: ILexResult) => void;
+}
+
+// a warm rebuild usually only has a file or two that changed, which is quicker to lex inline than
+// to start a worker for
+const WARM_INLINE_FILES = 2;
+
+function startWorker(): Worker | false {
+  try {
+    return new Worker(new URL('./lexworker.ts', import.meta.url).href, { type: 'module' });
+  } catch (_) {
+    return false;
+  }
+}
+
+class LexPool {
+  private size: number;
+  private workers: Worker[] = [];
+  private idle: Worker[] = [];
+  private busy = new Map<Worker, IJob>();
+  private queue: IJob[] = [];
+  private failed = false;
+
+  constructor(size: number) {
+    this.size = size;
+  }
+
+  public lex(filename: string, text: string, inline: boolean): Promise<ILexResult> {
+    if (inline || this.failed || this.size <= 0) {
+      return Promise.resolve(lexEncodeFile(filename, text));
+    }
+    return new Promise((resolve) => {
+      this.queue.push({ filename, text, resolve });
+      this.pump();
+    });
+  }
+
+  private pump() {
+    while (this.queue.length > 0) {
+      let worker = this.idle.pop();
+      if (!worker && this.workers.length < this.size) {
+        worker = this.spawn();
+      }
+      if (!worker) {
+        return;
+      }
+      const job = this.queue.shift() as IJob;
+      this.busy.set(worker, job);
+      worker.postMessage({ filename: job.filename, text: job.text });
+    }
+  }
+
+  private spawn(): Worker | undefined {
+    const worker = startWorker();
+    if (!worker) {
+      this.fail();
+      return;
+    }
+    worker.onmessage = (e: MessageEvent<ILexResult>) => {
+      const job = this.busy.get(worker);
+      if (job) {
+        this.busy.delete(worker);
+        this.idle.push(worker);
+        job.resolve(e.data);
+        this.pump();
+      }
+    };
+    worker.onerror = (e: ErrorEvent) => {
+      e.preventDefault();
+      this.fail();
+    };
+    this.workers.push(worker);
+    return worker;
+  }
+
+  // if workers aren't available (permissions, embedded runtimes, etc), lex on this thread instead
+  private fail() {
+    this.failed = true;
+    const jobs = [...this.busy.values(), ...this.queue];
+    this.busy.clear();
+    this.queue = [];
+    this.close();
+    for (const job of jobs) {
+      job.resolve(lexEncodeFile(job.filename, job.text));
+    }
+  }
+
+  public close() {
+    for (const worker of this.workers) {
+      worker.terminate();
+    }
+    this.workers = [];
+    this.idle = [];
+  }
+}
+
+export async function prelexTree(
+  filename: string,
+  posix: boolean,
+  isAbsolute: (filename: string) => boolean,
+  readTextFile: (filename: string) => Promise<string>,
+  workers: number,
+  previous: IPrelex = new Map(),
+): Promise<IPrelex> {
+  const files: IPrelex = new Map();
+  const seen = new Set<string>();
+  const pool = new LexPool(workers);
+  let inlineFiles = previous.size > 0 ? WARM_INLINE_FILES : 0;
+
+  const visit = async (full: string, root: boolean): Promise<void> => {
+    if (seen.has(full)) {
+      return;
+    }
+    seen.add(full);
+    let text;
+    try {
+      text = await readTextFile(full);
+    } catch (_) {
+      // assembly will report the error, if the include is actually reached
+      return;
+    }
+    // reuse the results from a previous build if the file hasn't changed
+    let file = previous.get(full);
+    if (!file || file.text !== text) {
+      // a single file isn't worth starting a worker for, so only includes are sent to the pool,
+      // and only once a rebuild has more changes than a typical edit
+      const inline = root || inlineFiles-- > 0;
+      const { toks, chars, includes } = await pool.lex(full, text, inline);
+      file = {
+        text,
+        lines: splitLines(full, text, false).map(({ data }) => data),
+        includes,
+        toks,
+        chars,
+      };
+    }
+    files.set(full, file);
+    await Promise.all(
+      file.includes.map((include) =>
+        visit(
+          isAbsolute(include) ? include : pathJoin(posix, pathDirname(posix, full), include),
+          false,
+        )
+      ),
+    );
+  };
+
+  try {
+    await visit(filename, true);
+  } finally {
+    pool.close();
+  }
+  return files;
+}
@@ -0,0 +1,66 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+// run-length encoding in the format understood by the BIOS RLUnCompWram/RLUnCompVram functions
+//
+//   u32  0x30 | (decompressed size << 8)
+//   then blocks starting with a flag byte:
+//     0x80 | (length - 3)  followed by one byte repeated length times (3..130)
+//     length - 1           followed by length literal bytes (1..128)
+
+const MIN_RUN = 3;
+const MAX_RUN = 130;
+const MAX_LITERALS = 128;
+
+export function rleCompress(data: Uint8Array): Uint8Array {
+  if (data.length >= 1 << 24) {
+    throw 'Data too large to compress with RLE';
+  }
+  const out: number[] = [
+    0x30,
+    data.length & 0xff,
+    (data.length >> 8) & 0xff,
+    (data.length >> 16) & 0xff,
+  ];
+
+  let literals = 0;
+  const flushLiterals = (end: number) => {
+    if (literals > 0) {
+      out.push(literals - 1);
+      for (let i = end - literals; i < end; i++) {
+        out.push(data[i]);
+      }
+      literals = 0;
+    }
+  };
+
+  let i = 0;
+  while (i < data.length) {
+    let run = 1;
+    while (run < MAX_RUN && i + run < data.length && data[i + run] === data[i]) {
+      run++;
+    }
+    if (run >= MIN_RUN) {
+      flushLiterals(i);
+      out.push(0x80 | (run - MIN_RUN), data[i]);
+      i += run;
+    } else {
+      literals++;
+      i++;
+      if (literals >= MAX_LITERALS) {
+        flushLiterals(i);
+      }
+    }
+  }
+  flushLiterals(i);
+
+  // the BIOS expects the source to be word aligned, so keep the size a multiple of 4 too
+  while (out.length % 4) {
+    out.push(0);
+  }
+  return new Uint8Array(out);
+}
@@ -7,11 +7,23 @@
 
 import { IDebugStatement, makeResult } from './make.ts';
 import { parseARM, parseThumb } from './dis.ts';
-import { assertNever, hex16, hex32, printf } from './util.ts';
+import { assertNever, hex16, hex32, popcount, printf } from './util.ts';
+import { createSaveDevice, detectSaveType, SaveType } from './save.ts';
+import { PerfLint } from './perflint.ts';
+import { Timers } from './timers.ts';
 
 export interface IRunArgs {
   input: string;
   defines: { key: string; value: number }[];
+  save: SaveType | false;
+  perfLint: boolean;
+}
+
+// memory-mapped hardware, addressed by offset from the start of its region
+export interface IMemoryDevice {
+  read8(offset: number): number;
+  write8(offset: number, value: number): void;
+  endDMA?(): void;
 }
 
 interface IMemoryRegion {
@@ -19,10 +31,17 @@ interface IMemoryRegion {
   size: number;
   ram?: number[];
   rom?: readonly number[];
+  device?: IMemoryDevice;
 }
 
 export type SymReader = (name: string) => number;
 
+// sees the memory accessed by instructions, but not instruction fetches or DMA
+export interface IAccessWatcher {
+  access(addr: number, size: 1 | 2 | 4, write: boolean): void;
+  block(addr: number, size: number, write: boolean): void;
+}
+
 const V = 0x10000000;
 const C = 0x20000000;
 const Z = 0x40000000;
@@ -32,6 +51,17 @@ export class CPU {
   private memory: IMemoryRegion[] = [];
   // deno-fmt-ignore
   private regs: number[] = [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0];
+  // cycles follow GBATEK's memory timing: instruction fetches and data accesses cost the wait
+  // states of their region, plus internal cycles and pipeline refills; the game pak prefetch buffer
+  // isn't emulated, so code in ROM runs a little slower than on hardware with prefetch enabled
+  public cycles = 0;
+  public watcher: IAccessWatcher | false = false;
+  // WAITCNT, which sets the game pak and SRAM wait states
+  private waitcnt = 0;
+  // data accesses after the first one in an instruction are sequential
+  private sequential = false;
+  // carry out of the barrel shifter, for logical operations that set status
+  private shifterCarry = false;
 
   public reg(n: number) {
     return this.regs[n];
@@ -49,10 +79,25 @@ export class CPU {
     this.memory.push({ addr, size });
   }
 
+  public addDevice(addr: number, size: number, device: IMemoryDevice) {
+    this.memory.push({ addr, size, device });
+  }
+
+  private region(addr: number): IMemoryRegion | undefined {
+    for (const m of this.memory) {
+      if (addr >= m.addr && addr < m.addr + m.size) {
+        return m;
+      }
+    }
+  }
+
   public read8(addr: number): number {
+    addr = addr >>> 0;
     for (const m of this.memory) {
       if (addr >= m.addr && addr < m.addr + m.size) {
-        if (m.ram) {
+        if (m.device) {
+          return m.device.read8(addr - m.addr) & 0xff;
+        } else if (m.ram) {
           return m.ram[addr - m.addr];
         } else if (m.rom) {
           return m.rom[addr - m.addr];
@@ -81,8 +126,13 @@ export class CPU {
   }
 
   public write8(addr: number, value: number) {
+    addr = addr >>> 0;
     for (const m of this.memory) {
       if (addr >= m.addr && addr < m.addr + m.size) {
+        if (m.device) {
+          m.device.write8(addr - m.addr, value & 0xff);
+          return;
+        }
         if (m.rom) {
           return;
         }
@@ -92,6 +142,11 @@ export class CPU {
           m.ram = ram;
         }
         ram[addr - m.addr] = value & 0xff;
+        if (addr === 0x040000df && (value & 0x80)) {
+          this.dma3();
+        } else if (addr === 0x04000204 || addr === 0x04000205) {
+          this.waitcnt = ram[0x204] | (ram[0x205] << 8);
+        }
         return;
       }
     }
@@ -99,14 +154,160 @@ export class CPU {
 
   public write16(addr: number, value: number) {
     this.write8(addr, value & 0xff);
-    this.write8(addr + 2, (value >>> 8) & 0xff);
+    this.write8(addr + 1, (value >>> 8) & 0xff);
   }
 
   public write32(addr: number, value: number) {
     this.write8(addr, value & 0xff);
-    this.write8(addr + 2, (value >>> 8) & 0xff);
-    this.write8(addr + 4, (value >>> 16) & 0xff);
-    this.write8(addr + 6, (value >>> 24) & 0xff);
+    this.write8(addr + 1, (value >>> 8) & 0xff);
+    this.write8(addr + 2, (value >>> 16) & 0xff);
+    this.write8(addr + 3, (value >>> 24) & 0xff);
+  }
+
+  // unaligned loads read the aligned word or halfword, rotated so the addressed byte is lowest
+  public load(addr: number, size: 1 | 2 | 4): number {
+    if (this.watcher) {
+      this.watcher.access(addr, size, false);
+    }
+    if (!this.sequential) {
+      // loads take an internal cycle to write the register
+      this.cycles++;
+    }
+    this.cycles += this.accessCycles(addr, size, this.sequential);
+    this.sequential = true;
+    const value = this.read(addr & ~(size - 1), size);
+    const rot = (addr & (size - 1)) * 8;
+    if (rot === 0) {
+      return value;
+    }
+    return size === 4
+      ? (value >>> rot) | (value << (32 - rot))
+      : ((value >>> rot) | (value << (16 - rot))) & 0xffff;
+  }
+
+  // unaligned stores write the aligned word or halfword
+  public store(addr: number, size: 1 | 2 | 4, value: number) {
+    if (this.watcher) {
+      this.watcher.access(addr, size, true);
+    }
+    this.cycles += this.accessCycles(addr, size, this.sequential);
+    this.sequential = true;
+    this.write(addr & ~(size - 1), size, value);
+  }
+
+  // ldm/stm always transfer registers in ascending order from the lowest address, so callers
+  // work out the start address; returns true if pc was loaded
+  public blockTransfer(load: boolean, addr: number, mask: number): boolean {
+    if (this.watcher) {
+      this.watcher.block(addr, popcount(mask) * 4, !load);
+    }
+    let branched = false;
+    for (let r = 0; r < 16; r++, mask >>= 1) {
+      if (!(mask & 1)) {
+        continue;
+      }
+      if (load) {
+        const value = this.load(addr, 4);
+        if (r === 15) {
+          this.jump(value);
+          branched = true;
+        } else {
+          this.regs[r] = value;
+        }
+      } else {
+        this.store(addr, 4, r === 15 ? this.regs[15] + (this.isARM() ? 4 : 2) : this.regs[r]);
+      }
+      addr += 4;
+    }
+    return branched;
+  }
+
+  // cycles for one access, from GBATEK's memory timing table
+  public accessCycles(addr: number, size: 1 | 2 | 4, sequential: boolean): number {
+    const waitN = [4, 3, 2, 8];
+    const rom = (n: number, s: number, slowS: number) => {
+      const first = 1 + (sequential ? (s ? 1 : slowS) : waitN[n]);
+      // 32-bit accesses are two 16-bit accesses, and the second is sequential
+      return size === 4 ? first + 1 + (s ? 1 : slowS) : first;
+    };
+    const wait = this.waitcnt;
+    switch ((addr >>> 24) & 0xf) {
+      case 0x02: // EWRAM, 16-bit bus with 2 wait states
+        return size === 4 ? 6 : 3;
+      case 0x05: // palette and VRAM, 16-bit bus
+      case 0x06:
+        return size === 4 ? 2 : 1;
+      case 0x08: // game pak wait state 0
+      case 0x09:
+        return rom((wait >> 2) & 3, (wait >> 4) & 1, 2);
+      case 0x0a: // wait state 1
+      case 0x0b:
+        return rom((wait >> 5) & 3, (wait >> 7) & 1, 4);
+      case 0x0c: // wait state 2
+      case 0x0d:
+        return rom((wait >> 8) & 3, (wait >> 10) & 1, 8);
+      case 0x0e: // SRAM, 8-bit bus
+      case 0x0f:
+        return (1 + waitN[wait & 3]) * size;
+      default: // BIOS, IWRAM, IO, OAM
+        return 1;
+    }
+  }
+
+  // counts the cycles to fetch the instruction at pc, and starts its data accesses
+  public fetch(pc: number) {
+    this.cycles += this.accessCycles(pc, this.isARM() ? 4 : 2, true);
+    this.sequential = false;
+  }
+
+  // counts the pipeline refill after a branch: the first fetch at the new pc is non-sequential, and
+  // the second is sequential
+  public refill(pc?: number) {
+    const size = this.isARM() ? 4 : 2;
+    pc ??= this.regs[15] - size * 2;
+    this.cycles += this.accessCycles(pc, size, false) + this.accessCycles(pc + size, size, true);
+  }
+
+  // internal cycles, like register shifts and multiplies
+  public idle(cycles: number) {
+    this.cycles += cycles;
+  }
+
+  private read(addr: number, size: 1 | 2 | 4): number {
+    return size === 1 ? this.read8(addr) : size === 2 ? this.read16(addr) : this.read32(addr) | 0;
+  }
+
+  private write(addr: number, size: 1 | 2 | 4, value: number) {
+    if (size === 1) {
+      this.write8(addr, value);
+    } else if (size === 2) {
+      this.write16(addr, value);
+    } else {
+      this.write32(addr, value);
+    }
+  }
+
+  // DMA3 runs immediately when enabled, which is enough for memory copies and EEPROM access
+  private dma3() {
+    const src = this.read32(0x040000d4) & 0x0ffffffe;
+    const dst = this.read32(0x040000d8) & 0x0ffffffe;
+    const count = this.read16(0x040000dc) || 0x10000;
+    const ctrl = this.read16(0x040000de);
+    const size = ctrl & 0x0400 ? 4 : 2;
+    const step = (mode: number) => mode === 1 ? -size : mode === 2 ? 0 : size;
+    const dstStep = step((ctrl >> 5) & 3);
+    const srcStep = step((ctrl >> 7) & 3);
+    // 2 internal cycles to start, then a read and a write per unit, which are sequential after the
+    // first
+    this.cycles += 2;
+    for (let i = 0, s = src, d = dst; i < count; i++, s += srcStep, d += dstStep) {
+      this.write(d, size, this.read(s, size));
+      this.cycles += this.accessCycles(s, size, i > 0) + this.accessCycles(d, size, i > 0);
+    }
+    this.region(dst)?.device?.endDMA?.();
+    this.region(src)?.device?.endDMA?.();
+    // clear the enable bit
+    this.write8(0x040000df, (ctrl >> 8) & 0x7f);
   }
 
   public bx(addr: number) {
@@ -115,6 +316,11 @@ export class CPU {
     this.regs[15] += this.isARM() ? 8 : 4;
   }
 
+  // branch without changing state, like writing pc with ldr/ldm/mov (ARMv4 doesn't switch modes)
+  public jump(addr: number) {
+    this.regs[15] = this.isARM() ? (addr & ~3) + 8 : (addr & ~1) + 4;
+  }
+
   public isARM(): boolean {
     return !((this.regs[16] >> 5) & 1);
   }
@@ -141,7 +347,7 @@ export class CPU {
       case 8: // hi
         return !!(status & C) && !(status & Z);
       case 9: // ls
-        return !(status & C) && !!(status & Z);
+        return !(status & C) || !!(status & Z);
       case 10: // ge
         return !(status & N) === !(status & V);
       case 11: // lt
@@ -194,31 +400,170 @@ export class CPU {
   }
 
   public mov(reg: number, value: number) {
-    this.regs[reg] = value;
+    this.regs[reg] = value | 0;
   }
 
   public next() {
     this.regs[15] += this.isARM() ? 4 : 2;
   }
 
-  public add(a: number, b: number, setStatus: boolean): number {
-    const result = (a + b) | 0;
+  public getC(): number {
+    return this.regs[16] & C ? 1 : 0;
+  }
+
+  // a + b + carry, with the flags of the ARM adder; subtraction is a + ~b + 1, so C is set when
+  // there is no borrow
+  public addc(a: number, b: number, carry: number, setStatus: boolean): number {
+    const result = (a + b + carry) | 0;
     if (setStatus) {
       this.setZNFromValue(result);
-      this.setC(result < a);
-      this.setV(!!((~(a ^ b) & (b ^ result)) >>> 31));
+      this.setC((a >>> 0) + (b >>> 0) + carry > 0xffffffff);
+      this.setV(!!((~(a ^ b) & (a ^ result)) >>> 31));
     }
     return result;
   }
 
+  public add(a: number, b: number, setStatus: boolean): number {
+    return this.addc(a, b, 0, setStatus);
+  }
+
   public sub(a: number, b: number, setStatus: boolean): number {
-    const result = (a - b) | 0;
-    if (setStatus) {
+    return this.addc(a, ~b, 1, setStatus);
+  }
+
+  // the 12-bit immediate of data processing instructions, an 8-bit value rotated right by twice the
+  // top 4 bits
+  public rotateImmediate(expression: number): number {
+    const rot = (expression >> 8) * 2;
+    const imm = expression & 0xff;
+    if (rot === 0) {
+      this.shifterCarry = !!this.getC();
+      return imm;
+    }
+    const value = (imm >>> rot) | (imm << (32 - rot));
+    this.shifterCarry = value < 0;
+    return value;
+  }
+
+  // shift is 0 = lsl, 1 = lsr, 2 = asr, 3 = ror; amounts from the instruction encode lsr/asr #32
+  // as #0, and rrx as ror #0, but amounts from a register don't
+  public shift(value: number, shift: number, amount: number, register: boolean): number {
+    value |= 0;
+    if (amount === 0 && (register || shift === 0)) {
+      this.shifterCarry = !!this.getC();
+      return value;
+    }
+    switch (shift) {
+      case 0: // lsl
+        this.shifterCarry = amount <= 32 && !!((value >>> (32 - amount)) & 1);
+        return amount < 32 ? value << amount : 0;
+      case 1: // lsr
+        if (amount === 0) {
+          amount = 32;
+        }
+        this.shifterCarry = amount <= 32 && !!((value >>> (amount - 1)) & 1);
+        return amount < 32 ? value >>> amount | 0 : 0;
+      case 2: // asr
+        if (amount === 0 || amount > 32) {
+          amount = 32;
+        }
+        this.shifterCarry = !!((value >> (amount - 1)) & 1);
+        return amount < 32 ? value >> amount : value >> 31;
+      case 3: // ror
+        if (amount === 0) {
+          // rrx
+          this.shifterCarry = !!(value & 1);
+          return (this.getC() << 31) | (value >>> 1);
+        }
+        amount &= 31;
+        if (amount === 0) {
+          this.shifterCarry = value < 0;
+          return value;
+        }
+        this.shifterCarry = !!((value >>> (amount - 1)) & 1);
+        return (value >>> amount) | (value << (32 - amount));
+      default:
+        throw `Invalid shift`;
+    }
+  }
+
+  // the 16 data processing operations, where b is the second operand from rotateImmediate or shift;
+  // returns true if pc was written
+  public alu(oper: number, Rd: number, a: number, b: number, setStatus: boolean): boolean {
+    let result: number;
+    switch (oper) {
+      case 0: // and
+      case 8: // tst
+        result = a & b;
+        break;
+      case 1: // eor
+      case 9: // teq
+        result = a ^ b;
+        break;
+      case 2: // sub
+      case 10: // cmp
+        result = this.addc(a, ~b, 1, setStatus);
+        break;
+      case 3: // rsb
+        result = this.addc(b, ~a, 1, setStatus);
+        break;
+      case 4: // add
+      case 11: // cmn
+        result = this.addc(a, b, 0, setStatus);
+        break;
+      case 5: // adc
+        result = this.addc(a, b, this.getC(), setStatus);
+        break;
+      case 6: // sbc
+        result = this.addc(a, ~b, this.getC(), setStatus);
+        break;
+      case 7: // rsc
+        result = this.addc(b, ~a, this.getC(), setStatus);
+        break;
+      case 12: // orr
+        result = a | b;
+        break;
+      case 13: // mov
+        result = b | 0;
+        break;
+      case 14: // bic
+        result = a & ~b;
+        break;
+      case 15: // mvn
+        result = ~b;
+        break;
+      default:
+        throw `Invalid data processing operation`;
+    }
+    const logical = oper < 2 || oper === 8 || oper === 9 || oper >= 12;
+    if (setStatus && logical) {
       this.setZNFromValue(result);
-      this.setC(a >= b);
-      this.setV(!!(((a ^ b) & (a ^ result)) >>> 31));
+      this.setC(this.shifterCarry);
     }
-    return result;
+    if (oper >= 8 && oper <= 11) {
+      return false;
+    }
+    if (Rd === 15) {
+      if (setStatus) {
+        throw `Not implemented: set status when Rd is r15`;
+      }
+      this.jump(result);
+      return true;
+    }
+    this.regs[Rd] = result;
+    return false;
+  }
+
+  // multiplies take 1 to 4 internal cycles, depending on how many top bytes of the multiplier are
+  // all zeros (or all ones, when signed)
+  public multiplyCycles(rs: number, signed = true): number {
+    for (let m = 1; m < 4; m++) {
+      const top = rs >> (m * 8);
+      if (top === 0 || (signed && top === -1)) {
+        return m;
+      }
+    }
+    return 4;
   }
 }
 
@@ -228,15 +573,25 @@ export function runResult(
   arm: boolean,
   debug: IDebugStatement[],
   log: (str: string) => void,
+  save: SaveType | false = false,
+  lint: PerfLint | false = false,
 ) {
   const cpu = new CPU();
+  cpu.watcher = lint;
+  const saveType = save === false ? detectSaveType(bytes) : save;
+  const saveDevice = createSaveDevice(saveType, () => cpu.cycles);
+  if (saveDevice) {
+    cpu.addDevice(saveDevice.addr, saveDevice.size, saveDevice);
+  }
   cpu.addROM(base, bytes);
+  cpu.addDevice(0x04000100, 0x10, new Timers(() => cpu.cycles));
   cpu.addRAM(0x02000000, 0x40000); // EWRAM
   cpu.addRAM(0x03000000, 0x8000); // IWRAM
   cpu.addRAM(0x04000000, 0x400); // IO
   cpu.addRAM(0x05000000, 0x400); // palette
   cpu.addRAM(0x06000000, 0x18000); // VRAM
   cpu.addRAM(0x07000000, 0x400); // OAM
+  cpu.mov(13, 0x03007f00); // BIOS default stack
 
   cpu.bx(base + (arm ? 0 : 1));
 
@@ -276,6 +631,11 @@ export function runResult(
     if (done) break;
 
     // run code here
+    cpu.fetch(pc);
+    if (lint) {
+      lint.step(pc, cpu.isARM());
+    }
+    const nextPC = cpu.pc() + (cpu.isARM() ? 4 : 2);
     const opcode16 = cpu.read16(pc);
     const opcode32 = cpu.read32(pc);
     if (cpu.isARM()) {
@@ -309,10 +669,24 @@ export function runResult(
         throw new Error(`Unknown symbol: ${name}`);
       });
     }
+    if (cpu.pc() !== nextPC) {
+      cpu.refill();
+    }
+  }
+
+  if (saveDevice) {
+    for (const line of saveDevice.report(saveType)) {
+      log(line);
+    }
+  }
+  if (lint) {
+    for (const line of lint.report()) {
+      log(line);
+    }
   }
 }
 
-export async function run({ input, defines }: IRunArgs): Promise<number> {
+export async function run({ input, defines, save, perfLint }: IRunArgs): Promise<number> {
   try {
     const result = await makeResult(input, defines);
 
@@ -329,6 +703,8 @@ export async function run({ input, defines }: IRunArgs): Promise<number> {
       result.arm,
       result.debug,
       (str: string) => console.log(str),
+      save,
+      perfLint ? new PerfLint(result.lines) : false,
     );
 
     return 0;
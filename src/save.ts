@@ -0,0 +1,323 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { IMemoryDevice } from './run.ts';
+
+// emulated cartridge save memory for `gvasm run`, so save code can be exercised and its busy
+// waits measured without hardware
+
+export type SaveType = 'none' | 'sram' | 'flash64' | 'flash128' | 'eeprom';
+
+export const saveTypes: SaveType[] = ['none', 'sram', 'flash64', 'flash128', 'eeprom'];
+
+// timing is measured in CPU cycles at 2^24 Hz
+const CYCLES_PER_MS = 16777.216;
+
+// busy times are typical figures for the chips found on carts, and real chips vary (sometimes
+// by a lot), so results are only good for comparing save strategies
+const FLASH_PROGRAM_CYCLES = 336; // ~20us per byte
+const FLASH_SECTOR_ERASE_CYCLES = 419430; // ~25ms per 4K sector
+const FLASH_CHIP_ERASE_CYCLES = 1677722; // ~100ms
+const EEPROM_WRITE_CYCLES = 108368; // ~6.5ms per 8 byte block
+
+// libraries detect the save type by these strings, so carts and emulators do too
+const saveTypeIds: [string, SaveType][] = [
+  ['EEPROM_V', 'eeprom'],
+  ['SRAM_V', 'sram'],
+  ['SRAM_F_V', 'sram'],
+  ['FLASH_V', 'flash64'],
+  ['FLASH512_V', 'flash64'],
+  ['FLASH1M_V', 'flash128'],
+];
+
+export function detectSaveType(bytes: readonly number[]): SaveType {
+  for (let i = 0; i < bytes.length; i += 4) {
+    for (const [id, type] of saveTypeIds) {
+      let match = true;
+      for (let j = 0; j < id.length && match; j++) {
+        match = bytes[i + j] === id.charCodeAt(j);
+      }
+      if (match) {
+        return type;
+      }
+    }
+  }
+  return 'none';
+}
+
+interface IOpStats {
+  count: number;
+  worst: number;
+}
+
+export abstract class SaveDevice implements IMemoryDevice {
+  public abstract readonly addr: number;
+  public abstract readonly size: number;
+  protected clock: () => number;
+  private stats = new Map<string, IOpStats>();
+  // the operation the chip is busy with, which is finished once software sees it done
+  private pending: { name: string; start: number; end: number } | false = false;
+
+  constructor(clock: () => number) {
+    this.clock = clock;
+  }
+
+  public abstract read8(offset: number): number;
+  public abstract write8(offset: number, value: number): void;
+
+  protected begin(name: string, cycles: number) {
+    this.finish(true);
+    const start = this.clock();
+    this.pending = { name, start, end: start + cycles };
+    if (!this.stats.has(name)) {
+      this.stats.set(name, { count: 0, worst: 0 });
+    }
+    (this.stats.get(name) as IOpStats).count++;
+  }
+
+  protected count(name: string) {
+    this.begin(name, 0);
+  }
+
+  protected busy(): boolean {
+    if (!this.pending) {
+      return false;
+    }
+    if (this.clock() < this.pending.end) {
+      return true;
+    }
+    this.finish(false);
+    return false;
+  }
+
+  // latency is from the command to the first poll that sees the chip ready, so slow polling loops
+  // show up too; operations that are never polled count their busy time
+  private finish(unpolled: boolean) {
+    if (!this.pending) {
+      return;
+    }
+    const { name, start, end } = this.pending;
+    const stats = this.stats.get(name) as IOpStats;
+    const latency = unpolled ? end - start : this.clock() - start;
+    stats.worst = Math.max(stats.worst, latency);
+    this.pending = false;
+  }
+
+  public report(type: SaveType): string[] {
+    this.finish(true);
+    const out: string[] = [];
+    for (const [name, { count, worst }] of this.stats) {
+      out.push(
+        `  ${name}: ${count}` + (worst > 0
+          ? `, worst ${worst} cycles (${(worst / CYCLES_PER_MS).toFixed(2)}ms)`
+          : ''),
+      );
+    }
+    return out.length > 0 ? [`Save memory (${type}):`, ...out] : [];
+  }
+}
+
+class SRAM extends SaveDevice {
+  public readonly addr = 0x0e000000;
+  public readonly size = 0x01000000;
+  private data = new Uint8Array(0x8000).fill(0xff);
+
+  public read8(offset: number) {
+    this.count('read');
+    return this.data[offset & 0x7fff];
+  }
+
+  public write8(offset: number, value: number) {
+    this.count('write');
+    this.data[offset & 0x7fff] = value;
+  }
+}
+
+// Flash is driven by command sequences:
+//   write 0xaa to 0x5555, 0x55 to 0x2aaa, then the command to 0x5555
+//   0x90  enter ID mode, where 0x0000 is the manufacturer and 0x0001 is the device
+//   0xf0  exit ID mode
+//   0x80  erase, followed by a second unlock, and 0x10 to 0x5555 (chip) or 0x30 to a sector
+//   0xa0  program the next byte written
+//   0xb0  (128K only) switch banks by writing the bank to 0x0000
+class Flash extends SaveDevice {
+  public readonly addr = 0x0e000000;
+  public readonly size = 0x01000000;
+  private data: Uint8Array;
+  private idCode: number[];
+  private bank = 0;
+  private unlock = 0;
+  private erasing = false;
+  private idMode = false;
+  private next: 'none' | 'program' | 'bank' = 'none';
+  // value expected at the address being programmed or erased, for busy reads
+  private busyAddr = -1;
+  private busyValue = 0;
+
+  constructor(clock: () => number, large: boolean) {
+    super(clock);
+    this.data = new Uint8Array(large ? 0x20000 : 0x10000).fill(0xff);
+    // Macronix 128K or Panasonic 64K
+    this.idCode = large ? [0xc2, 0x09] : [0x32, 0x1b];
+  }
+
+  public read8(offset: number) {
+    offset &= 0xffff;
+    if (this.idMode && offset < 2) {
+      return this.idCode[offset];
+    }
+    if (this.busy()) {
+      // while busy, the chip returns something other than the final value (DQ7 is inverted)
+      return offset === this.busyAddr ? this.busyValue ^ 0x80 : this.busyValue ^ 0xff;
+    }
+    return this.data[this.bank * 0x10000 + offset];
+  }
+
+  public write8(offset: number, value: number) {
+    offset &= 0xffff;
+    if (this.next === 'program') {
+      this.next = 'none';
+      const addr = this.bank * 0x10000 + offset;
+      // programming can only clear bits
+      this.data[addr] &= value;
+      this.busyAddr = offset;
+      this.busyValue = this.data[addr];
+      this.begin('byte program', FLASH_PROGRAM_CYCLES);
+      return;
+    }
+    if (this.next === 'bank') {
+      this.next = 'none';
+      if (offset === 0) {
+        this.bank = value & (this.data.length / 0x10000 - 1);
+      }
+      return;
+    }
+    if (this.unlock === 0 && offset === 0x5555 && value === 0xaa) {
+      this.unlock = 1;
+      return;
+    }
+    if (this.unlock === 1 && offset === 0x2aaa && value === 0x55) {
+      this.unlock = 2;
+      return;
+    }
+    if (this.unlock !== 2) {
+      this.unlock = 0;
+      return;
+    }
+    this.unlock = 0;
+    if (this.erasing) {
+      this.erasing = false;
+      if (offset === 0x5555 && value === 0x10) {
+        this.data.fill(0xff);
+        this.busyAddr = -1;
+        this.busyValue = 0xff;
+        this.begin('chip erase', FLASH_CHIP_ERASE_CYCLES);
+      } else if (value === 0x30) {
+        const start = this.bank * 0x10000 + (offset & 0xf000);
+        this.data.fill(0xff, start, start + 0x1000);
+        this.busyAddr = -1;
+        this.busyValue = 0xff;
+        this.begin('sector erase', FLASH_SECTOR_ERASE_CYCLES);
+      }
+      return;
+    }
+    if (offset !== 0x5555) {
+      return;
+    }
+    switch (value) {
+      case 0x90:
+        this.idMode = true;
+        break;
+      case 0xf0:
+        this.idMode = false;
+        break;
+      case 0x80:
+        this.erasing = true;
+        break;
+      case 0xa0:
+        this.next = 'program';
+        break;
+      case 0xb0:
+        if (this.data.length > 0x10000) {
+          this.next = 'bank';
+        }
+        break;
+    }
+  }
+}
+
+// EEPROM is accessed serially, one bit per halfword, with DMA3:
+//   read request:  1, 1, address (6 or 14 bits), 0
+//   read reply:    4 junk bits, then 64 data bits
+//   write request: 1, 0, address (6 or 14 bits), 64 data bits, 0
+// after a write, reads return 0 until the write is done, then 1
+class EEPROM extends SaveDevice {
+  public readonly addr = 0x0d000000;
+  public readonly size = 0x01000000;
+  private data = new Uint8Array(0x2000).fill(0xff);
+  private input: number[] = [];
+  private output: number[] = [];
+
+  public read8(offset: number) {
+    if (offset & 1) {
+      return 0;
+    }
+    if (this.output.length > 0) {
+      return this.output.shift() as number;
+    }
+    return this.busy() ? 0 : 1;
+  }
+
+  public write8(offset: number, value: number) {
+    if (!(offset & 1)) {
+      this.input.push(value & 1);
+    }
+  }
+
+  // requests are only complete once the DMA is done, since the address size depends on the length
+  public endDMA() {
+    const bits = this.input;
+    this.input = [];
+    const num = (start: number, count: number) => {
+      let v = 0;
+      for (let i = 0; i < count; i++) {
+        v = (v * 2) + bits[start + i];
+      }
+      return v;
+    };
+    const addrBits = bits.length === 9 || bits.length === 73 ? 6 : 14;
+    if ((bits.length === 9 || bits.length === 17) && bits[0] === 1 && bits[1] === 1) {
+      const addr = (num(2, addrBits) & 0x3ff) * 8;
+      this.output = [0, 0, 0, 0];
+      for (let i = 0; i < 64; i++) {
+        this.output.push((this.data[addr + (i >> 3)] >> (7 - (i & 7))) & 1);
+      }
+      this.count('block read');
+    } else if ((bits.length === 73 || bits.length === 81) && bits[0] === 1 && bits[1] === 0) {
+      const addr = (num(2, addrBits) & 0x3ff) * 8;
+      for (let i = 0; i < 8; i++) {
+        this.data[addr + i] = num(2 + addrBits + i * 8, 8);
+      }
+      this.begin('block write', EEPROM_WRITE_CYCLES);
+    }
+  }
+}
+
+export function createSaveDevice(type: SaveType, clock: () => number): SaveDevice | false {
+  switch (type) {
+    case 'none':
+      return false;
+    case 'sram':
+      return new SRAM(clock);
+    case 'flash64':
+      return new Flash(clock, false);
+    case 'flash128':
+      return new Flash(clock, true);
+    case 'eeprom':
+      return new EEPROM(clock);
+  }
+}
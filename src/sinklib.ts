@@ -8,17 +8,33 @@
 // deno-lint-ignore-file no-explicit-any
 
 import { b16, b32, ILineStr, printf, splitLines } from './util.ts';
-import { loadImage } from './deps.ts';
+import { loadImage, pathDirname, pathResolve } from './deps.ts';
 import * as sink from './sink.ts';
 import { ConstTable } from './const.ts';
+import { BitReader, BitWriter } from './bitstream.ts';
+import { alignLoop, decodeWav, IAudio, mixMono, resample, toS8 } from './audio.ts';
+import { spritePack } from './sprite.ts';
+import { buildDict, huffmanStrings, packStrings } from './strtab.ts';
+import { lz77Compress } from './lz77.ts';
+import { rleCompress } from './rle.ts';
 
 export interface ILineBytes {
   kind: 'bytes';
-  data: number[];
+  data: number[] | Uint8Array;
 }
 
 export type ILinePut = ILineStr | ILineBytes;
 
+// convert binary data to a sink string (one character per byte), in chunks so large files don't
+// blow the argument limit of fromCharCode
+export function bytesToStr(data: number[] | Uint8Array): string {
+  const chunks: string[] = [];
+  for (let i = 0; i < data.length; i += 0x8000) {
+    chunks.push(String.fromCharCode(...data.slice(i, i + 0x8000)));
+  }
+  return chunks.join('');
+}
+
 export function loadLibIntoScript(scr: sink.scr, ctable: ConstTable) {
   sink.scr_autonative(scr, 'put');
   sink.scr_autonative(scr, 'i8');
@@ -38,7 +54,52 @@ export function loadLibIntoScript(scr: sink.scr, ctable: ConstTable) {
   sink.scr_autonative(scr, 'store.set');
   sink.scr_autonative(scr, 'store.get');
   sink.scr_autonative(scr, 'store.has');
+  sink.scr_autonative(scr, 'file.read');
+  sink.scr_autonative(scr, 'buffer.size');
+  sink.scr_autonative(scr, 'buffer.slice');
+  sink.scr_autonative(scr, 'buffer.list');
+  sink.scr_autonative(scr, 'buffer.str');
+  sink.scr_autonative(scr, 'buffer.u8');
+  sink.scr_autonative(scr, 'buffer.s8');
+  sink.scr_autonative(scr, 'buffer.u16');
+  sink.scr_autonative(scr, 'buffer.s16');
+  sink.scr_autonative(scr, 'buffer.u32');
+  sink.scr_autonative(scr, 'buffer.s32');
+  sink.scr_autonative(scr, 'buffer.ub16');
+  sink.scr_autonative(scr, 'buffer.sb16');
+  sink.scr_autonative(scr, 'buffer.ub32');
+  sink.scr_autonative(scr, 'buffer.sb32');
+  sink.scr_autonative(scr, 'bits.writer');
+  sink.scr_autonative(scr, 'bits.reader');
+  sink.scr_autonative(scr, 'bits.write');
+  sink.scr_autonative(scr, 'bits.read');
+  sink.scr_autonative(scr, 'bits.sread');
+  sink.scr_autonative(scr, 'bits.skip');
+  sink.scr_autonative(scr, 'bits.align');
+  sink.scr_autonative(scr, 'bits.size');
+  sink.scr_autonative(scr, 'bits.left');
+  sink.scr_autonative(scr, 'bits.buffer');
+  sink.scr_autoenum(scr, ['bits.LSB', 'bits.MSB']);
+  sink.scr_autonative(scr, 'audio.load');
+  sink.scr_autonative(scr, 'audio.rate');
+  sink.scr_autonative(scr, 'audio.length');
+  sink.scr_autonative(scr, 'audio.channels');
+  sink.scr_autonative(scr, 'audio.loop');
+  sink.scr_autonative(scr, 'audio.setloop');
+  sink.scr_autonative(scr, 'audio.channel');
+  sink.scr_autonative(scr, 'audio.mono');
+  sink.scr_autonative(scr, 'audio.samples');
+  sink.scr_autonative(scr, 'audio.resample');
+  sink.scr_autonative(scr, 'audio.align');
+  sink.scr_autonative(scr, 'audio.s8');
   sink.scr_autonative(scr, 'image.load');
+  sink.scr_autonative(scr, 'sprite.indexed');
+  sink.scr_autonative(scr, 'sprite.pack');
+  sink.scr_autonative(scr, 'strtab.pack');
+  sink.scr_autonative(scr, 'strtab.dict');
+  sink.scr_autonative(scr, 'strtab.huffman');
+  sink.scr_autonative(scr, 'lz77.compress');
+  sink.scr_autonative(scr, 'rle.compress');
   sink.scr_autonative(scr, 'json.load');
   sink.scr_autonative(scr, 'json.type');
   sink.scr_autonative(scr, 'json.boolean');
@@ -67,7 +128,14 @@ export function loadLibIntoContext(
   store: { [key: string]: string },
   main: boolean,
   ctable: ConstTable,
+  posix: boolean,
+  readBinaryFile: (filename: string) => Promise<number[] | Uint8Array>,
 ) {
+  const bufferType = sink.ctx_addusertype(ctx, 'buffer');
+  const isBuffer = (v: sink.val) => sink.list_hasuser(ctx, v, bufferType);
+  const bitWriterType = sink.ctx_addusertype(ctx, 'bits.writer');
+  const bitReaderType = sink.ctx_addusertype(ctx, 'bits.reader');
+  const audioType = sink.ctx_addusertype(ctx, 'audio');
   sink.ctx_autonative(
     ctx,
     'put',
@@ -92,6 +160,13 @@ export function loadLibIntoContext(
         for (const n of new TextEncoder().encode(arg)) {
           data.push(n);
         }
+      } else if (isBuffer(arg)) {
+        // buffers are already packed bytes, so hand them to the assembler as-is
+        put.push({ kind: 'bytes', data: data.splice(0, data.length) });
+        put.push({ kind: 'bytes', data: sink.list_getuser(ctx, arg) as Uint8Array });
+      } else if (sink.list_hasuser(ctx, arg, bitWriterType)) {
+        put.push({ kind: 'bytes', data: data.splice(0, data.length) });
+        put.push({ kind: 'bytes', data: (sink.list_getuser(ctx, arg) as BitWriter).bytes() });
       } else if (sink.islist(arg)) {
         if ((arg as { gvasmSeen?: true }).gvasmSeen) {
           throw 'Invalid circular lists';
@@ -117,7 +192,8 @@ export function loadLibIntoContext(
           const v = isB ? b16(arg) : arg;
           data.push(v & 0xff);
           data.push((v >>> 8) & 0xff);
-        } else if (sink.islist(arg)) {
+        } else if (sink.islist(arg) && sink.list_getuser(ctx, arg) === null) {
+          // buffers and other objects are lists too, but their bytes aren't 16/32-bit values
           if ((arg as { gvasmSeen?: true }).gvasmSeen) {
             throw 'Invalid circular lists';
           }
@@ -144,7 +220,8 @@ export function loadLibIntoContext(
           data.push((v >>> 8) & 0xff);
           data.push((v >>> 16) & 0xff);
           data.push((v >>> 24) & 0xff);
-        } else if (sink.islist(arg)) {
+        } else if (sink.islist(arg) && sink.list_getuser(ctx, arg) === null) {
+          // buffers and other objects are lists too, but their bytes aren't 16/32-bit values
           if ((arg as { gvasmSeen?: true }).gvasmSeen) {
             throw 'Invalid circular lists';
           }
@@ -308,22 +385,342 @@ export function loadLibIntoContext(
       return Promise.resolve(sink.bool(key in store));
     },
   );
+  const argBuffer = (args: sink.val[], index: number): Uint8Array => {
+    if (args.length <= index || !isBuffer(args[index])) {
+      throw `Expecting buffer for argument ${index + 1}`;
+    }
+    return sink.list_getuser(ctx, args[index]) as Uint8Array;
+  };
+  const argOptNum = (args: sink.val[], index: number, def: number): number => {
+    if (args.length <= index || args[index] === sink.NIL) {
+      return def;
+    }
+    const v = args[index];
+    if (typeof v !== 'number') {
+      throw `Expecting number for argument ${index + 1}`;
+    }
+    return Math.floor(v);
+  };
+  const sliceBuffer = (buf: Uint8Array, args: sink.val[], index: number) => {
+    const offset = argOptNum(args, index, 0);
+    const length = argOptNum(args, index + 1, buf.length - offset);
+    if (offset < 0 || offset > buf.length) {
+      throw `Offset out of range: ${offset}`;
+    }
+    if (length < 0 || offset + length > buf.length) {
+      throw `Length out of range: ${length}`;
+    }
+    return buf.subarray(offset, offset + length);
+  };
+  const valBytes = (data: sink.val): Uint8Array | false => {
+    if (isBuffer(data)) {
+      return sink.list_getuser(ctx, data) as Uint8Array;
+    } else if (typeof data === 'string') {
+      const bytes = new Uint8Array(data.length);
+      for (let i = 0; i < data.length; i++) {
+        bytes[i] = data.charCodeAt(i);
+      }
+      return bytes;
+    } else if (Array.isArray(data)) {
+      return new Uint8Array(data as number[]);
+    }
+    return false;
+  };
+  const argBytes = (args: sink.val[], index: number): Uint8Array => {
+    const bytes = valBytes(args[index]);
+    if (bytes === false) {
+      throw `Expecting string, list, or buffer for argument ${index + 1}`;
+    }
+    return bytes;
+  };
   sink.ctx_autonative(
     ctx,
-    'image.load',
+    'file.read',
     null,
-    async (_ctx: sink.ctx, args: sink.val[]) => {
-      if (args.length <= 0) {
-        throw 'Expecting string or list for argument 1';
+    async (ctx: sink.ctx, args: sink.val[]) => {
+      if (args.length <= 0 || typeof args[0] !== 'string') {
+        throw 'Expecting string for argument 1';
+      }
+      const flp = sink.ctx_source(ctx);
+      const full = pathResolve(posix, pathDirname(posix, flp.filename), args[0]);
+      let data;
+      try {
+        data = await readBinaryFile(full);
+      } catch (_) {
+        throw `Failed to read file: ${full}`;
+      }
+      const buf = data instanceof Uint8Array ? data : new Uint8Array(data);
+      return sink.user_new(ctx, bufferType, sliceBuffer(buf, args, 1));
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'buffer.size',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => Promise.resolve(argBuffer(args, 0).length),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'buffer.slice',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(sink.user_new(ctx, bufferType, sliceBuffer(argBuffer(args, 0), args, 1))),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'buffer.list',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      const buf = argBuffer(args, 0);
+      const ret = new sink.list();
+      for (let i = 0; i < buf.length; i++) {
+        ret.push(buf[i]);
+      }
+      return Promise.resolve(ret);
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'buffer.str',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => Promise.resolve(bytesToStr(argBuffer(args, 0))),
+  );
+  const bufferGetter = (size: 1 | 2 | 4, signed: boolean, little: boolean) =>
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      const buf = argBuffer(args, 0);
+      const offset = argOptNum(args, 1, 0);
+      if (offset < 0 || offset + size > buf.length) {
+        return Promise.reject(`Offset out of range: ${offset}`);
+      }
+      const view = new DataView(buf.buffer, buf.byteOffset, buf.byteLength);
+      if (size === 1) {
+        return Promise.resolve(signed ? view.getInt8(offset) : view.getUint8(offset));
+      } else if (size === 2) {
+        return Promise.resolve(
+          signed ? view.getInt16(offset, little) : view.getUint16(offset, little),
+        );
+      }
+      return Promise.resolve(
+        signed ? view.getInt32(offset, little) : view.getUint32(offset, little),
+      );
+    };
+  sink.ctx_autonative(ctx, 'buffer.u8', null, bufferGetter(1, false, true));
+  sink.ctx_autonative(ctx, 'buffer.s8', null, bufferGetter(1, true, true));
+  sink.ctx_autonative(ctx, 'buffer.u16', null, bufferGetter(2, false, true));
+  sink.ctx_autonative(ctx, 'buffer.s16', null, bufferGetter(2, true, true));
+  sink.ctx_autonative(ctx, 'buffer.u32', null, bufferGetter(4, false, true));
+  sink.ctx_autonative(ctx, 'buffer.s32', null, bufferGetter(4, true, true));
+  sink.ctx_autonative(ctx, 'buffer.ub16', null, bufferGetter(2, false, false));
+  sink.ctx_autonative(ctx, 'buffer.sb16', null, bufferGetter(2, true, false));
+  sink.ctx_autonative(ctx, 'buffer.ub32', null, bufferGetter(4, false, false));
+  sink.ctx_autonative(ctx, 'buffer.sb32', null, bufferGetter(4, true, false));
+  const argBitOrder = (args: sink.val[], index: number): boolean => {
+    const order = argOptNum(args, index, 0);
+    if (order !== 0 && order !== 1) {
+      throw `Expecting bits.LSB or bits.MSB for argument ${index + 1}`;
+    }
+    return order === 1;
+  };
+  const argBitWriter = (args: sink.val[], index: number): BitWriter => {
+    if (args.length <= index || !sink.list_hasuser(ctx, args[index], bitWriterType)) {
+      throw `Expecting bit writer for argument ${index + 1}`;
+    }
+    return sink.list_getuser(ctx, args[index]) as BitWriter;
+  };
+  const argBitReader = (args: sink.val[], index: number): BitReader => {
+    if (args.length <= index || !sink.list_hasuser(ctx, args[index], bitReaderType)) {
+      throw `Expecting bit reader for argument ${index + 1}`;
+    }
+    return sink.list_getuser(ctx, args[index]) as BitReader;
+  };
+  const argBitCount = (args: sink.val[], index: number): number => {
+    const count = argOptNum(args, index, -1);
+    if (count < 0 || count > 32) {
+      throw `Expecting bit count 0..32 for argument ${index + 1}`;
+    }
+    return count;
+  };
+  sink.ctx_autonative(
+    ctx,
+    'bits.writer',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(sink.user_new(ctx, bitWriterType, new BitWriter(argBitOrder(args, 0)))),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.reader',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(
+        sink.user_new(
+          ctx,
+          bitReaderType,
+          new BitReader(argBytes(args, 0), argBitOrder(args, 1)),
+        ),
+      ),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.write',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      const bw = argBitWriter(args, 0);
+      if (args.length <= 1 || typeof args[1] !== 'number') {
+        return Promise.reject('Expecting number for argument 2');
+      }
+      bw.write(Math.floor(args[1]), argBitCount(args, 2));
+      return Promise.resolve(args[0]);
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.read',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(argBitReader(args, 0).read(argBitCount(args, 1))),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.sread',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(argBitReader(args, 0).readSigned(argBitCount(args, 1))),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.skip',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      argBitReader(args, 0).skip(argOptNum(args, 1, 0));
+      return Promise.resolve(args[0]);
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.align',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      const bytes = argOptNum(args, 1, 1);
+      if (bytes < 1) {
+        return Promise.reject('Expecting positive number for argument 2');
       }
-      let data = args[0];
-      if (typeof data === 'string') {
-        data = data.split('').map((a) => a.charCodeAt(0)) as sink.list;
+      if (sink.list_hasuser(ctx, args[0], bitReaderType)) {
+        argBitReader(args, 0).align(bytes);
+      } else {
+        argBitWriter(args, 0).align(bytes);
       }
-      if (!Array.isArray(data)) {
-        throw 'Expecting string or list for argument 1';
+      return Promise.resolve(args[0]);
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.size',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => {
+      if (sink.list_hasuser(ctx, args[0], bitReaderType)) {
+        return Promise.resolve(argBitReader(args, 0).position());
       }
-      const img = await loadImage(new Uint8Array(data as number[])).catch(() => null);
+      return Promise.resolve(argBitWriter(args, 0).bitLength());
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.left',
+    null,
+    (_ctx: sink.ctx, args: sink.val[]) => Promise.resolve(argBitReader(args, 0).left()),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'bits.buffer',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(sink.user_new(ctx, bufferType, argBitWriter(args, 0).bytes())),
+  );
+  const argAudio = (args: sink.val[], index: number): IAudio => {
+    if (args.length <= index || !sink.list_hasuser(ctx, args[index], audioType)) {
+      throw `Expecting audio for argument ${index + 1}`;
+    }
+    return sink.list_getuser(ctx, args[index]) as IAudio;
+  };
+  const newAudio = (audio: IAudio) => sink.user_new(ctx, audioType, audio);
+  const audioNative = (name: string, f: (args: sink.val[]) => sink.val) => {
+    sink.ctx_autonative(
+      ctx,
+      name,
+      null,
+      (_ctx: sink.ctx, args: sink.val[]) => Promise.resolve(f(args)),
+    );
+  };
+  audioNative('audio.load', (args) => newAudio(decodeWav(argBytes(args, 0))));
+  audioNative('audio.rate', (args) => argAudio(args, 0).rate);
+  audioNative('audio.length', (args) => argAudio(args, 0).channels[0].length);
+  audioNative('audio.channels', (args) => argAudio(args, 0).channels.length);
+  audioNative('audio.loop', (args) => {
+    const { loop } = argAudio(args, 0);
+    return loop === false ? sink.NIL : new sink.list(loop.start, loop.end);
+  });
+  audioNative('audio.setloop', (args) => {
+    const audio = argAudio(args, 0);
+    if (args.length <= 1 || args[1] === sink.NIL) {
+      return newAudio({ ...audio, loop: false });
+    }
+    const start = argOptNum(args, 1, 0);
+    const end = argOptNum(args, 2, audio.channels[0].length);
+    if (start < 0 || start >= end || end > audio.channels[0].length) {
+      throw `Invalid loop points: ${start}, ${end}`;
+    }
+    return newAudio({ ...audio, loop: { start, end } });
+  });
+  audioNative('audio.channel', (args) => {
+    const audio = argAudio(args, 0);
+    const ch = argOptNum(args, 1, 0);
+    if (ch < 0 || ch >= audio.channels.length) {
+      throw `Invalid channel: ${ch}`;
+    }
+    return newAudio({ ...audio, channels: [audio.channels[ch]] });
+  });
+  audioNative('audio.mono', (args) => newAudio(mixMono(argAudio(args, 0))));
+  audioNative('audio.samples', (args) => {
+    const audio = argAudio(args, 0);
+    const ch = argOptNum(args, 1, 0);
+    if (ch < 0 || ch >= audio.channels.length) {
+      throw `Invalid channel: ${ch}`;
+    }
+    const ret = new sink.list();
+    for (const v of audio.channels[ch]) {
+      ret.push(v);
+    }
+    return ret;
+  });
+  audioNative('audio.resample', (args) => {
+    const audio = argAudio(args, 0);
+    const rate = argOptNum(args, 1, 0);
+    if (rate <= 0) {
+      throw 'Expecting positive sample rate for argument 2';
+    }
+    return newAudio(resample(audio, rate));
+  });
+  audioNative('audio.align', (args) => {
+    const audio = argAudio(args, 0);
+    const align = argOptNum(args, 1, 16);
+    if (align < 1) {
+      throw 'Expecting positive alignment for argument 2';
+    }
+    return newAudio(alignLoop(audio, align));
+  });
+  audioNative('audio.s8', (args) => {
+    const audio = mixMono(argAudio(args, 0));
+    const s8 = toS8(audio.channels[0], sink.arg_bool(args, 1));
+    return sink.user_new(ctx, bufferType, new Uint8Array(s8.buffer));
+  });
+  sink.ctx_autonative(
+    ctx,
+    'image.load',
+    null,
+    async (_ctx: sink.ctx, args: sink.val[]) => {
+      const bytes = argBytes(args, 0);
+      const img = await loadImage(bytes).catch(() => null);
       if (img === null) {
         throw 'Unknown image format';
       }
@@ -351,6 +748,173 @@ export function loadLibIntoContext(
       return ret;
     },
   );
+  sink.ctx_autonative(
+    ctx,
+    'sprite.indexed',
+    null,
+    async (_ctx: sink.ctx, args: sink.val[]) => {
+      const img = args[0];
+      const pal = args[1];
+      if (!sink.islist(img)) {
+        throw 'Expecting image for argument 1';
+      }
+      if (!sink.islist(pal)) {
+        throw 'Expecting palette list for argument 2';
+      }
+      // compare colors at 15-bit precision, since that's all the hardware can show
+      const rgb15 = (c: sink.val) => {
+        if (typeof c === 'number') {
+          return c & 0x7fff;
+        } else if (sink.islist(c) && c.length >= 3 && c.every((v) => typeof v === 'number')) {
+          const [r, g, b] = c as number[];
+          return ((r >> 3) & 0x1f) | (((g >> 3) & 0x1f) << 5) | (((b >> 3) & 0x1f) << 10);
+        }
+        throw 'Expecting palette entries to be numbers or {r, g, b} lists';
+      };
+      const lookup = new Map<number, number>();
+      for (let i = pal.length - 1; i >= 1; i--) {
+        lookup.set(rgb15(pal[i]), i);
+      }
+      const ret = new sink.list();
+      for (const row of img) {
+        if (!sink.islist(row)) {
+          throw 'Expecting image to be a list of rows';
+        }
+        const out = new sink.list();
+        for (const px of row) {
+          if (!sink.islist(px) || px.length < 4) {
+            throw 'Expecting pixels to be {r, g, b, a} lists';
+          }
+          if ((px[3] as number) < 128) {
+            out.push(0);
+            continue;
+          }
+          const index = lookup.get(rgb15(px));
+          if (index === undefined) {
+            throw `Color not in palette: ${sink.tostr(px)}`;
+          }
+          out.push(index);
+        }
+        ret.push(out);
+      }
+      return ret;
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'sprite.pack',
+    null,
+    async (ctx: sink.ctx, args: sink.val[]) => {
+      const frames = args[0];
+      if (!sink.islist(frames)) {
+        throw 'Expecting list of frames for argument 1';
+      }
+      const bpp = argOptNum(args, 1, 4);
+      if (bpp !== 4 && bpp !== 8) {
+        throw 'Expecting 4 or 8 for argument 2';
+      }
+      const objCost = argOptNum(args, 2, 1);
+      const input = frames.map((frame) => {
+        if (!sink.islist(frame)) {
+          throw 'Expecting frame to be a list of rows';
+        }
+        return frame.map((row) => {
+          if (!sink.islist(row) || row.some((p) => typeof p !== 'number')) {
+            throw 'Expecting frame rows to be lists of palette indices';
+          }
+          return (row as number[]).map((p) => Math.floor(p));
+        });
+      });
+      const { tiles, frames: packed } = spritePack(input, bpp as 4 | 8, objCost);
+      const out = new sink.list();
+      for (const pieces of packed) {
+        out.push(
+          new sink.list(
+            ...pieces.map(({ x, y, shape, size, tile }) =>
+              new sink.list(x, y, shape, size, tile)
+            ),
+          ),
+        );
+      }
+      return new sink.list(sink.user_new(ctx, bufferType, tiles), out);
+    },
+  );
+  const argStrings = (args: sink.val[], index: number): Uint8Array[] => {
+    const list = args[index];
+    if (!sink.islist(list)) {
+      throw `Expecting list of strings for argument ${index + 1}`;
+    }
+    return list.map((v) => {
+      // text is stored as UTF-8, like i8 writes strings, unlike binary data passed as a string
+      const bytes = typeof v === 'string' ? new TextEncoder().encode(v) : valBytes(v);
+      if (bytes === false) {
+        throw `Expecting list of strings for argument ${index + 1}`;
+      }
+      return bytes;
+    });
+  };
+  // push one at a time, since spreading 100k strings into the constructor overflows the stack
+  const toList = (vals: sink.val[]) => {
+    const ret = new sink.list();
+    for (const v of vals) {
+      ret.push(v);
+    }
+    return ret;
+  };
+  sink.ctx_autonative(
+    ctx,
+    'strtab.pack',
+    null,
+    async (ctx: sink.ctx, args: sink.val[]) => {
+      const { data, offsets } = packStrings(argStrings(args, 0));
+      return new sink.list(sink.user_new(ctx, bufferType, data), toList(offsets));
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'strtab.dict',
+    null,
+    async (ctx: sink.ctx, args: sink.val[]) => {
+      const strings = argStrings(args, 0);
+      const first = argOptNum(args, 2, 0x80);
+      const count = argOptNum(args, 1, 256 - first);
+      const dict = buildDict(strings, count, first);
+      // buffers, since codes from 0x80 would be written as two bytes if they were strings
+      return new sink.list(
+        toList(dict.entries.map((e) => sink.user_new(ctx, bufferType, e))),
+        toList(dict.strings.map((e) => sink.user_new(ctx, bufferType, e))),
+      );
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'strtab.huffman',
+    null,
+    async (ctx: sink.ctx, args: sink.val[]) => {
+      const { tree, data, offsets } = huffmanStrings(argStrings(args, 0), argBitOrder(args, 1));
+      return new sink.list(
+        sink.user_new(ctx, bufferType, tree),
+        sink.user_new(ctx, bufferType, data),
+        toList(offsets),
+      );
+    },
+  );
+  sink.ctx_autonative(
+    ctx,
+    'lz77.compress',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(
+        sink.user_new(ctx, bufferType, lz77Compress(argBytes(args, 0), sink.arg_bool(args, 1))),
+      ),
+  );
+  sink.ctx_autonative(
+    ctx,
+    'rle.compress',
+    null,
+    (ctx: sink.ctx, args: sink.val[]) =>
+      Promise.resolve(sink.user_new(ctx, bufferType, rleCompress(argBytes(args, 0)))),
+  );
   const jsonType = sink.ctx_addusertype(ctx, 'json');
   function jsonTypeOf(v: any): string {
     switch (typeof v) {
@@ -0,0 +1,199 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+// legal OBJ dimensions in tiles, indexed by [shape][size]
+const objShapes: [number, number][][] = [
+  [[1, 1], [2, 2], [4, 4], [8, 8]], // square
+  [[2, 1], [4, 1], [4, 2], [8, 4]], // horizontal
+  [[1, 2], [1, 4], [2, 4], [4, 8]], // vertical
+];
+
+export interface ISpritePiece {
+  x: number; // pixel offset from the top-left of the untrimmed frame
+  y: number;
+  shape: number; // attr0 bits 14-15
+  size: number; // attr1 bits 14-15
+  tile: number; // tile index relative to the start of the packed tile data (32-byte units)
+}
+
+export interface ISpritePack {
+  tiles: Uint8Array;
+  frames: ISpritePiece[][];
+}
+
+// a frame is a list of rows of palette indices, where 0 is transparent
+type Frame = number[][];
+
+interface ICoverPiece {
+  tx: number;
+  ty: number;
+  shape: number;
+  size: number;
+}
+
+function pixel(frame: Frame, x: number, y: number): number {
+  return (frame[y] && frame[y][x]) || 0;
+}
+
+function encodeTiles(
+  frame: Frame,
+  px: number,
+  py: number,
+  tw: number,
+  th: number,
+  bpp: 4 | 8,
+): Uint8Array {
+  // 1D mapping stores the tiles of an object row by row, one after another
+  const out = new Uint8Array(tw * th * bpp * 8);
+  let k = 0;
+  for (let ty = 0; ty < th; ty++) {
+    for (let tx = 0; tx < tw; tx++) {
+      for (let y = 0; y < 8; y++) {
+        for (let x = 0; x < 8; x += bpp === 4 ? 2 : 1) {
+          const sx = px + tx * 8 + x;
+          const sy = py + ty * 8 + y;
+          if (bpp === 4) {
+            out[k++] = pixel(frame, sx, sy) | (pixel(frame, sx + 1, sy) << 4);
+          } else {
+            out[k++] = pixel(frame, sx, sy);
+          }
+        }
+      }
+    }
+  }
+  return out;
+}
+
+// cover the occupied tiles of a frame with OBJs, greedily picking the placement that covers the
+// most new tiles relative to its size plus a fixed per-OBJ cost
+function coverFrame(
+  occupied: boolean[][],
+  objCost: number,
+): ICoverPiece[] {
+  const gh = occupied.length;
+  const gw = gh > 0 ? occupied[0].length : 0;
+  const covered = occupied.map((row) => row.map(() => false));
+  const result: ICoverPiece[] = [];
+  for (let uy = 0; uy < gh; uy++) {
+    for (let ux = 0; ux < gw; ux++) {
+      if (!occupied[uy][ux] || covered[uy][ux]) {
+        continue;
+      }
+      // (ux, uy) is the first uncovered tile; every candidate must include it
+      let best: false | (ICoverPiece & { c: number; a: number }) = false;
+      for (let shape = 0; shape < objShapes.length; shape++) {
+        for (let size = 0; size < 4; size++) {
+          const [w, h] = objShapes[shape][size];
+          // rows above are fully covered, so only start at or left of the tile on this row
+          for (let ox = Math.max(0, ux - w + 1); ox <= ux; ox++) {
+            let c = 0;
+            for (let y = uy; y < Math.min(gh, uy + h); y++) {
+              for (let x = ox; x < Math.min(gw, ox + w); x++) {
+                if (occupied[y][x] && !covered[y][x]) {
+                  c++;
+                }
+              }
+            }
+            const a = w * h;
+            if (
+              !best ||
+              c * (best.a + objCost) > best.c * (a + objCost) ||
+              (c * (best.a + objCost) === best.c * (a + objCost) && a < best.a)
+            ) {
+              best = { tx: ox, ty: uy, shape, size, c, a };
+            }
+          }
+        }
+      }
+      if (!best) {
+        throw new Error('Failed to cover sprite tile');
+      }
+      const [w, h] = objShapes[best.shape][best.size];
+      for (let y = best.ty; y < Math.min(gh, best.ty + h); y++) {
+        for (let x = best.tx; x < Math.min(gw, best.tx + w); x++) {
+          covered[y][x] = true;
+        }
+      }
+      result.push({ tx: best.tx, ty: best.ty, shape: best.shape, size: best.size });
+    }
+  }
+  return result;
+}
+
+export function spritePack(frames: Frame[], bpp: 4 | 8, objCost: number): ISpritePack {
+  const chunks: Uint8Array[] = [];
+  const seen = new Map<string, number>();
+  let nextTile = 0;
+  const result: ISpritePiece[][] = [];
+  for (const frame of frames) {
+    // trim to the bounding box of non-transparent pixels
+    let x0 = Infinity;
+    let y0 = Infinity;
+    let x1 = -1;
+    let y1 = -1;
+    for (let y = 0; y < frame.length; y++) {
+      for (let x = 0; x < frame[y].length; x++) {
+        const p = frame[y][x];
+        if (p < 0 || p >= (1 << bpp)) {
+          throw `Invalid palette index for ${bpp}bpp sprite: ${p}`;
+        }
+        if (p) {
+          x0 = Math.min(x0, x);
+          y0 = Math.min(y0, y);
+          x1 = Math.max(x1, x);
+          y1 = Math.max(y1, y);
+        }
+      }
+    }
+    const pieces: ISpritePiece[] = [];
+    result.push(pieces);
+    if (x1 < 0) {
+      continue; // empty frame
+    }
+
+    const gw = Math.ceil((x1 - x0 + 1) / 8);
+    const gh = Math.ceil((y1 - y0 + 1) / 8);
+    const occupied: boolean[][] = [];
+    for (let ty = 0; ty < gh; ty++) {
+      const row: boolean[] = [];
+      for (let tx = 0; tx < gw; tx++) {
+        let any = false;
+        for (let y = 0; y < 8 && !any; y++) {
+          for (let x = 0; x < 8 && !any; x++) {
+            any = pixel(frame, x0 + tx * 8 + x, y0 + ty * 8 + y) !== 0;
+          }
+        }
+        row.push(any);
+      }
+      occupied.push(row);
+    }
+
+    for (const { tx, ty, shape, size } of coverFrame(occupied, objCost)) {
+      const [w, h] = objShapes[shape][size];
+      const px = x0 + tx * 8;
+      const py = y0 + ty * 8;
+      const data = encodeTiles(frame, px, py, w, h, bpp);
+      // identical pieces (across or within frames) share the same tiles
+      const key = `${w},${h},${data.join(',')}`;
+      let tile = seen.get(key);
+      if (tile === undefined) {
+        tile = nextTile;
+        seen.set(key, tile);
+        chunks.push(data);
+        nextTile += data.length / 32;
+      }
+      pieces.push({ x: px, y: py, shape, size, tile });
+    }
+  }
+  const tiles = new Uint8Array(nextTile * 32);
+  let offset = 0;
+  for (const chunk of chunks) {
+    tiles.set(chunk, offset);
+    offset += chunk.length;
+  }
+  return { tiles, frames: result };
+}
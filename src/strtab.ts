@@ -0,0 +1,382 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { BitWriter } from './bitstream.ts';
+
+export interface IStringTable {
+  data: Uint8Array;
+  offsets: number[];
+}
+
+export interface IStringDict {
+  entries: Uint8Array[];
+  strings: Uint8Array[];
+}
+
+export interface IHuffmanTable {
+  tree: Uint8Array;
+  data: Uint8Array;
+  offsets: number[]; // in bits
+}
+
+function checkNoZero(strings: Uint8Array[]) {
+  for (let i = 0; i < strings.length; i++) {
+    if (strings[i].indexOf(0) >= 0) {
+      throw `String ${i} contains a zero byte, which is reserved for the terminator`;
+    }
+  }
+}
+
+// compare strings from their last byte to their first
+function compareReversed(a: Uint8Array, b: Uint8Array): number {
+  const len = Math.min(a.length, b.length);
+  for (let i = 1; i <= len; i++) {
+    const d = a[a.length - i] - b[b.length - i];
+    if (d !== 0) {
+      return d;
+    }
+  }
+  return a.length - b.length;
+}
+
+function isSuffix(a: Uint8Array, b: Uint8Array): boolean {
+  if (a.length > b.length) {
+    return false;
+  }
+  for (let i = 1; i <= a.length; i++) {
+    if (a[a.length - i] !== b[b.length - i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// store each string zero-terminated, sharing storage when one string is a suffix of another
+export function packStrings(strings: Uint8Array[]): IStringTable {
+  checkNoZero(strings);
+  // sorting by reversed contents puts every string right before the strings that end with it
+  const order = strings.map((_, i) => i).sort((a, b) =>
+    compareReversed(strings[a], strings[b]) || a - b
+  );
+  const owner = new Int32Array(strings.length);
+  for (let j = order.length - 1; j >= 0; j--) {
+    const i = order[j];
+    if (j + 1 < order.length && isSuffix(strings[i], strings[order[j + 1]])) {
+      owner[i] = owner[order[j + 1]];
+    } else {
+      owner[i] = i;
+    }
+  }
+
+  const start = new Int32Array(strings.length);
+  let size = 0;
+  for (let i = 0; i < strings.length; i++) {
+    if (owner[i] === i) {
+      start[i] = size;
+      size += strings[i].length + 1;
+    }
+  }
+  const data = new Uint8Array(size);
+  const offsets: number[] = [];
+  for (let i = 0; i < strings.length; i++) {
+    const o = owner[i];
+    if (o === i) {
+      data.set(strings[i], start[i]);
+    }
+    offsets.push(start[o] + strings[o].length - strings[i].length);
+  }
+  return { data, offsets };
+}
+
+// prefix doubling with radix sort, O(n log n)
+function suffixArray(text: Int32Array, alphabet: number): Int32Array {
+  const n = text.length;
+  const sa = new Int32Array(n);
+  let rank = new Int32Array(n);
+  let next = new Int32Array(n);
+  const second = new Int32Array(n);
+  const count = new Int32Array(Math.max(alphabet, n) + 1);
+  if (n === 0) {
+    return sa;
+  }
+  for (let i = 0; i < n; i++) {
+    count[text[i]]++;
+  }
+  for (let c = 1; c < count.length; c++) {
+    count[c] += count[c - 1];
+  }
+  for (let i = n - 1; i >= 0; i--) {
+    sa[--count[text[i]]] = i;
+  }
+  let classes = 1;
+  rank[sa[0]] = 0;
+  for (let i = 1; i < n; i++) {
+    if (text[sa[i]] !== text[sa[i - 1]]) {
+      classes++;
+    }
+    rank[sa[i]] = classes - 1;
+  }
+  for (let k = 1; classes < n; k <<= 1) {
+    // order by the second half first: suffixes too short to have one sort first
+    let p = 0;
+    for (let i = n - k; i < n; i++) {
+      second[p++] = i;
+    }
+    for (let i = 0; i < n; i++) {
+      if (sa[i] >= k) {
+        second[p++] = sa[i] - k;
+      }
+    }
+    // then stable counting sort by the first half
+    count.fill(0, 0, classes);
+    for (let i = 0; i < n; i++) {
+      count[rank[i]]++;
+    }
+    for (let c = 1; c < classes; c++) {
+      count[c] += count[c - 1];
+    }
+    for (let i = n - 1; i >= 0; i--) {
+      const j = second[i];
+      sa[--count[rank[j]]] = j;
+    }
+    classes = 1;
+    next[sa[0]] = 0;
+    for (let i = 1; i < n; i++) {
+      const a = sa[i - 1];
+      const b = sa[i];
+      const a2 = a + k < n ? rank[a + k] : -1;
+      const b2 = b + k < n ? rank[b + k] : -1;
+      if (rank[a] !== rank[b] || a2 !== b2) {
+        classes++;
+      }
+      next[b] = classes - 1;
+    }
+    [rank, next] = [next, rank];
+  }
+  return sa;
+}
+
+// Kasai's algorithm; lcp[i] is the common prefix length of suffixes sa[i - 1] and sa[i]
+function lcpArray(text: Int32Array, sa: Int32Array): Int32Array {
+  const n = text.length;
+  const rank = new Int32Array(n);
+  const lcp = new Int32Array(n);
+  for (let i = 0; i < n; i++) {
+    rank[sa[i]] = i;
+  }
+  let h = 0;
+  for (let i = 0; i < n; i++) {
+    if (rank[i] > 0) {
+      const j = sa[rank[i] - 1];
+      while (i + h < n && j + h < n && text[i + h] === text[j + h]) {
+        h++;
+      }
+      lcp[rank[i]] = h;
+      if (h > 0) {
+        h--;
+      }
+    } else {
+      h = 0;
+    }
+  }
+  return lcp;
+}
+
+const MAX_ENTRY = 32;
+
+// replace frequent substrings with single byte codes `first` to `first + count - 1`
+export function buildDict(strings: Uint8Array[], count: number, first: number): IStringDict {
+  if (count < 1 || first < 1 || first + count > 256) {
+    throw 'Invalid dictionary code range';
+  }
+  let total = 0;
+  for (let i = 0; i < strings.length; i++) {
+    for (const b of strings[i]) {
+      if (b >= first && b < first + count) {
+        throw `String ${i} contains byte ${b}, which is reserved for dictionary codes`;
+      }
+    }
+    total += strings[i].length + 1;
+  }
+
+  // concatenate the strings, each followed by a unique separator so no match crosses strings
+  const text = new Int32Array(total);
+  let p = 0;
+  for (let i = 0; i < strings.length; i++) {
+    text.set(strings[i], p);
+    p += strings[i].length;
+    text[p++] = 256 + i;
+  }
+  const sa = suffixArray(text, 256 + strings.length);
+  const lcp = lcpArray(text, sa);
+
+  // every LCP interval is a substring that repeats (interval size) times
+  const candidates = new Map<string, { bytes: Uint8Array; score: number }>();
+  const consider = (len: number, occurs: number, at: number) => {
+    len = Math.min(len, MAX_ENTRY);
+    // each use saves (len - 1) bytes, and the entry itself costs len bytes plus a terminator
+    const score = occurs * (len - 1) - (len + 1);
+    if (len < 2 || score <= 0) {
+      return;
+    }
+    const bytes = Uint8Array.from(text.subarray(at, at + len));
+    const key = bytes.join(',');
+    const prev = candidates.get(key);
+    if (!prev || prev.score < score) {
+      candidates.set(key, { bytes, score });
+    }
+  };
+  const stack: { lcp: number; lb: number }[] = [{ lcp: 0, lb: 0 }];
+  for (let i = 1; i <= text.length; i++) {
+    const cur = i < text.length ? lcp[i] : 0;
+    let lb = i - 1;
+    while (stack[stack.length - 1].lcp > cur) {
+      const top = stack.pop() as { lcp: number; lb: number };
+      consider(top.lcp, i - top.lb, sa[top.lb]);
+      lb = top.lb;
+    }
+    if (stack[stack.length - 1].lcp < cur) {
+      stack.push({ lcp: cur, lb });
+    }
+  }
+
+  // pick the best candidates, skipping ones that overlap an entry already chosen, since their
+  // occurrences would mostly be consumed by it
+  const contains = (a: Uint8Array, b: Uint8Array) => {
+    outer: for (let i = 0; i + b.length <= a.length; i++) {
+      for (let j = 0; j < b.length; j++) {
+        if (a[i + j] !== b[j]) {
+          continue outer;
+        }
+      }
+      return true;
+    }
+    return false;
+  };
+  const entries: Uint8Array[] = [];
+  const sorted = Array.from(candidates.values()).sort((a, b) =>
+    b.score - a.score || compareReversed(a.bytes, b.bytes)
+  );
+  for (const { bytes } of sorted) {
+    if (entries.length >= count) {
+      break;
+    }
+    if (!entries.some((e) => contains(e, bytes) || contains(bytes, e))) {
+      entries.push(bytes);
+    }
+  }
+
+  // tokenize each string optimally (fewest output bytes) with dynamic programming
+  const codes = new Map<string, number>();
+  entries.forEach((e, i) => codes.set(e.join(','), first + i));
+  const maxLen = entries.reduce((m, e) => Math.max(m, e.length), 0);
+  const out = strings.map((s) => {
+    const cost = new Int32Array(s.length + 1);
+    const step = new Int32Array(s.length + 1);
+    for (let i = s.length - 1; i >= 0; i--) {
+      cost[i] = cost[i + 1] + 1;
+      step[i] = 1;
+      for (let len = 2; len <= maxLen && i + len <= s.length; len++) {
+        if (cost[i + len] + 1 < cost[i] && codes.has(s.subarray(i, i + len).join(','))) {
+          cost[i] = cost[i + len] + 1;
+          step[i] = len;
+        }
+      }
+    }
+    const res = new Uint8Array(cost[0]);
+    for (let i = 0, k = 0; i < s.length; i += step[i]) {
+      res[k++] = step[i] === 1 ? s[i] : codes.get(s.subarray(i, i + step[i]).join(',')) as number;
+    }
+    return res;
+  });
+  return { entries, strings: out };
+}
+
+interface IHuffNode {
+  weight: number;
+  id: number;
+  symbol: number;
+  left?: IHuffNode;
+  right?: IHuffNode;
+}
+
+// encode each string followed by a zero terminator using a Huffman code built for the table
+//
+// the tree is a list of nodes, each two little-endian 16-bit entries for the 0 and 1 branches; an
+// entry with bit 15 set is a leaf holding the byte in its low bits, otherwise it's the index of
+// the next node, starting from node 0
+export function huffmanStrings(strings: Uint8Array[], msb: boolean): IHuffmanTable {
+  checkNoZero(strings);
+  const freq = new Array(256).fill(0);
+  for (const s of strings) {
+    for (const b of s) {
+      freq[b]++;
+    }
+    freq[0]++;
+  }
+  let nodes: IHuffNode[] = [];
+  for (let symbol = 0; symbol < 256; symbol++) {
+    if (freq[symbol] > 0) {
+      nodes.push({ weight: freq[symbol], id: symbol, symbol });
+    }
+  }
+  if (nodes.length === 0) {
+    return { tree: new Uint8Array(0), data: new Uint8Array(0), offsets: [] };
+  }
+  let nextId = 256;
+  while (nodes.length > 1) {
+    nodes.sort((a, b) => a.weight - b.weight || a.id - b.id);
+    const [left, right] = nodes;
+    nodes = nodes.slice(2);
+    nodes.push({ weight: left.weight + right.weight, id: nextId++, symbol: -1, left, right });
+  }
+  let root = nodes[0];
+  if (root.symbol >= 0) {
+    // a single symbol still needs one bit per code
+    root = { weight: root.weight, id: nextId, symbol: -1, left: root, right: root };
+  }
+
+  // number the internal nodes breadth first, and collect the codes
+  const codes: number[][] = [];
+  const queue: { node: IHuffNode; code: number[] }[] = [{ node: root, code: [] }];
+  const index = new Map<IHuffNode, number>([[root, 0]]);
+  const entries: number[] = [];
+  for (let q = 0; q < queue.length; q++) {
+    const { node, code } = queue[q];
+    for (const [child, bit] of [[node.left, 0], [node.right, 1]] as [IHuffNode, number][]) {
+      if (child.symbol >= 0) {
+        entries.push(0x8000 | child.symbol);
+        codes[child.symbol] = codes[child.symbol] ?? [...code, bit];
+      } else {
+        index.set(child, index.size);
+        entries.push(index.size - 1);
+        queue.push({ node: child, code: [...code, bit] });
+      }
+    }
+  }
+  const tree = new Uint8Array(entries.length * 2);
+  entries.forEach((e, i) => {
+    tree[i * 2] = e & 0xff;
+    tree[i * 2 + 1] = e >> 8;
+  });
+
+  const bw = new BitWriter(msb);
+  const offsets: number[] = [];
+  const put = (symbol: number) => {
+    for (const bit of codes[symbol]) {
+      bw.write(bit, 1);
+    }
+  };
+  for (const s of strings) {
+    offsets.push(bw.bitLength());
+    for (const b of s) {
+      put(b);
+    }
+    put(0);
+  }
+  return { tree, data: bw.bytes(), offsets };
+}
@@ -0,0 +1,99 @@
+//
+// gvasm - Assembler and disassembler for Game Boy Advance homebrew
+// by Sean Connelly (@velipso), https://sean.cm
+// The Unlicense License
+// Project Home: https://github.com/velipso/gvasm
+//
+
+import { IMemoryDevice } from './run.ts';
+
+// TM0-TM3 for `gvasm run`, so code can time itself the same way it would on hardware
+//
+//   0x04000100 + n * 4  counter (read) or reload value (write)
+//   0x04000102 + n * 4  control:
+//     bits 0-1  prescaler: 1, 64, 256, or 1024 cycles per tick
+//     bit 2     count-up: tick when the previous timer overflows (not for TM0)
+//     bit 7     enable, which loads the counter with the reload value
+//
+// timers are brought up to date whenever they are read or written, instead of every cycle; they
+// don't raise interrupts
+
+const PRESCALERS = [1, 64, 256, 1024];
+
+export class Timers implements IMemoryDevice {
+  private clock: () => number;
+  private last = 0;
+  private reload = [0, 0, 0, 0];
+  private counter = [0, 0, 0, 0];
+  private control = [0, 0, 0, 0];
+  // cycles that haven't added up to a tick yet
+  private remainder = [0, 0, 0, 0];
+
+  constructor(clock: () => number) {
+    this.clock = clock;
+  }
+
+  private update() {
+    const now = this.clock();
+    const cycles = now - this.last;
+    this.last = now;
+    let overflows = 0;
+    for (let i = 0; i < 4; i++) {
+      const control = this.control[i];
+      if (!(control & 0x80)) {
+        overflows = 0;
+        continue;
+      }
+      let ticks = overflows;
+      if (i === 0 || !(control & 4)) {
+        const total = this.remainder[i] + cycles;
+        const prescaler = PRESCALERS[control & 3];
+        ticks = Math.floor(total / prescaler);
+        this.remainder[i] = total % prescaler;
+      }
+      let count = this.counter[i] + ticks;
+      overflows = 0;
+      if (count > 0xffff) {
+        const period = 0x10000 - this.reload[i];
+        overflows = 1 + Math.floor((count - 0x10000) / period);
+        count = this.reload[i] + (count - 0x10000) % period;
+      }
+      this.counter[i] = count;
+    }
+  }
+
+  public read8(offset: number) {
+    this.update();
+    const i = offset >> 2;
+    switch (offset & 3) {
+      case 0:
+        return this.counter[i] & 0xff;
+      case 1:
+        return this.counter[i] >> 8;
+      case 2:
+        return this.control[i];
+      default:
+        return 0;
+    }
+  }
+
+  public write8(offset: number, value: number) {
+    this.update();
+    const i = offset >> 2;
+    switch (offset & 3) {
+      case 0:
+        this.reload[i] = (this.reload[i] & 0xff00) | value;
+        break;
+      case 1:
+        this.reload[i] = (this.reload[i] & 0xff) | (value << 8);
+        break;
+      case 2:
+        if (!(this.control[i] & 0x80) && (value & 0x80)) {
+          this.counter[i] = this.reload[i];
+          this.remainder[i] = 0;
+        }
+        this.control[i] = value;
+        break;
+    }
+  }
+}
@@ -50,6 +50,14 @@ export function isNum(c: string) {
   return c >= '0' && c <= '9';
 }
 
+export function popcount(v: number) {
+  let count = 0;
+  for (; v; v &= v - 1) {
+    count++;
+  }
+  return count;
+}
+
 // reverse byte order
 export function b16(v: number) {
   const b1 = v & 0xff;